@@ -31,6 +31,8 @@
 
 #include <cstddef>
 
+#include <libfreenect2/packet_pipeline.h>
+
 namespace libfreenect2
 {
 
@@ -54,6 +56,22 @@ public:
    */
   virtual Buffer *allocate(size_t size) = 0;
   virtual void free(Buffer *b) = 0;
+
+  /* Allow up to count buffers to be allocated at once, if the allocator
+   * limits them. Others ignore it.
+   */
+  virtual void setCapacity(size_t /*count*/) {}
+
+  /* Create buffers ahead of use, if the allocator keeps them. Others
+   * ignore it.
+   */
+  virtual void setEagerAllocation(bool /*eager*/) {}
+
+  /* Fill in the use of the buffers and return true, if the allocator
+   * keeps track of it. Others return false.
+   */
+  virtual bool getStatistics(BufferStatistics &/*statistics*/) { return false; }
+
   virtual ~Allocator() {}
 };
 
@@ -91,6 +109,29 @@ public:
    * free() can be called from different threads than allocate().
    */
   virtual void free(Buffer *b);
+
+  /* Number of buffers that can be allocated at once, 2 by default.
+   * Buffers are created by the inner allocator on first use, and kept
+   * until the pool is destroyed, also if the capacity is reduced.
+   *
+   * setCapacity() can be called from any thread.
+   */
+  virtual void setCapacity(size_t count);
+
+  /* Create all buffers up to the capacity at once, from the first
+   * allocate() on and whenever the capacity grows, instead of on first use.
+   * Lazy by default.
+   *
+   * setEagerAllocation() can be called from any thread, which then runs the
+   * inner allocate().
+   */
+  virtual void setEagerAllocation(bool eager);
+
+  /* Use of the pool since it was created.
+   *
+   * getStatistics() can be called from any thread.
+   */
+  virtual bool getStatistics(BufferStatistics &statistics);
 private:
   PoolAllocatorImpl *impl_;
 };
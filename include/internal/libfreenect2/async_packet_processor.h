@@ -31,12 +31,24 @@
 
 #include <libfreenect2/threading.h>
 #include <libfreenect2/packet_processor.h>
+#include <libfreenect2/packet_pipeline.h>
 
 namespace libfreenect2
 {
 
 /**
  * Packet processor that runs asynchronously.
+ *
+ * Packets are queued for a background thread, up to a capacity which counts
+ * the packet being processed. A queue of one packet, the default, drops any
+ * packet arriving while the previous one is processed; longer queues absorb
+ * processing hiccups longer than a frame interval.
+ *
+ * The queue is a lock-free ring between one producer, the stream parser in
+ * the USB thread, and the background thread. ready() and process() only
+ * take the mutex to wake up the background thread when it is idle, which
+ * holds it only to go to sleep, or with the Block policy to wait for room.
+ *
  * @tparam PacketT Type of the packet being processed.
  */
 template<typename PacketT>
@@ -45,37 +57,95 @@ class AsyncPacketProcessor : public PacketProcessor<PacketT>
 public:
   typedef PacketProcessor<PacketT>* PacketProcessorPtr;
 
+  /** Largest queue capacity, see setQueue(). A power of two. */
+  static const uint32_t MaxQueueSize = 16;
+
   /**
    * Constructor.
    * @param processor Object performing the processing.
    */
   AsyncPacketProcessor(PacketProcessorPtr processor) :
     processor_(processor),
-    current_packet_available_(false),
-    shutdown_(false),
+    capacity_(1),
+    policy_(PacketPipeline::DropNewest),
+    shutdown_(0),
+    consumer_waiting_(0),
+    producer_waiting_(0),
     thread_(&AsyncPacketProcessor<PacketT>::static_execute, this)
   {
   }
 
   virtual ~AsyncPacketProcessor()
   {
-    shutdown_ = true;
-    packet_condition_.notify_one();
+    shutdown_.store(1);
+    {
+      libfreenect2::lock_guard l(packet_mutex_);
+      packet_condition_.notify_one();
+      space_condition_.notify_all();
+    }
 
     thread_.join();
+
+    PacketT packet;
+    while(takeOldest(packet, false))
+      releaseBuffer(packet);
   }
 
-  virtual bool ready()
+  /**
+   * Set the size of the queue, and what process() does when it is full.
+   * The buffer pool of the processor is sized to match, with one more
+   * buffer for the packet being received.
+   * @param capacity Number of packets, including the one being processed. 0 is taken as 1, and at most #MaxQueueSize.
+   * @param policy Policy when the queue is full.
+   */
+  void setQueue(size_t capacity, PacketPipeline::QueuePolicy policy)
   {
-    // try to aquire lock, if we succeed the background thread is waiting on packet_condition_
-    bool locked = packet_mutex_.try_lock();
+    if(capacity == 0)
+      capacity = 1;
+    if(capacity > MaxQueueSize)
+      capacity = MaxQueueSize;
 
-    if(locked)
+    capacity_.store((uint32_t)capacity);
+    policy_.store((uint32_t)policy);
     {
-      packet_mutex_.unlock();
+      libfreenect2::lock_guard l(packet_mutex_);
+      space_condition_.notify_all();
     }
+    processor_->setBufferCapacity(capacity + 1);
+  }
+
+  /** Number of packets queued, including the one being processed. */
+  size_t queueSize()
+  {
+    return size();
+  }
 
-    return locked;
+  /** Maximum of queueSize(), see setQueue(). */
+  size_t queueCapacity()
+  {
+    return capacity_.load();
+  }
+
+  /**
+   * Whether process() accepts a packet, according to the queue policy. When
+   * the queue is empty, the processor must also be ready() for the packet to
+   * be processed without waiting, except with the Block policy.
+   */
+  virtual bool ready()
+  {
+    const uint32_t policy = policy_.load();
+    if(policy != PacketPipeline::Block && size() == 0 && !processor_->ready())
+      return false;
+
+    switch(policy)
+    {
+    case PacketPipeline::DropOldest:
+      return size() < capacity_.load() || waiting() > 0;
+    case PacketPipeline::Block:
+      return true;
+    default:
+      return size() < capacity_.load();
+    }
   }
 
   virtual bool good()
@@ -83,16 +153,53 @@ public:
     return processor_->good();
   }
 
+  /**
+   * Queue a packet. Call only if ready(), and from one thread at a time.
+   * With the Block policy, this waits for room.
+   */
   virtual void process(const PacketT &packet)
   {
+    const uint32_t policy = policy_.load();
+
+    if(policy == PacketPipeline::Block && size() >= capacity_.load())
+    {
+      libfreenect2::unique_lock l(packet_mutex_);
+      producer_waiting_.store(1);
+      while(!shutdown_.load() && size() >= capacity_.load())
+        WAIT_CONDITION(space_condition_, packet_mutex_, l);
+      producer_waiting_.store(0);
+    }
+
+    if(policy == PacketPipeline::DropOldest)
+    {
+      PacketT dropped;
+      while(size() >= capacity_.load() && takeOldest(dropped, false))
+        releaseBuffer(dropped);
+    }
+
+    // With DropOldest, the thread may have taken the last waiting packet
+    // since ready(): then drop the new one. Also drop it if the thread is
+    // still copying the previous packet of its slot out of the ring.
+    const uint32_t tail = produced_.load();
+    if(shutdown_.load() || waiting() >= MaxQueueSize || (policy == PacketPipeline::DropOldest && size() >= capacity_.load()) || reading_.load() == tail % MaxQueueSize + 1)
+    {
+      PacketT dropped = packet;
+      releaseBuffer(dropped);
+      return;
+    }
+
+    slots_[tail % MaxQueueSize] = packet;
+    produced_.store(tail + 1);
+
+    if(consumer_waiting_.load())
     {
       libfreenect2::lock_guard l(packet_mutex_);
-      current_packet_ = packet;
-      current_packet_available_ = true;
+      packet_condition_.notify_one();
     }
-    packet_condition_.notify_one();
   }
 
+  virtual bool releasesBuffers() { return true; }
+
   virtual void allocateBuffer(PacketT &p, size_t size)
   {
     processor_->allocateBuffer(p, size);
@@ -103,16 +210,92 @@ public:
     processor_->releaseBuffer(p);
   }
 
+  virtual void setBufferCapacity(size_t count)
+  {
+    processor_->setBufferCapacity(count);
+  }
+
+  virtual void setEagerBufferAllocation(bool eager)
+  {
+    processor_->setEagerBufferAllocation(eager);
+  }
+
+  virtual bool getBufferStatistics(BufferStatistics &statistics)
+  {
+    return processor_->getBufferStatistics(statistics);
+  }
+
 private:
   PacketProcessorPtr processor_;  ///< The processing routine, executed in the asynchronous thread.
-  bool current_packet_available_; ///< Whether #current_packet_ still needs processing.
-  PacketT current_packet_;        ///< Packet being processed.
 
-  bool shutdown_;
-  libfreenect2::mutex packet_mutex_; ///< Mutex indicating a new packet can be stored in #current_packet_.
-  libfreenect2::condition_variable packet_condition_; ///< Mutex indicating processing is blocked on lack of packets.
+  /**
+   * Ring of packets. Packets from #consumed_ to #produced_ are waiting. The
+   * counters wrap around, and index #slots_ modulo #MaxQueueSize.
+   */
+  PacketT slots_[MaxQueueSize];
+  libfreenect2::atomic_uint32 produced_;   ///< Packets queued, written by process().
+  libfreenect2::atomic_uint32 consumed_;   ///< Packets taken from the queue, by the thread or dropped by process().
+  libfreenect2::atomic_uint32 processing_; ///< Whether the thread holds a packet; set before it takes one, cleared after releasing it.
+  libfreenect2::atomic_uint32 reading_;    ///< One plus the slot the thread copies a packet from, or 0. Set before it claims the packet, cleared after copying it.
+
+  libfreenect2::atomic_uint32 capacity_;  ///< Maximum number of packets, see setQueue().
+  libfreenect2::atomic_uint32 policy_;    ///< PacketPipeline::QueuePolicy.
+  libfreenect2::atomic_uint32 shutdown_;
+
+  libfreenect2::atomic_uint32 consumer_waiting_; ///< Whether the thread waits for #packet_condition_.
+  libfreenect2::atomic_uint32 producer_waiting_; ///< Whether process() waits for #space_condition_.
+  libfreenect2::mutex packet_mutex_; ///< Mutex of the conditions.
+  libfreenect2::condition_variable packet_condition_; ///< Condition of the processing thread waiting for packets.
+  libfreenect2::condition_variable space_condition_; ///< Condition of process() waiting for room in the queue.
   libfreenect2::thread thread_; ///< Asynchronous thread.
 
+  /** Number of packets waiting. */
+  uint32_t waiting() const
+  {
+    const uint32_t head = consumed_.load();
+    return produced_.load() - head;
+  }
+
+  /** Number of packets queued or being processed, possibly one too many while the thread takes one. */
+  uint32_t size() const
+  {
+    const uint32_t n = waiting();
+    return n + processing_.load();
+  }
+
+  /**
+   * Take the oldest waiting packet, if there is one. Both the thread and
+   * process() may take packets: each claims a packet before copying it, so
+   * only one of them reads its slot. process() may fill the slot again as
+   * soon as the packet is claimed, so the thread publishes the slot it reads
+   * in #reading_, and process() does not write it until the copy is done.
+   * @param packet Packet taken.
+   * @param publish Whether to publish the slot in #reading_, for the thread.
+   */
+  bool takeOldest(PacketT &packet, bool publish)
+  {
+    for(;;)
+    {
+      const uint32_t head = consumed_.load();
+      if(produced_.load() == head)
+      {
+        if(publish)
+          reading_.store(0);
+        return false;
+      }
+
+      if(publish)
+        reading_.store(head % MaxQueueSize + 1);
+      if(consumed_.compare_exchange(head, head + 1))
+      {
+        packet = slots_[head % MaxQueueSize];
+        if(publish)
+          reading_.store(0);
+        return true;
+      }
+    }
+  }
+
   /**
    * Wrapper function to start the thread.
    * @param data The #AsyncPacketProcessor object to use.
@@ -122,33 +305,65 @@ private:
     static_cast<AsyncPacketProcessor<PacketT> *>(data)->execute();
   }
 
-  /** Asynchronously process a provided packet. */
+  /**
+   * Wait for the next packet and take it from the queue.
+   * @return False on shutdown.
+   */
+  bool takePacket(PacketT &packet)
+  {
+    for(;;)
+    {
+      if(shutdown_.load())
+        return false;
+      processing_.store(1);
+      if(takeOldest(packet, true))
+        return true;
+      processing_.store(0);
+
+      libfreenect2::unique_lock l(packet_mutex_);
+      consumer_waiting_.store(1);
+      while(!shutdown_.load() && waiting() == 0)
+        WAIT_CONDITION(packet_condition_, packet_mutex_, l);
+      consumer_waiting_.store(0);
+    }
+  }
+
+  /** Mark the packet taken by takePacket() as done, and wake up process() if it waits for room. */
+  void completePacket()
+  {
+    processing_.store(0);
+
+    if(producer_waiting_.load())
+    {
+      libfreenect2::lock_guard l(packet_mutex_);
+      space_condition_.notify_all();
+    }
+  }
+
+  /** Asynchronously process the queued packets. */
   void execute()
   {
     this_thread::set_name(processor_->name());
-    libfreenect2::unique_lock l(packet_mutex_);
+    PacketT packet;
 
-    while(!shutdown_)
+    while(takePacket(packet))
     {
-      WAIT_CONDITION(packet_condition_, packet_mutex_, l);
+      // invoke process impl
+      if (processor_->good())
+        processor_->process(packet);
 
-      if(current_packet_available_)
-      {
-        // invoke process impl
-        if (processor_->good())
-          processor_->process(current_packet_);
-        /*
-         * The stream parser passes the buffer asynchronously to processors so
-         * it can not wait after process() finishes and free the buffer.  In
-         * theory releaseBuffer() should be called as soon as the access to it
-         * is finished, but right now no new allocateBuffer() will be called
-         * before ready() becomes true, so releaseBuffer() in the main loop of
-         * the async processor is OK.
-         */
-        releaseBuffer(current_packet_);
-
-        current_packet_available_ = false;
-      }
+      /*
+       * The stream parser passes the buffer asynchronously to processors so
+       * it can not wait after process() finishes and free the buffer.  In
+       * theory releaseBuffer() should be called as soon as the access to it
+       * is finished, but right now all processors are done with the packet
+       * when process() returns, so releaseBuffer() in the main loop of
+       * the async processor is OK. Processors which keep the packet say so.
+       */
+      if(!processor_->releasesBuffers())
+        releaseBuffer(packet);
+
+      completePacket();
     }
   }
 };
@@ -0,0 +1,267 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file cpu_depth_kernels.h Row kernels of the CPU depth processor, per instruction set. */
+
+#ifndef CPU_DEPTH_KERNELS_H_
+#define CPU_DEPTH_KERNELS_H_
+
+#include <libfreenect2/depth_packet_processor.h>
+
+namespace libfreenect2
+{
+
+/** Stage 1 output of one row: a, b and amplitude per frequency. */
+struct Stage1Row
+{
+  float *a[3], *b[3], *amplitude[3];
+};
+
+/** Bilateral filter output of one row. The amplitude is not filtered. */
+struct FilteredRow
+{
+  float *a[3], *b[3];
+  unsigned char *max_edge_test; ///< Whether the filter found no edge at the pixel.
+};
+
+/** Stage 2 output of one row, read by the edge filter. */
+struct Stage2Row
+{
+  float *raw_depth;
+  float *edge_test_depth; ///< #raw_depth, or 0 where the bilateral edge test failed.
+  float *ir_sum;
+  unsigned char *max_edge_test;
+};
+
+/** Number of phase unwrapping hypotheses ranked by the KDE phase unwrapping. */
+static const int KDE_NUM_HYPOTHESES = 30;
+
+/** Number of phase wraps of the second, first and third frequency for each hypothesis. */
+extern const float kde_k_list[KDE_NUM_HYPOTHESES], kde_n_list[KDE_NUM_HYPOTHESES], kde_m_list[KDE_NUM_HYPOTHESES];
+
+/**
+ * Likelihoods below KDE_MIN_CONF, and kernel terms with an exponent below
+ * KDE_MIN_EXPONENT, are taken as 0 by the KDE. This keeps denormal floats,
+ * which are very slow on x86, out of its sums, with a negligible effect on
+ * the result.
+ */
+static const float KDE_MIN_CONF = 1e-12f;
+static const float KDE_MIN_EXPONENT = -50.0f;
+
+/**
+ * Phase hypotheses of the KDE phase unwrapping, for the whole frame.
+ *
+ * Each plane has a border of Parameters::kde_neigborhood_size pixels on every
+ * side, so that the KDE can read the full neighbourhood of any pixel.
+ */
+struct KdePlanes
+{
+  float *phase[3]; ///< Pixel (0, 0) of the phase of each hypothesis.
+  float *conf[3];  ///< Pixel (0, 0) of the likelihood of each hypothesis; 0 on the border and pixels excluded from the KDE.
+  int stride;      ///< Number of floats from one row to the next.
+};
+
+/**
+ * Row kernels compute columns [x_begin, x_end) of a row, for a region of
+ * interest. Both are multiples of this, so that SIMD kernels need no tail.
+ */
+static const int CPU_DEPTH_COLUMN_ALIGNMENT = 16;
+
+/**
+ * Implementation of the vectorizable CPU depth passes for one instruction set.
+ *
+ * The "scalar" kernels are the reference implementation. Others compute the
+ * same with another float rounding, and with the approximations of
+ * cpu_simd.h, whose errors are below 3e-7. Given the same input, each of
+ * their outputs is within a bound of the scalar output, as an error scaled
+ * by the magnitude of the scalar value, at least 1, unless stated otherwise:
+ * - unpacked measurements, registered depth: exact;
+ * - stage 1 a, b and amplitude, scaled by the sum of the magnitudes of the
+ *   measurements times their multipliers, as these mostly cancel out: 1e-6;
+ * - stage 2 amplitude, IR: 1e-6;
+ * - bilateral filter a and b, scaled by the largest norm of the 3x3 input: 1e-6;
+ * - depth, scaled by the z table, so in units of phase: 1e-5, as the phase
+ *   of the second frequency is multiplied by 15 to unwrap it;
+ * - dealiasing confidence: 1e-4, as it squares the disagreement of the
+ *   unwrapped phases, which have the error of depth;
+ * - KDE phase hypotheses: 1e-6, and their likelihood: 1e-5. Hypotheses of
+ *   equal residual, as in pixels without signal, are ranked in any order.
+ *
+ * Values decided by comparing values that close may differ more, in at most
+ * 0.1% of the pixels: the edge test, by 1; the phase unwrapping, to 0 or
+ * another depth within the 18.75 m unambiguous range, a phase error up to 9,
+ * and its dealiasing confidence, by up to 1; the likelihood where the phase
+ * variance model is steep, near its branch, by 1e-2; and the color pixel of
+ * the registration, by one column.
+ * tools/cpu_depth_kernels_check.cpp checks these bounds.
+ */
+struct CpuDepthKernels
+{
+  const char *isa; ///< Name of the instruction set.
+
+  /**
+   * Unpack one row of a raw depth sub-image.
+   *
+   * A sub-image stores 512x424 11-bit codes, packed little-endian into rows of
+   * 352 16-bit words. Rows are stored bottom half first, and the bottom half
+   * upside down. Within a row, the code of pixel x is the (x / 4 + (x % 4) * 128)-th
+   * code, and the first and last pixel are invalid.
+   *
+   * @param data Packet data. Up to 8 bytes past the row may be read.
+   * @param sub Sub-image index.
+   * @param y Row in the image.
+   * @param lut Lookup table mapping 11-bit codes to measurements.
+   * @param x_begin First column, see CPU_DEPTH_COLUMN_ALIGNMENT.
+   * @param x_end Column after the last one.
+   * @param [out] out Measurements of the row, in pixel order; columns [x_begin, x_end) are written.
+   */
+  void (*unpackRow)(const unsigned char *data, int sub, int y, const int16_t *lut, int x_begin, int x_end, int16_t *out);
+
+  /**
+   * Stage 1 of one row: a, b and amplitude of each frequency from the raw measurements.
+   * @param params Processing parameters.
+   * @param raw Unpacked measurements of the row, three per frequency.
+   * @param p0_row Row of the P0 table of each frequency.
+   * @param z_table_row Row of the z table.
+   * @param x_begin First column, see CPU_DEPTH_COLUMN_ALIGNMENT.
+   * @param x_end Column after the last one.
+   * @param [out] out Output row.
+   */
+  void (*processStage1Row)(const DepthPacketProcessor::Parameters &params, const int16_t * const raw[9], const uint16_t * const p0_row[3],
+      const float *z_table_row, int x_begin, int x_end, const Stage1Row &out);
+
+  /**
+   * IR of one row, for frames whose depth is not computed.
+   * @param params Processing parameters.
+   * @param amplitude_in Stage 1 output.
+   * @param x_begin First column, see CPU_DEPTH_COLUMN_ALIGNMENT.
+   * @param x_end Column after the last one.
+   * @param [out] ir_out IR row.
+   */
+  void (*processIrRow)(const DepthPacketProcessor::Parameters &params, const Stage1Row &amplitude_in, int x_begin, int x_end, float *ir_out);
+
+  /**
+   * Joint bilateral filter of one row of stage 1 output. Pixels on the
+   * border of the image are not filtered.
+   * @param y Row.
+   * @param params Filter parameters.
+   * @param m Stage 1 output of rows y-1, y and y+1, from column x_begin - 1 to x_end, where they exist.
+   * @param width Image width, 512, or 256 when binning.
+   * @param height Image height, 424, or 212 when binning.
+   * @param x_begin First column, see CPU_DEPTH_COLUMN_ALIGNMENT.
+   * @param x_end Column after the last one.
+   * @param [out] out Filtered row and edge test.
+   */
+  void (*filterStage1Row)(int y, const DepthPacketProcessor::Parameters &params, const Stage1Row *m[3], int width, int height,
+      int x_begin, int x_end, const FilteredRow &out);
+
+  /**
+   * Phase unwrapping and depth of one row.
+   * @param params Processing parameters.
+   * @param in Stage 1 or bilateral filter output.
+   * @param amplitude_in Stage 1 output.
+   * @param x_table_row Row of the x table.
+   * @param z_table_row Row of the z table.
+   * @param x_begin First column, see CPU_DEPTH_COLUMN_ALIGNMENT.
+   * @param x_end Column after the last one.
+   * @param [out] ir_out IR row, or NULL.
+   * @param [out] depth_out Depth row.
+   * @param [out] ir_sum_out Sum of the amplitudes of the three frequencies, or NULL.
+   * @param [out] dealiasing_out Dealiasing confidence, see Frame::DealiasingConfidence, or NULL.
+   */
+  void (*processStage2Row)(const DepthPacketProcessor::Parameters &params, const FilteredRow &in, const Stage1Row &amplitude_in,
+      const float *x_table_row, const float *z_table_row, int x_begin, int x_end, float *ir_out, float *depth_out, float *ir_sum_out,
+      float *dealiasing_out);
+
+  /**
+   * Rank the phase unwrapping hypotheses of one row for the KDE, and compute IR.
+   * @param params Processing parameters; Parameters::num_hyps hypotheses are kept.
+   * @param in Stage 1 or bilateral filter output.
+   * @param amplitude_in Stage 1 output.
+   * @param x_begin First column, see CPU_DEPTH_COLUMN_ALIGNMENT.
+   * @param x_end Column after the last one.
+   * @param [out] ir_out IR row, or NULL.
+   * @param [out] out Hypotheses; row @p y is written.
+   * @param y Row.
+   */
+  void (*processKdePhaseRow)(const DepthPacketProcessor::Parameters &params, const FilteredRow &in, const Stage1Row &amplitude_in,
+      int x_begin, int x_end, float *ir_out, const KdePlanes &out, int y);
+
+  /**
+   * Select the hypothesis with the highest kernel density in the neighbourhood
+   * of each pixel of one row, and compute its depth.
+   * @param params Processing parameters.
+   * @param in Hypotheses of the whole frame.
+   * @param y Row.
+   * @param gauss 2 * Parameters::kde_neigborhood_size + 1 spatial weights.
+   * @param x_table_row Row of the x table.
+   * @param z_table_row Row of the z table.
+   * @param x_begin First column, see CPU_DEPTH_COLUMN_ALIGNMENT.
+   * @param x_end Column after the last one.
+   * @param [out] depth_out Depth row.
+   */
+  void (*filterKdeRow)(const DepthPacketProcessor::Parameters &params, const KdePlanes &in, int y, const float *gauss,
+      const float *x_table_row, const float *z_table_row, int x_begin, int x_end, float *depth_out);
+
+  /**
+   * Undistort depth and map it to color pixels, for Registration::apply().
+   * @param depth Depth image.
+   * @param map_dist Index of the distorted depth pixel of each pixel, or -1.
+   * @param map_x Color x coordinate of each pixel before the depth dependent shift.
+   * @param map_yi Color row of each pixel.
+   * @param shift_m Color camera shift parameter.
+   * @param fx Color camera focal length.
+   * @param cx Color camera principal point, plus 0.5 for rounding.
+   * @param size_color Number of color pixels.
+   * @param count Number of pixels, a multiple of 16.
+   * @param [out] undistorted Undistorted depth.
+   * @param [out] color_offset Offset of the color pixel, or -1 if there is none.
+   */
+  void (*mapDepthToColor)(const float *depth, const int *map_dist, const float *map_x, const int *map_yi,
+      float shift_m, float fx, float cx, int size_color, int count, float *undistorted, int *color_offset);
+
+  /** mapDepthToColor() reading UInt16 depth in millimeters, without converting the frame first. */
+  void (*mapUShortDepthToColor)(const uint16_t *depth, const int *map_dist, const float *map_x, const int *map_yi,
+      float shift_m, float fx, float cx, int size_color, int count, float *undistorted, int *color_offset);
+};
+
+/**
+ * Find the kernels for an instruction set.
+ * @param isa "scalar", "sse2", "avx2" or "neon", or NULL for the fastest one.
+ * @return Kernels, or NULL if @p isa is not built in or not supported by this CPU.
+ */
+const CpuDepthKernels *findCpuDepthKernels(const char *isa);
+
+/**
+ * Kernels for the instruction set named by the LIBFREENECT2_CPU_ISA
+ * environment variable, or the fastest ones supported by this CPU if it is
+ * unset or not supported.
+ */
+const CpuDepthKernels &selectCpuDepthKernels();
+
+} /* namespace libfreenect2 */
+
+#endif /* CPU_DEPTH_KERNELS_H_ */
@@ -0,0 +1,695 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/**
+ * @file cpu_depth_kernels_simd.h SIMD row kernels, templated on a vector type of cpu_simd.h.
+ *
+ * Included by each translation unit that instantiates them for an instruction
+ * set. Like cpu_simd.h, everything is in an anonymous namespace.
+ */
+
+#ifndef CPU_DEPTH_KERNELS_SIMD_H_
+#define CPU_DEPTH_KERNELS_SIMD_H_
+
+#include <libfreenect2/cpu_depth_kernels.h>
+#include <libfreenect2/cpu_simd.h>
+
+#include <string.h>
+
+namespace libfreenect2
+{
+namespace
+{
+
+/**
+ * Packed codes of row @p y of raw depth sub-image @p sub, see
+ * CpuDepthKernels::unpackRow.
+ */
+inline const unsigned char *packedRow(const unsigned char *data, int sub, int y)
+{
+  // 298496 = 512 * 424 * 11 / 8 = number of bytes per sub image
+  // 704 = 512 * 11 / 8 = number of bytes per row
+  return data + 298496 * sub + 704 * (y < 212 ? y + 212 : 423 - y);
+}
+
+/**
+ * Map the codes of a row to measurements in pixel order, for columns
+ * [x_begin, x_end). The first and last pixel are invalid.
+ */
+inline void lookUpCodes(const uint16_t codes[512], const int16_t *lut, int x_begin, int x_end, int16_t *out)
+{
+  for(int j = x_begin / 4; j < x_end / 4; ++j)
+  {
+    out[4 * j + 0] = lut[codes[j]];
+    out[4 * j + 1] = lut[codes[j + 128]];
+    out[4 * j + 2] = lut[codes[j + 256]];
+    out[4 * j + 3] = lut[codes[j + 384]];
+  }
+  if(x_begin == 0)
+    out[0] = lut[0];
+  if(x_end == 512)
+    out[511] = lut[0];
+}
+
+#ifdef LIBFREENECT2_SIMD_SSE2
+
+/** CpuDepthKernels::unpackRow with 16 codes per iteration. */
+inline void unpackRowSse2(const unsigned char *data, int sub, int y, const int16_t *lut, int x_begin, int x_end, int16_t *out)
+{
+  const unsigned char *row = packedRow(data, sub, y);
+  uint16_t codes[512];
+
+  // Columns [x_begin, x_end) use codes [code_begin, code_end) of each quarter
+  // of the row, rounded out to whole groups of 16 codes.
+  const int code_begin = x_begin / 64 * 16, code_end = (x_end + 63) / 64 * 16;
+
+  // 16 codes take 11 words. Code k starts at bit s of word w; it is obtained
+  // from the pair of words (w, w + 1) as (word_w >> s | word_w+1 << (16 - s)),
+  // and both shifts are done as 16-bit multiplies by 2^(16 - s). A code with
+  // s = 0 is read as s = 16 from the pair (w - 1, w) instead.
+  const __m128i mul0 = _mm_setr_epi16(1, 32, 1024, (short)32768, 16, 512, 16384, 8);
+  const __m128i mul1 = _mm_setr_epi16(256, 8192, 4, 128, 4096, 2, 64, 2048);
+  const __m128i mask = _mm_set1_epi16(2047);
+
+  // The loads read up to 8 bytes past the row, which is still inside the
+  // packet as the last sub-image is never unpacked.
+  for(int quarter = 0; quarter < 512; quarter += 128)
+  for(int i = quarter + code_begin; i < quarter + code_end; i += 16)
+  {
+    const uint16_t *words = reinterpret_cast<const uint16_t *>(row) + i / 16 * 11;
+    __m128i w0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(words));
+    __m128i w2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(words + 2));
+    __m128i w5 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(words + 5));
+    __m128i w8 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(words + 8));
+
+    // codes 0..7 use words 0..5
+    __m128i lo0 = _mm_unpacklo_epi64(_mm_shufflelo_epi16(w0, _MM_SHUFFLE(2, 1, 0, 0)), _mm_shufflelo_epi16(w2, _MM_SHUFFLE(2, 2, 1, 0)));
+    __m128i hi0 = _mm_unpacklo_epi64(w0, _mm_shufflelo_epi16(w2, _MM_SHUFFLE(3, 3, 2, 1)));
+    // codes 8..15 use words 5..11
+    __m128i lo1 = _mm_unpacklo_epi64(_mm_shufflelo_epi16(w5, _MM_SHUFFLE(2, 1, 1, 0)), _mm_shufflelo_epi16(w8, _MM_SHUFFLE(2, 1, 0, 0)));
+    __m128i hi1 = _mm_unpacklo_epi64(_mm_shufflelo_epi16(w5, _MM_SHUFFLE(3, 2, 2, 1)), _mm_shufflelo_epi16(w8, _MM_SHUFFLE(3, 2, 1, 1)));
+
+    __m128i c0 = _mm_and_si128(_mm_or_si128(_mm_mulhi_epu16(lo0, mul0), _mm_mullo_epi16(hi0, mul0)), mask);
+    __m128i c1 = _mm_and_si128(_mm_or_si128(_mm_mulhi_epu16(lo1, mul1), _mm_mullo_epi16(hi1, mul1)), mask);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(codes + i), c0);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(codes + i + 8), c1);
+  }
+
+  lookUpCodes(codes, lut, x_begin, x_end, out);
+}
+
+#endif // LIBFREENECT2_SIMD_SSE2
+
+/**
+ * Stage 1 of one frequency for V::size pixels starting at x.
+ *
+ * Same as processMeasurementTriple(), with the branches turned into selects
+ * and polynomial sine and cosine.
+ */
+template<typename V>
+inline void processMeasurementsStage1(int x, const DepthPacketProcessor::Parameters &params, const float cos_phase[3], const float sin_phase[3],
+    float abMultiplierPerFrq, const int16_t * const raw[3], const uint16_t *p0_row, V zmultiplier, float *a_out, float *b_out, float *amplitude_out)
+{
+  V m0 = V::loadShort(raw[0] + x), m1 = V::loadShort(raw[1] + x), m2 = V::loadShort(raw[2] + x);
+
+  V sin_p0, cos_p0;
+  vsincos(V::loadUShort(p0_row + x) * V(-float(0.000031 * 3.14159265358979324)), sin_p0, cos_p0);
+
+  V m_cos = V(cos_phase[0]) * m0 + V(cos_phase[1]) * m1 + V(cos_phase[2]) * m2;
+  V m_sin = V(sin_phase[0]) * m0 + V(sin_phase[1]) * m1 + V(sin_phase[2]) * m2;
+  V a = (cos_p0 * m_cos - sin_p0 * m_sin) * V(abMultiplierPerFrq);
+  V b = -(sin_p0 * m_cos + cos_p0 * m_sin) * V(abMultiplierPerFrq);
+  V amplitude = vsqrt(a * a + b * b) * V(params.ab_multiplier);
+
+  V saturated = (m0 == V(32767.0f)) | (m1 == V(32767.0f)) | (m2 == V(32767.0f));
+  V valid = V(0.0f) < zmultiplier;
+  a = vselect(saturated, V(0.0f), a);
+  b = vselect(saturated, V(0.0f), b);
+  amplitude = vselect(saturated, V(65535.0f), amplitude);
+
+  vselect(valid, a, V(0.0f)).store(a_out + x);
+  vselect(valid, b, V(0.0f)).store(b_out + x);
+  vselect(valid, amplitude, V(0.0f)).store(amplitude_out + x);
+}
+
+template<typename V>
+void processStage1RowSimd(const DepthPacketProcessor::Parameters &params, const int16_t * const raw[9], const uint16_t * const p0_row[3],
+    const float *z_table_row, int x_begin, int x_end, const Stage1Row &out)
+{
+  float cos_phase[3], sin_phase[3];
+  for(int i = 0; i < 3; ++i)
+  {
+    cos_phase[i] = cosf(params.phase_in_rad[i]);
+    sin_phase[i] = sinf(params.phase_in_rad[i]);
+  }
+
+  for(int x = x_begin; x < x_end; x += V::size)
+  {
+    V zmultiplier = V::load(z_table_row + x);
+    for(int i = 0; i < 3; ++i)
+    {
+      processMeasurementsStage1<V>(x, params, cos_phase, sin_phase, params.ab_multiplier_per_frq[i], raw + 3 * i, p0_row[i], zmultiplier,
+          out.a[i], out.b[i], out.amplitude[i]);
+    }
+  }
+}
+
+/** IR of V::size pixels from their stage 1 amplitudes. */
+template<typename V>
+inline void processIrPixels(int x, const DepthPacketProcessor::Parameters &params, const Stage1Row &amplitude_in, float *ir_out)
+{
+  V amplitude_sum = V::load(amplitude_in.amplitude[0] + x) + V::load(amplitude_in.amplitude[1] + x) + V::load(amplitude_in.amplitude[2] + x);
+  vmin(amplitude_sum * V(0.3333333f) * V(params.ab_output_multiplier), V(65535.0f)).store(ir_out + x);
+}
+
+template<typename V>
+void processIrRowSimd(const DepthPacketProcessor::Parameters &params, const Stage1Row &amplitude_in, int x_begin, int x_end, float *ir_out)
+{
+  for(int x = x_begin; x < x_end; x += V::size)
+  {
+    processIrPixels<V>(x, params, amplitude_in, ir_out);
+  }
+}
+
+/** Copy columns [x_begin, x_end) of a row unfiltered, for the image border. */
+inline void copyStage1Row(const Stage1Row &in, int x_begin, int x_end, const FilteredRow &out)
+{
+  for(int i = 0; i < 3; ++i)
+  {
+    memcpy(out.a[i] + x_begin, in.a[i] + x_begin, (x_end - x_begin) * sizeof(float));
+    memcpy(out.b[i] + x_begin, in.b[i] + x_begin, (x_end - x_begin) * sizeof(float));
+  }
+  memset(out.max_edge_test + x_begin, 1, x_end - x_begin);
+}
+
+/** 1 / sqrt(x), with +inf instead of NaN like the reference. */
+template<typename V>
+inline V invNorm(V norm2)
+{
+  V inv_norm = V(1.0f) / vsqrt(norm2);
+  return vselect(inv_norm == inv_norm, inv_norm, V(HUGE_VALF));
+}
+
+/**
+ * Joint bilateral filter of V::size pixels starting at x.
+ *
+ * Same operations as filterPixelStage1() in the same order, with the branches
+ * turned into selects. Only std::exp is replaced, by vexp().
+ */
+template<typename V>
+inline void filterPixelsStage1(int x, const DepthPacketProcessor::Parameters &params, const Stage1Row *m[3], const FilteredRow &out)
+{
+  const float threshold_param = (params.joint_bilateral_ab_threshold * params.joint_bilateral_ab_threshold) / (params.ab_multiplier * params.ab_multiplier);
+  V edge_test = V(0.0f) == V(0.0f);
+
+  for(int i = 0; i < 3; ++i)
+  {
+    V a = V::load(m[1]->a[i] + x), b = V::load(m[1]->b[i] + x);
+    V norm2 = a * a + b * b;
+    V inv_norm = invNorm(norm2);
+
+    V m_normalized0 = a * inv_norm;
+    V m_normalized1 = b * inv_norm;
+
+    V weight_acc = V(0.0f);
+    V weighted_m_acc0 = V(0.0f), weighted_m_acc1 = V(0.0f);
+
+    V below_threshold = norm2 < V(threshold_param);
+    V threshold = vselect(below_threshold, V(0.0f), V(threshold_param));
+    V exp_factor = V(-1.442695f) * vselect(below_threshold, V(0.0f), V(params.joint_bilateral_exp));
+
+    V dist_acc = V(0.0f);
+
+    int j = 0;
+    for(int yi = -1; yi < 2; ++yi)
+    {
+      for(int xi = -1; xi < 2; ++xi, ++j)
+      {
+        const V kernel = V(params.gaussian_kernel[j]);
+
+        if(yi == 0 && xi == 0)
+        {
+          weight_acc = weight_acc + kernel;
+
+          weighted_m_acc0 = weighted_m_acc0 + kernel * a;
+          weighted_m_acc1 = weighted_m_acc1 + kernel * b;
+          continue;
+        }
+
+        V other_a = V::load(m[yi + 1]->a[i] + x + xi), other_b = V::load(m[yi + 1]->b[i] + x + xi);
+        V other_norm2 = other_a * other_a + other_b * other_b;
+        V other_inv_norm = invNorm(other_norm2);
+
+        V dist = -((other_a * other_inv_norm) * m_normalized0 + (other_b * other_inv_norm) * m_normalized1);
+        dist = (dist + V(1.0f)) * V(0.5f);
+
+        V valid = other_norm2 >= threshold;
+        V weight = vselect(valid, kernel * vexp(exp_factor * dist), V(0.0f));
+        dist_acc = dist_acc + vselect(valid, dist, V(0.0f));
+
+        weighted_m_acc0 = weighted_m_acc0 + weight * other_a;
+        weighted_m_acc1 = weighted_m_acc1 + weight * other_b;
+
+        weight_acc = weight_acc + weight;
+      }
+    }
+
+    edge_test = edge_test & (dist_acc < V(params.joint_bilateral_max_edge));
+
+    V positive = V(0.0f) < weight_acc;
+    vselect(positive, weighted_m_acc0 / weight_acc, V(0.0f)).store(out.a[i] + x);
+    vselect(positive, weighted_m_acc1 / weight_acc, V(0.0f)).store(out.b[i] + x);
+  }
+
+  int edge_bits = vmovemask(edge_test);
+  for(int k = 0; k < V::size; ++k)
+  {
+    out.max_edge_test[x + k] = (edge_bits >> k) & 1;
+  }
+}
+
+template<typename V>
+void filterStage1RowSimd(int y, const DepthPacketProcessor::Parameters &params, const Stage1Row *m[3], int width, int height,
+    int x_begin, int x_end, const FilteredRow &out)
+{
+  if(y < 1 || y > height - 2)
+  {
+    copyStage1Row(*m[1], x_begin, x_end, out);
+    return;
+  }
+
+  if(x_begin == 0)
+    copyStage1Row(*m[1], 0, 1, out);
+  if(x_end == width)
+    copyStage1Row(*m[1], width - 1, width, out);
+
+  // The last block is moved back to end at the last inner pixel. It overlaps
+  // the previous one, which only recomputes the same values.
+  const int inner_begin = x_begin > 1 ? x_begin : 1, inner_end = x_end < width - 1 ? x_end : width - 1;
+  for(int x = inner_begin; x < inner_end; x += V::size)
+  {
+    filterPixelsStage1<V>(x + V::size <= inner_end ? x : inner_end - V::size, params, m, out);
+  }
+}
+
+/** Phase and amplitude of one frequency, see transformMeasurements(). */
+template<typename V>
+inline void transformMeasurementsSimd(const DepthPacketProcessor::Parameters &params, const float *a_ptr, const float *b_ptr, V &phase, V &amplitude)
+{
+  V a = V::load(a_ptr), b = V::load(b_ptr);
+
+  V tmp0 = vatan2(b, a);
+  tmp0 = vselect(tmp0 < V(0.0f), tmp0 + V(float(2.0 * 3.14159265358979324)), tmp0);
+  phase = vselect(tmp0 == tmp0, tmp0, V(0.0f));
+
+  amplitude = vsqrt(a * a + b * b) * V(params.ab_multiplier);
+}
+
+/** 1 where @p mask is set, 0 elsewhere. */
+template<typename V>
+inline V maskToFloat(V mask)
+{
+  return vselect(mask, V(1.0f), V(0.0f));
+}
+
+/**
+ * Phase unwrapping and depth of V::size pixels starting at x.
+ *
+ * Same as processPixelStage2(), with all branches turned into selects and
+ * polynomial atan2, log and exp. Intermediates that the reference computes
+ * in double precision are computed in float.
+ */
+template<typename V>
+inline void processPixelsStage2(int x, const DepthPacketProcessor::Parameters &params, const FilteredRow &in, const Stage1Row &amplitude_in,
+    const float *x_table_row, const float *z_table_row, float *ir_out, float *depth_out, float *ir_sum_out, float *dealiasing_out)
+{
+  V phase0, phase1, phase2, ir0, ir1, ir2;
+  transformMeasurementsSimd(params, in.a[0] + x, in.b[0] + x, phase0, ir0);
+  transformMeasurementsSimd(params, in.a[1] + x, in.b[1] + x, phase1, ir1);
+  transformMeasurementsSimd(params, in.a[2] + x, in.b[2] + x, phase2, ir2);
+
+  V ir_sum = ir0 + ir1 + ir2;
+  V ir_min = vmin(vmin(ir0, ir1), ir2);
+  V ir_max = vmax(vmax(ir0, ir1), ir2);
+  V valid = (ir_min >= V(params.individual_ab_threshold)) & (ir_sum >= V(params.ab_threshold));
+
+  V t0 = phase0 * V(float(3.0 / (2.0 * 3.14159265358979324)));
+  V t1 = phase1 * V(float(15.0 / (2.0 * 3.14159265358979324)));
+  V t2 = phase2 * V(float(2.0 / (2.0 * 3.14159265358979324)));
+
+  V t5 = vfloor((t1 - t0) * V(0.333333f) + V(0.5f)) * V(3.0f) + t0;
+  V t3 = t5 - t2;
+  V t4 = t3 * V(2.0f);
+
+  V c1 = t4 >= -t4; // true if t4 positive
+  V f1 = vselect(c1, V(2.0f), V(-2.0f));
+  V f2 = vselect(c1, V(0.5f), V(-0.5f));
+  t3 = t3 * f2;
+  t3 = (t3 - vfloor(t3)) * f1;
+
+  V abs_t3 = vabs(t3);
+  V c2 = (V(0.5f) < abs_t3) & (abs_t3 < V(1.5f));
+  V t6 = vselect(c2, t5 + V(15.0f), t5);
+  V t7 = vselect(c2, t1 + V(15.0f), t1);
+
+  V t8 = (vfloor((t6 - t2) * V(0.5f) + V(0.5f)) * V(2.0f) + t2) * V(0.5f);
+  t6 = t6 * V(0.333333f);
+  t7 = t7 * V(0.066667f);
+
+  V t9 = t8 + t6 + t7;
+  V t10 = t9 * V(0.333333f);
+
+  t6 = t6 * V(float(2.0 * 3.14159265358979324));
+  t7 = t7 * V(float(2.0 * 3.14159265358979324));
+  t8 = t8 * V(float(2.0 * 3.14159265358979324));
+
+  V t8_new = t7 * V(0.826977f) - t8 * V(0.110264f);
+  V t6_new = t8 * V(0.551318f) - t6 * V(0.826977f);
+  V t7_new = t6 * V(0.110264f) - t7 * V(0.551318f);
+
+  V norm = t8_new * t8_new + t6_new * t6_new + t7_new * t7_new;
+  t10 = t10 * maskToFloat(t9 >= V(0.0f));
+
+  V ir_x = vlog(0 < params.ab_confidence_slope ? ir_min : ir_max);
+  ir_x = (ir_x * V(params.ab_confidence_slope) * V(0.301030f) + V(params.ab_confidence_offset)) * V(3.321928f);
+  ir_x = vexp(ir_x);
+  ir_x = vmin(V(params.max_dealias_confidence), vmax(V(params.min_dealias_confidence), ir_x));
+  ir_x = ir_x * ir_x;
+
+  V phase = vselect(valid, t10 * maskToFloat(ir_x >= norm), V(0.0f));
+
+  if(dealiasing_out != 0)
+  {
+    vselect(V(0.0f) < phase, vmax(V(0.0f), V(1.0f) - norm / ir_x), V(0.0f)).store(dealiasing_out + x);
+  }
+
+  // this seems to be the phase to depth mapping :)
+  V zmultiplier = V::load(z_table_row + x);
+  V xmultiplier = V::load(x_table_row + x);
+
+  phase = vselect(V(0.0f) < phase, phase + V(params.phase_offset), phase);
+
+  V depth_linear = zmultiplier * phase;
+  V max_depth = phase * V(params.unambigious_dist) * V(2.0f);
+
+  V cond1 = (V(0.0f) < depth_linear) & (V(0.0f) < max_depth);
+
+  xmultiplier = (xmultiplier * V(90.0f)) / (max_depth * max_depth * V(8192.0f));
+
+  V depth_fit = depth_linear / (-depth_linear * xmultiplier + V(1.0f));
+  depth_fit = vselect(depth_fit < V(0.0f), V(0.0f), depth_fit);
+
+  vselect(cond1, depth_fit, depth_linear).store(depth_out + x);
+
+  if(ir_sum_out != 0)
+  {
+    ir_sum.store(ir_sum_out + x);
+  }
+
+  if(ir_out != 0)
+  {
+    processIrPixels<V>(x, params, amplitude_in, ir_out);
+  }
+}
+
+template<typename V>
+void processStage2RowSimd(const DepthPacketProcessor::Parameters &params, const FilteredRow &in, const Stage1Row &amplitude_in,
+    const float *x_table_row, const float *z_table_row, int x_begin, int x_end, float *ir_out, float *depth_out, float *ir_sum_out,
+    float *dealiasing_out)
+{
+  for(int x = x_begin; x < x_end; x += V::size)
+  {
+    processPixelsStage2<V>(x, params, in, amplitude_in, x_table_row, z_table_row, ir_out, depth_out, ir_sum_out, dealiasing_out);
+  }
+}
+
+/** Phase variance of one frequency, see calculatePhaseUnwrappingVar(). */
+template<typename V>
+inline V phaseUnwrappingVar(V ir, float gamma0, float gamma1, float gamma2, float root)
+{
+  V q = V(gamma0) * ir - V(gamma1) * ir * ir - V(gamma2);
+  q = q * q;
+
+  V sigma = vselect(V(root) < ir, V(root) * V(0.5f) * V(float(3.14159265358979324)) / ir, V(0.5f) * V(float(3.14159265358979324)));
+  sigma = vselect(V(1.0f) < q, vatan2(vsqrt(V(1.0f) / (q - V(1.0f))), V(1.0f)), sigma);
+  sigma = vselect(sigma < V(0.001f), V(0.001f), sigma);
+  return sigma * sigma;
+}
+
+/**
+ * Rank the phase unwrapping hypotheses of V::size pixels starting at x, and
+ * keep the best H.
+ *
+ * Same as processKdePhasePixel(), with the ranking done by selects and
+ * polynomial atan2 and exp.
+ */
+template<typename V, int H>
+inline void processKdePhasePixels(int x, const DepthPacketProcessor::Parameters &params, const FilteredRow &in, const Stage1Row &amplitude_in,
+    float *ir_out, const KdePlanes &out, int y)
+{
+  V phase0, phase1, phase2, ir0, ir1, ir2;
+  transformMeasurementsSimd(params, in.a[0] + x, in.b[0] + x, phase0, ir0);
+  transformMeasurementsSimd(params, in.a[1] + x, in.b[1] + x, phase1, ir1);
+  transformMeasurementsSimd(params, in.a[2] + x, in.b[2] + x, phase2, ir2);
+
+  V ir_sum = ir0 + ir1 + ir2;
+
+  const V two_pi(float(2.0 * 3.14159265358979324));
+  V t0 = phase0 / two_pi * V(3.0f);
+  V t1 = phase1 / two_pi * V(15.0f);
+  V t2 = phase2 / two_pi * V(2.0f);
+
+  V t10 = t1 - t0, t20 = t2 - t0, t21 = t2 - t1;
+  V u0 = t0 / V(3.0f), u1 = t1 / V(15.0f), u2 = t2 / V(2.0f);
+
+  // Residual and fused phase times 3 of the best hypotheses, kept sorted.
+  V err[3] = {V(100000.0f), V(200000.0f), V(300000.0f)};
+  V phase[3] = {V(0.0f), V(0.0f), V(0.0f)};
+
+  for(int i = 0; i < KDE_NUM_HYPOTHESES; ++i)
+  {
+    const float k = kde_k_list[i], n = kde_n_list[i], m = kde_m_list[i];
+
+    V err1 = V(3.0f * n - 15.0f * k) - t10;
+    V err2 = V(3.0f * n - 2.0f * m) - t20;
+    V err3 = V(15.0f * k - 2.0f * m) - t21;
+    V e = err1 * err1 + V(10.0f) * err2 * err2 + V(1.0218f) * err3 * err3;
+    V fused = (u2 + V(m)) + (u1 + V(k)) + (u0 + V(n));
+
+    V better0 = e < err[0], better1 = e < err[1];
+    if(H == 3)
+    {
+      V better2 = e < err[2];
+      err[2] = vselect(better1, err[1], vselect(better2, e, err[2]));
+      phase[2] = vselect(better1, phase[1], vselect(better2, fused, phase[2]));
+    }
+    err[1] = vselect(better0, err[0], vselect(better1, e, err[1]));
+    phase[1] = vselect(better0, phase[0], vselect(better1, fused, phase[1]));
+    err[0] = vselect(better0, e, err[0]);
+    phase[0] = vselect(better0, fused, phase[0]);
+  }
+
+  V var = phaseUnwrappingVar(ir0, 0.8211288451f, 0.002601348899f, 3.549793908f, 5.64173671f)
+      + phaseUnwrappingVar(ir1, 1.259642407f, 0.005478390508f, 4.335841127f, 4.31705182f)
+      + phaseUnwrappingVar(ir2, 0.6447928035f, 0.0009627273649f, 3.368205575f, 6.84453530f);
+  V phase_likelihood = vexp(-var / V(2.0f * params.phase_confidence_scale));
+  phase_likelihood = vselect((ir_sum < V(0.4f * 65535.0f)) & (phase_likelihood == phase_likelihood), phase_likelihood, V(0.0f));
+
+  const V max_phase(params.max_depth * 9.0f / 18750.0f);
+  const int offset = y * out.stride + x;
+
+  for(int j = 0; j < H; ++j)
+  {
+    V phase_j = phase[j] / V(3.0f);
+    V conf_j = phase_likelihood * vexp(-err[j] / V(2.0f * params.unwrapping_likelihood_scale));
+
+    phase_j.store(out.phase[j] + offset);
+    vselect((phase_j > max_phase) | (conf_j < V(KDE_MIN_CONF)), V(0.0f), conf_j).store(out.conf[j] + offset);
+  }
+
+  if(ir_out != 0)
+  {
+    processIrPixels<V>(x, params, amplitude_in, ir_out);
+  }
+}
+
+template<typename V>
+void processKdePhaseRowSimd(const DepthPacketProcessor::Parameters &params, const FilteredRow &in, const Stage1Row &amplitude_in,
+    int x_begin, int x_end, float *ir_out, const KdePlanes &out, int y)
+{
+  for(int x = x_begin; x < x_end; x += V::size)
+  {
+    if(params.num_hyps == 3)
+      processKdePhasePixels<V, 3>(x, params, in, amplitude_in, ir_out, out, y);
+    else
+      processKdePhasePixels<V, 2>(x, params, in, amplitude_in, ir_out, out, y);
+  }
+}
+
+/** 0, 1, 2, ...: the offset of each lane from the first pixel of a vector. */
+const float lane_offsets[8] = {0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f};
+
+/**
+ * Kernel density estimation of V::size pixels starting at x, with H hypotheses.
+ *
+ * Same as filterKdePixel(), except that it multiplies by the reciprocal of
+ * 2 * kde_sigma_sqr instead of dividing, and uses vexp().
+ */
+template<typename V, int H>
+inline void filterKdePixels(int x, const DepthPacketProcessor::Parameters &params, const KdePlanes &in, int y, const float *gauss,
+    const float *x_table_row, const float *z_table_row, float *depth_out)
+{
+  const int size = (int)params.kde_neigborhood_size;
+  const int offset = y * in.stride + x;
+  const V exp_scale(-1.0f / (2.0f * params.kde_sigma_sqr));
+
+  V phase_local[3], sum[3];
+  for(int j = 0; j < H; ++j)
+  {
+    phase_local[j] = V::load(in.phase[j] + offset);
+    sum[j] = V(0.0f);
+  }
+  V sum_gauss(0.0f);
+
+  for(int k = -size; k <= size; ++k)
+  {
+    const int row = offset + k * in.stride;
+
+    for(int l = -size; l <= size; ++l)
+    {
+      const V gauss_kl(gauss[k + size] * gauss[l + size]);
+
+      V phase_other[3], conf_other[3];
+      for(int h = 0; h < H; ++h)
+      {
+        phase_other[h] = V::load(in.phase[h] + row + l);
+        conf_other[h] = V::load(in.conf[h] + row + l);
+      }
+
+      V conf_sum = conf_other[0] + conf_other[1];
+      if(H == 3)
+        conf_sum = conf_sum + conf_other[2];
+      sum_gauss = sum_gauss + gauss_kl * conf_sum;
+
+      for(int j = 0; j < H; ++j)
+      {
+        V density(0.0f);
+        for(int h = 0; h < H; ++h)
+        {
+          V diff = phase_other[h] - phase_local[j];
+          V exponent = diff * diff * exp_scale;
+          density = density + conf_other[h] * vselect(exponent < V(KDE_MIN_EXPONENT), V(0.0f), vexp(exponent));
+        }
+        sum[j] = sum[j] + gauss_kl * density;
+      }
+    }
+  }
+
+  // The first and last column take no part in the KDE.
+  V xs = V::load(lane_offsets) + V(float(x));
+  V inner = (V(1.0f) <= xs) & (xs < V(511.0f));
+  V normalize = sum_gauss > V(0.5f);
+
+  V kde_val[3];
+  for(int j = 0; j < H; ++j)
+  {
+    kde_val[j] = vselect(inner, vselect(normalize, sum[j] / sum_gauss, sum[j] * V(2.0f)), V(0.0f));
+  }
+
+  //select hypothesis
+  V phase_final, max_val;
+  if(H == 3)
+  {
+    V not_first = (kde_val[1] > kde_val[0]) | (kde_val[2] > kde_val[0]);
+    V third = kde_val[2] > kde_val[1];
+    phase_final = vselect(not_first, vselect(third, phase_local[2], phase_local[1]), phase_local[0]);
+    max_val = vselect(not_first, vselect(third, kde_val[2], kde_val[1]), kde_val[0]);
+  }
+  else
+  {
+    V second = kde_val[1] > kde_val[0];
+    phase_final = vselect(second, phase_local[1], phase_local[0]);
+    max_val = vselect(second, kde_val[1], kde_val[0]);
+  }
+
+  V zmultiplier = V::load(z_table_row + x);
+  V xmultiplier = V::load(x_table_row + x);
+
+  V depth_linear = zmultiplier * phase_final;
+  V max_depth = phase_final * V(params.unambigious_dist) * V(2.0f);
+
+  V cond1 = (V(0.0f) < depth_linear) & (V(0.0f) < max_depth);
+
+  xmultiplier = (xmultiplier * V(90.0f)) / (max_depth * max_depth * V(8192.0f));
+
+  V depth_fit = depth_linear / (-depth_linear * xmultiplier + V(1.0f));
+  depth_fit = vselect(depth_fit < V(0.0f), V(0.0f), depth_fit);
+
+  V d = vselect(cond1, depth_fit, depth_linear);
+
+  V range_depth = H == 3 ? depth_linear : d;
+  max_val = vselect((range_depth < V(params.min_depth)) | (range_depth > V(params.max_depth)), V(0.0f), max_val);
+
+  vselect(max_val >= V(params.kde_threshold), d, V(0.0f)).store(depth_out + x);
+}
+
+template<typename V>
+void filterKdeRowSimd(const DepthPacketProcessor::Parameters &params, const KdePlanes &in, int y, const float *gauss,
+    const float *x_table_row, const float *z_table_row, int x_begin, int x_end, float *depth_out)
+{
+  for(int x = x_begin; x < x_end; x += V::size)
+  {
+    if(params.num_hyps == 3)
+      filterKdePixels<V, 3>(x, params, in, y, gauss, x_table_row, z_table_row, depth_out);
+    else
+      filterKdePixels<V, 2>(x, params, in, y, gauss, x_table_row, z_table_row, depth_out);
+  }
+}
+
+template<typename V, typename T>
+void mapDepthToColorSimd(const T *depth, const int *map_dist, const float *map_x, const int *map_yi,
+    float shift_m, float fx, float cx, int size_color, int count, float *undistorted, int *color_offset)
+{
+  for(int i = 0; i < count; i += V::size)
+  {
+    V z = V::gather(depth, map_dist + i);
+    z.store(undistorted + i);
+
+    V rx = (V::load(map_x + i) + V(shift_m) / z) * V(fx) + V(cx);
+    V c_off = vtrunc(rx) + V::loadInt(map_yi + i) * V(1920.0f);
+
+    // Offsets are exact in float within the color image, and anything
+    // larger is rejected.
+    V valid = (V(0.0f) < z) & (V(0.0f) <= c_off) & (c_off < V(float(size_color)));
+    vselect(valid, c_off, V(-1.0f)).storeInt(color_offset + i);
+  }
+}
+
+} /* namespace */
+} /* namespace libfreenect2 */
+
+#endif /* CPU_DEPTH_KERNELS_SIMD_H_ */
@@ -0,0 +1,465 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/**
+ * @file cpu_simd.h Thin wrappers around SIMD float vectors for the CPU depth kernels.
+ *
+ * A vector type V has a static member V::size (number of lanes), a broadcast
+ * constructor V(float), V::load() and store() for unaligned memory, the usual
+ * arithmetic operators, and comparisons returning masks of the same type with
+ * all bits of a lane set or cleared. The wrappers available depend on the
+ * instruction set the including file is compiled for.
+ *
+ * Everything is in an anonymous namespace: translation units compiled with
+ * different instruction set flags must not share (and have the linker merge)
+ * any of these functions. For the same reason, code using them should not
+ * call inline functions of the standard library.
+ */
+
+#ifndef CPU_SIMD_H_
+#define CPU_SIMD_H_
+
+#include <math.h>
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LIBFREENECT2_SIMD_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#define LIBFREENECT2_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace libfreenect2
+{
+namespace
+{
+
+#ifdef LIBFREENECT2_SIMD_SSE2
+
+/** 4 floats in an SSE2 register. */
+struct F32x4
+{
+  static const int size = 4;
+  __m128 v;
+
+  F32x4() {}
+  F32x4(__m128 v) : v(v) {}
+  explicit F32x4(float f) : v(_mm_set1_ps(f)) {}
+
+  static F32x4 load(const float *p) { return _mm_loadu_ps(p); }
+  /** Load and convert integers. */
+  static F32x4 loadInt(const int *p) { return _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))); }
+  /** Load and convert 16 bit integers. */
+  static F32x4 loadShort(const int16_t *p)
+  {
+    __m128i i = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(p));
+    return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(i, i), 16));
+  }
+  /** Load and convert 16 bit unsigned integers. */
+  static F32x4 loadUShort(const uint16_t *p)
+  {
+    __m128i i = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(p));
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(i, _mm_setzero_si128()));
+  }
+  /** base[index[i]] in lane i, or 0 where index[i] is negative. */
+  static F32x4 gather(const float *base, const int *index)
+  {
+    return _mm_setr_ps(index[0] >= 0 ? base[index[0]] : 0.0f, index[1] >= 0 ? base[index[1]] : 0.0f,
+                       index[2] >= 0 ? base[index[2]] : 0.0f, index[3] >= 0 ? base[index[3]] : 0.0f);
+  }
+  /** base[index[i]] converted in lane i, or 0 where index[i] is negative. */
+  static F32x4 gather(const uint16_t *base, const int *index)
+  {
+    return _mm_setr_ps(index[0] >= 0 ? base[index[0]] : 0.0f, index[1] >= 0 ? base[index[1]] : 0.0f,
+                       index[2] >= 0 ? base[index[2]] : 0.0f, index[3] >= 0 ? base[index[3]] : 0.0f);
+  }
+  void store(float *p) const { _mm_storeu_ps(p, v); }
+  /** Convert to integers, rounding towards zero, and store. */
+  void storeInt(int *p) const { _mm_storeu_si128(reinterpret_cast<__m128i *>(p), _mm_cvttps_epi32(v)); }
+};
+
+inline F32x4 operator+(F32x4 a, F32x4 b) { return _mm_add_ps(a.v, b.v); }
+inline F32x4 operator-(F32x4 a, F32x4 b) { return _mm_sub_ps(a.v, b.v); }
+inline F32x4 operator*(F32x4 a, F32x4 b) { return _mm_mul_ps(a.v, b.v); }
+inline F32x4 operator/(F32x4 a, F32x4 b) { return _mm_div_ps(a.v, b.v); }
+inline F32x4 operator-(F32x4 a) { return _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)); }
+inline F32x4 operator<(F32x4 a, F32x4 b) { return _mm_cmplt_ps(a.v, b.v); }
+inline F32x4 operator<=(F32x4 a, F32x4 b) { return _mm_cmple_ps(a.v, b.v); }
+inline F32x4 operator>(F32x4 a, F32x4 b) { return _mm_cmpgt_ps(a.v, b.v); }
+inline F32x4 operator>=(F32x4 a, F32x4 b) { return _mm_cmpge_ps(a.v, b.v); }
+inline F32x4 operator==(F32x4 a, F32x4 b) { return _mm_cmpeq_ps(a.v, b.v); }
+inline F32x4 operator&(F32x4 a, F32x4 b) { return _mm_and_ps(a.v, b.v); }
+inline F32x4 operator|(F32x4 a, F32x4 b) { return _mm_or_ps(a.v, b.v); }
+
+inline F32x4 vsqrt(F32x4 a) { return _mm_sqrt_ps(a.v); }
+inline F32x4 vabs(F32x4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+/** Lane-wise minimum. Returns @p b in lanes where either is NaN. */
+inline F32x4 vmin(F32x4 a, F32x4 b) { return _mm_min_ps(a.v, b.v); }
+/** Lane-wise maximum. Returns @p b in lanes where either is NaN. */
+inline F32x4 vmax(F32x4 a, F32x4 b) { return _mm_max_ps(a.v, b.v); }
+/** @p a where @p mask is set, @p b elsewhere. */
+inline F32x4 vselect(F32x4 mask, F32x4 a, F32x4 b) { return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)); }
+/** Round to the nearest integer, for |a| < 2^31. */
+inline F32x4 vround(F32x4 a) { return _mm_cvtepi32_ps(_mm_cvtps_epi32(a.v)); }
+/** Round towards minus infinity, for |a| < 2^31. */
+inline F32x4 vfloor(F32x4 a)
+{
+  __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+  return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a.v), _mm_set1_ps(1.0f)));
+}
+/** Split positive normal numbers into a mantissa in [0.5, 1) and exponent @p e, like frexp(). */
+inline F32x4 vfrexp(F32x4 a, F32x4 &e)
+{
+  __m128i bits = _mm_castps_si128(a.v);
+  e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(126)));
+  return _mm_or_ps(_mm_and_ps(a.v, _mm_castsi128_ps(_mm_set1_epi32(0x807fffff))), _mm_set1_ps(0.5f));
+}
+/** 2^n for integers -127 < n < 128. */
+inline F32x4 vexp2i(F32x4 n) { return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n.v), _mm_set1_epi32(127)), 23)); }
+/** Round towards zero, for |a| < 2^31. */
+inline F32x4 vtrunc(F32x4 a) { return _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v)); }
+/** Bit i is set if lane i of @p mask is set. */
+inline int vmovemask(F32x4 mask) { return _mm_movemask_ps(mask.v); }
+/** Mask of the lanes whose sign bit is set, -0 included. */
+inline F32x4 vsignbit(F32x4 a) { return _mm_castsi128_ps(_mm_srai_epi32(_mm_castps_si128(a.v), 31)); }
+
+#endif // LIBFREENECT2_SIMD_SSE2
+
+#ifdef LIBFREENECT2_SIMD_NEON
+
+/** 4 floats in a NEON register. Masks are stored as float bit patterns. */
+struct F32x4
+{
+  static const int size = 4;
+  float32x4_t v;
+
+  F32x4() {}
+  F32x4(float32x4_t v) : v(v) {}
+  F32x4(uint32x4_t mask) : v(vreinterpretq_f32_u32(mask)) {}
+  explicit F32x4(float f) : v(vdupq_n_f32(f)) {}
+
+  static F32x4 load(const float *p) { return vld1q_f32(p); }
+  /** Load and convert integers. */
+  static F32x4 loadInt(const int *p) { return vcvtq_f32_s32(vld1q_s32(p)); }
+  /** Load and convert 16 bit integers. */
+  static F32x4 loadShort(const int16_t *p) { return vcvtq_f32_s32(vmovl_s16(vld1_s16(p))); }
+  /** Load and convert 16 bit unsigned integers. */
+  static F32x4 loadUShort(const uint16_t *p) { return vcvtq_f32_u32(vmovl_u16(vld1_u16(p))); }
+  /** base[index[i]] in lane i, or 0 where index[i] is negative. */
+  static F32x4 gather(const float *base, const int *index)
+  {
+    float tmp[4];
+    for(int i = 0; i < 4; ++i)
+      tmp[i] = index[i] >= 0 ? base[index[i]] : 0.0f;
+    return vld1q_f32(tmp);
+  }
+  /** base[index[i]] converted in lane i, or 0 where index[i] is negative. */
+  static F32x4 gather(const uint16_t *base, const int *index)
+  {
+    float tmp[4];
+    for(int i = 0; i < 4; ++i)
+      tmp[i] = index[i] >= 0 ? base[index[i]] : 0.0f;
+    return vld1q_f32(tmp);
+  }
+  void store(float *p) const { vst1q_f32(p, v); }
+  /** Convert to integers, rounding towards zero, and store. */
+  void storeInt(int *p) const { vst1q_s32(p, vcvtq_s32_f32(v)); }
+  uint32x4_t mask() const { return vreinterpretq_u32_f32(v); }
+};
+
+inline F32x4 operator+(F32x4 a, F32x4 b) { return vaddq_f32(a.v, b.v); }
+inline F32x4 operator-(F32x4 a, F32x4 b) { return vsubq_f32(a.v, b.v); }
+inline F32x4 operator*(F32x4 a, F32x4 b) { return vmulq_f32(a.v, b.v); }
+inline F32x4 operator/(F32x4 a, F32x4 b) { return vdivq_f32(a.v, b.v); }
+inline F32x4 operator-(F32x4 a) { return vnegq_f32(a.v); }
+inline F32x4 operator<(F32x4 a, F32x4 b) { return vcltq_f32(a.v, b.v); }
+inline F32x4 operator<=(F32x4 a, F32x4 b) { return vcleq_f32(a.v, b.v); }
+inline F32x4 operator>(F32x4 a, F32x4 b) { return vcgtq_f32(a.v, b.v); }
+inline F32x4 operator>=(F32x4 a, F32x4 b) { return vcgeq_f32(a.v, b.v); }
+inline F32x4 operator==(F32x4 a, F32x4 b) { return vceqq_f32(a.v, b.v); }
+inline F32x4 operator&(F32x4 a, F32x4 b) { return vandq_u32(a.mask(), b.mask()); }
+inline F32x4 operator|(F32x4 a, F32x4 b) { return vorrq_u32(a.mask(), b.mask()); }
+
+inline F32x4 vsqrt(F32x4 a) { return vsqrtq_f32(a.v); }
+inline F32x4 vabs(F32x4 a) { return vabsq_f32(a.v); }
+/** Lane-wise minimum. Returns NaN in lanes where either is NaN. */
+inline F32x4 vmin(F32x4 a, F32x4 b) { return vminq_f32(a.v, b.v); }
+/** Lane-wise maximum. Returns NaN in lanes where either is NaN. */
+inline F32x4 vmax(F32x4 a, F32x4 b) { return vmaxq_f32(a.v, b.v); }
+/** @p a where @p mask is set, @p b elsewhere. */
+inline F32x4 vselect(F32x4 mask, F32x4 a, F32x4 b) { return vbslq_f32(mask.mask(), a.v, b.v); }
+/** Round to the nearest integer. */
+inline F32x4 vround(F32x4 a) { return vrndnq_f32(a.v); }
+/** Round towards minus infinity. */
+inline F32x4 vfloor(F32x4 a) { return vrndmq_f32(a.v); }
+/** Split positive normal numbers into a mantissa in [0.5, 1) and exponent @p e, like frexp(). */
+inline F32x4 vfrexp(F32x4 a, F32x4 &e)
+{
+  uint32x4_t bits = vreinterpretq_u32_f32(a.v);
+  e = vcvtq_f32_s32(vsubq_s32(vreinterpretq_s32_u32(vshrq_n_u32(bits, 23)), vdupq_n_s32(126)));
+  return vorrq_u32(vandq_u32(bits, vdupq_n_u32(0x807fffff)), vdupq_n_u32(0x3f000000));
+}
+/** 2^n for integers -127 < n < 128. */
+inline F32x4 vexp2i(F32x4 n) { return vreinterpretq_f32_s32(vshlq_n_s32(vaddq_s32(vcvtq_s32_f32(n.v), vdupq_n_s32(127)), 23)); }
+/** Round towards zero. */
+inline F32x4 vtrunc(F32x4 a) { return vrndq_f32(a.v); }
+/** Bit i is set if lane i of @p mask is set. */
+inline int vmovemask(F32x4 mask)
+{
+  static const int32_t shift[4] = {0, 1, 2, 3};
+  return vaddvq_u32(vshlq_u32(vshrq_n_u32(mask.mask(), 31), vld1q_s32(shift)));
+}
+/** Mask of the lanes whose sign bit is set, -0 included. */
+inline F32x4 vsignbit(F32x4 a) { return vreinterpretq_u32_s32(vshrq_n_s32(vreinterpretq_s32_f32(a.v), 31)); }
+
+#endif // LIBFREENECT2_SIMD_NEON
+
+#ifdef __AVX2__
+
+/** 8 floats in an AVX register, using AVX2 integer and gather instructions. */
+struct F32x8
+{
+  static const int size = 8;
+  __m256 v;
+
+  F32x8() {}
+  F32x8(__m256 v) : v(v) {}
+  explicit F32x8(float f) : v(_mm256_set1_ps(f)) {}
+
+  static F32x8 load(const float *p) { return _mm256_loadu_ps(p); }
+  /** Load and convert integers. */
+  static F32x8 loadInt(const int *p) { return _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p))); }
+  /** Load and convert 16 bit integers. */
+  static F32x8 loadShort(const int16_t *p) { return _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)))); }
+  /** Load and convert 16 bit unsigned integers. */
+  static F32x8 loadUShort(const uint16_t *p) { return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)))); }
+  /** base[index[i]] in lane i, or 0 where index[i] is negative. */
+  static F32x8 gather(const float *base, const int *index)
+  {
+    __m256i idx = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(index));
+    __m256 mask = _mm256_castsi256_ps(_mm256_cmpgt_epi32(idx, _mm256_set1_epi32(-1)));
+    return _mm256_mask_i32gather_ps(_mm256_setzero_ps(), base, idx, mask, 4);
+  }
+  /**
+   * base[index[i]] converted in lane i, or 0 where index[i] is negative.
+   * A 32 bit gather could read past the end of @p base, so lanes are loaded one by one.
+   */
+  static F32x8 gather(const uint16_t *base, const int *index)
+  {
+    float tmp[8];
+    for(int i = 0; i < 8; ++i)
+      tmp[i] = index[i] >= 0 ? base[index[i]] : 0.0f;
+    return _mm256_loadu_ps(tmp);
+  }
+  void store(float *p) const { _mm256_storeu_ps(p, v); }
+  /** Convert to integers, rounding towards zero, and store. */
+  void storeInt(int *p) const { _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), _mm256_cvttps_epi32(v)); }
+};
+
+inline F32x8 operator+(F32x8 a, F32x8 b) { return _mm256_add_ps(a.v, b.v); }
+inline F32x8 operator-(F32x8 a, F32x8 b) { return _mm256_sub_ps(a.v, b.v); }
+inline F32x8 operator*(F32x8 a, F32x8 b) { return _mm256_mul_ps(a.v, b.v); }
+inline F32x8 operator/(F32x8 a, F32x8 b) { return _mm256_div_ps(a.v, b.v); }
+inline F32x8 operator-(F32x8 a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)); }
+inline F32x8 operator<(F32x8 a, F32x8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+inline F32x8 operator<=(F32x8 a, F32x8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+inline F32x8 operator>(F32x8 a, F32x8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+inline F32x8 operator>=(F32x8 a, F32x8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+inline F32x8 operator==(F32x8 a, F32x8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ); }
+inline F32x8 operator&(F32x8 a, F32x8 b) { return _mm256_and_ps(a.v, b.v); }
+inline F32x8 operator|(F32x8 a, F32x8 b) { return _mm256_or_ps(a.v, b.v); }
+
+inline F32x8 vsqrt(F32x8 a) { return _mm256_sqrt_ps(a.v); }
+inline F32x8 vabs(F32x8 a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+/** Lane-wise minimum. Returns @p b in lanes where either is NaN. */
+inline F32x8 vmin(F32x8 a, F32x8 b) { return _mm256_min_ps(a.v, b.v); }
+/** Lane-wise maximum. Returns @p b in lanes where either is NaN. */
+inline F32x8 vmax(F32x8 a, F32x8 b) { return _mm256_max_ps(a.v, b.v); }
+/** @p a where @p mask is set, @p b elsewhere. */
+inline F32x8 vselect(F32x8 mask, F32x8 a, F32x8 b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+/** Round to the nearest integer. */
+inline F32x8 vround(F32x8 a) { return _mm256_round_ps(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+/** Round towards minus infinity. */
+inline F32x8 vfloor(F32x8 a) { return _mm256_floor_ps(a.v); }
+/** Round towards zero. */
+inline F32x8 vtrunc(F32x8 a) { return _mm256_round_ps(a.v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC); }
+/** 2^n for integers -127 < n < 128. */
+inline F32x8 vexp2i(F32x8 n) { return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(n.v), _mm256_set1_epi32(127)), 23)); }
+/** Split positive normal numbers into a mantissa in [0.5, 1) and exponent @p e, like frexp(). */
+inline F32x8 vfrexp(F32x8 a, F32x8 &e)
+{
+  __m256i bits = _mm256_castps_si256(a.v);
+  e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126)));
+  return _mm256_or_ps(_mm256_and_ps(a.v, _mm256_castsi256_ps(_mm256_set1_epi32(0x807fffff))), _mm256_set1_ps(0.5f));
+}
+/** Bit i is set if lane i of @p mask is set. */
+inline int vmovemask(F32x8 mask) { return _mm256_movemask_ps(mask.v); }
+/** Mask of the lanes whose sign bit is set, -0 included. */
+inline F32x8 vsignbit(F32x8 a) { return _mm256_castsi256_ps(_mm256_srai_epi32(_mm256_castps_si256(a.v), 31)); }
+
+#endif // __AVX2__
+
+/**
+ * Vectorized e^x.
+ *
+ * Cephes-style range reduction to x = n ln(2) + r with |r| <= ln(2) / 2,
+ * followed by a degree 7 polynomial for e^r. The relative error against the
+ * exact result is below 1e-7 (1 ulp) for -87 < x < 88, checked on all floats
+ * in that range; the result is clamped outside of it. NaN inputs give NaN.
+ */
+template<typename V>
+inline V vexp(V x)
+{
+  // The operand order makes NaN pass through on both SSE and NEON.
+  x = vmax(V(-87.0f), vmin(V(88.0f), x));
+
+  V n = vround(x * V(1.44269504088896341f));
+  V r = x - n * V(0.693359375f) - n * V(-2.12194440e-4f);
+
+  V p = V(1.9875691500E-4f);
+  p = p * r + V(1.3981999507E-3f);
+  p = p * r + V(8.3334519073E-3f);
+  p = p * r + V(4.1665795894E-2f);
+  p = p * r + V(1.6666665459E-1f);
+  p = p * r + V(5.0000001201E-1f);
+  p = p * (r * r) + r + V(1.0f);
+
+  return p * vexp2i(n);
+}
+
+/**
+ * Vectorized natural logarithm.
+ *
+ * Cephes-style: log(m 2^e) with sqrt(1/2) <= m < sqrt(2), and a degree 9
+ * polynomial for log(m). The absolute error is below 1e-7 for m near 1 and the
+ * relative error below 1e-7 elsewhere, for positive normal numbers. 0 gives
+ * -inf; negative numbers, denormals, inf and NaN are not supported.
+ */
+template<typename V>
+inline V vlog(V x)
+{
+  V e;
+  V m = vfrexp(x, e);
+
+  V small = m < V(0.707106781186547524f);
+  e = e - vselect(small, V(1.0f), V(0.0f));
+  m = m + vselect(small, m, V(0.0f)) - V(1.0f);
+
+  V z = m * m;
+  V p = V(7.0376836292E-2f);
+  p = p * m + V(-1.1514610310E-1f);
+  p = p * m + V(1.1676998740E-1f);
+  p = p * m + V(-1.2420140846E-1f);
+  p = p * m + V(1.4249322787E-1f);
+  p = p * m + V(-1.6668057665E-1f);
+  p = p * m + V(2.0000714765E-1f);
+  p = p * m + V(-2.4999993993E-1f);
+  p = p * m + V(3.3333331174E-1f);
+  p = p * m * z;
+  p = p + e * V(-2.12194440e-4f);
+  p = p - z * V(0.5f);
+
+  V r = m + p + e * V(0.693359375f);
+  return vselect(x == V(0.0f), V(-HUGE_VALF), r);
+}
+
+/**
+ * Vectorized sine and cosine, for |x| < 8192.
+ *
+ * Cephes-style: x = j pi/4 + r with an even j and |r| <= pi/4, a polynomial
+ * for the sine or cosine of r picked by j mod 8, and the sign of the octant.
+ * The absolute error is below 1e-7 (about 1 ulp of the result near 1).
+ */
+template<typename V>
+inline void vsincos(V x, V &s, V &c)
+{
+  V ax = vabs(x);
+  V j = vfloor(ax * V(1.27323954473516268f));
+  j = j + (j - V(2.0f) * vfloor(j * V(0.5f)));
+  V r = ((ax - j * V(0.78515625f)) - j * V(2.4187564849853515625e-4f)) - j * V(3.77489497744594108e-8f);
+  V octant = j - V(8.0f) * vfloor(j * V(0.125f));
+
+  V z = r * r;
+  V ps = V(-1.9515295891E-4f);
+  ps = ps * z + V(8.3321608736E-3f);
+  ps = ps * z + V(-1.6666654611E-1f);
+  ps = ps * z * r + r;
+  V pc = V(2.443315711809948E-5f);
+  pc = pc * z + V(-1.388731625493765E-3f);
+  pc = pc * z + V(4.166664568298827E-2f);
+  pc = pc * z * z - z * V(0.5f) + V(1.0f);
+
+  // Octants 0, 2, 4 and 6 start at 0, pi/2, pi and 3pi/2.
+  V swap = (octant == V(2.0f)) | (octant == V(6.0f));
+  V sin_negative = V(3.0f) < octant;
+  V cos_negative = (octant == V(2.0f)) | (octant == V(4.0f));
+  s = vselect(swap, pc, ps);
+  c = vselect(swap, ps, pc);
+  s = vselect(sin_negative, -s, s);
+  c = vselect(cos_negative, -c, c);
+  s = vselect(x < V(0.0f), -s, s);
+}
+
+/**
+ * Vectorized atan2(y, x) for finite inputs.
+ *
+ * The ratio of the smaller to the larger of |x| and |y| is reduced around
+ * tan(pi/8) like Cephes atanf(), and the result is moved into the quadrant of
+ * (x, y). The absolute error is below 3e-7, about 1 ulp of pi. Like
+ * std::atan2(), the sign of zeros picks the quadrant: atan2(-0, -0) is -pi.
+ */
+template<typename V>
+inline V vatan2(V y, V x)
+{
+  V ax = vabs(x), ay = vabs(y);
+  V num = vmin(ax, ay), den = vmax(ax, ay);
+  V t = vselect(den == V(0.0f), V(0.0f), num / den);
+
+  V reduced = t > V(0.4142135623730950f);
+  V offset = vselect(reduced, V(0.785398163397448310f), V(0.0f));
+  t = vselect(reduced, (t - V(1.0f)) / (t + V(1.0f)), t);
+
+  V z = t * t;
+  V p = V(8.05374449538e-2f);
+  p = p * z + V(-1.38776856032E-1f);
+  p = p * z + V(1.99777106478E-1f);
+  p = p * z + V(-3.33329491539E-1f);
+  V r = offset + (p * z * t + t);
+
+  r = vselect(ay > ax, V(1.57079632679489662f) - r, r);
+  r = vselect(vsignbit(x), V(3.14159265358979324f) - r, r);
+  return vselect(vsignbit(y), -r, r);
+}
+
+} /* namespace */
+} /* namespace libfreenect2 */
+
+#endif /* CPU_SIMD_H_ */
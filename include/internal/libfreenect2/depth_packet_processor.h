@@ -31,6 +31,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <vector>
 
 #include <libfreenect2/config.h>
 #include <libfreenect2/libfreenect2.hpp>
@@ -51,6 +52,73 @@ struct DepthPacket
   Buffer *memory;
 };
 
+/** Rectangle of pixels of the 512x424 depth and IR frames: columns [x_begin, x_end), rows [y_begin, y_end). */
+struct DepthRoi
+{
+  int x_begin, x_end, y_begin, y_end;
+
+  /** The whole frame. */
+  DepthRoi();
+
+  /** Region of interest of @p config, clipped to the frame; the whole frame if it is empty. */
+  explicit DepthRoi(const Freenect2Device::Config &config);
+
+  /** Pixels of 2x2 binned or downsampled frames covering this region. */
+  DepthRoi binned() const;
+
+  bool operator==(const DepthRoi &other) const;
+  bool operator!=(const DepthRoi &other) const { return !(*this == other); }
+};
+
+/**
+ * Adaptive depth quality, see Freenect2Device::Config::EnableAdaptiveDepthQuality.
+ *
+ * Keeps a moving average of the processing time of the packets. It steps
+ * down one Freenect2Device::DepthQuality level when the average exceeds the
+ * budget, and back up when it is well below it. Each change waits for the
+ * average to settle; stepping back up waits longer, and twice as long each
+ * time a step up has to be undone, so that the quality does not oscillate.
+ */
+class DepthQualityController
+{
+public:
+  DepthQualityController();
+
+  /** Restart at full quality, with the budget of @p config. */
+  void setConfiguration(const Freenect2Device::Config &config);
+
+  /**
+   * Record the processing time of a packet.
+   * @param seconds Processing time.
+   * @return Whether quality() changed.
+   */
+  bool update(double seconds);
+
+  Freenect2Device::DepthQuality quality() const { return quality_; }
+
+  /** Average processing time in seconds. */
+  float averageTime() const { return (float)average_; }
+
+  /** @p config reduced to quality(). */
+  Freenect2Device::Config apply(const Freenect2Device::Config &config) const;
+
+private:
+  /** Whether @p quality processes differently from the level above it, for #config_. */
+  bool reduces(int quality) const;
+
+  /** Move to the next level in @p direction (+1 cheaper, -1 better) that changes the processing. @return Whether there is one. */
+  bool step(int direction);
+
+  Freenect2Device::Config config_;
+  bool enabled_;
+  double budget_;
+  double average_;
+  int frames_;    ///< Packets since the last change.
+  int up_delay_;  ///< Packets to wait before stepping up.
+  bool last_up_;  ///< Whether the last change was a step up.
+  Freenect2Device::DepthQuality quality_;
+};
+
 /** Class for processing depth information. */
 typedef PacketProcessor<DepthPacket> BaseDepthPacketProcessor;
 
@@ -109,16 +177,31 @@ public:
   virtual void setFrameListener(libfreenect2::FrameListener *listener);
   virtual void setConfiguration(const libfreenect2::DepthPacketProcessor::Config &config);
 
+  /** Receive changes of the adaptive quality. Processors without it never call @p listener. */
+  virtual void setDepthQualityListener(libfreenect2::DepthQualityListener *listener);
+
   virtual void loadP0TablesFromCommandResponse(unsigned char* buffer, size_t buffer_length) = 0;
 
   static const size_t TABLE_SIZE = 512*424;
+  static const size_t BINNED_TABLE_SIZE = 256*212;
   static const size_t LUT_SIZE = 2048;
   virtual void loadXZTables(const float *xtable, const float *ztable) = 0;
   virtual void loadLookupTable(const short *lut) = 0;
 
+  /**
+   * Load the x/z tables of 2x2 binned pixels, see Config::EnableDepthBinning.
+   * Processors without binning ignore them.
+   */
+  virtual void loadBinnedXZTables(const float *xtable, const float *ztable);
+
 protected:
   libfreenect2::DepthPacketProcessor::Config config_;
+  DepthRoi roi_; ///< Region of interest of #config_.
   libfreenect2::FrameListener *listener_;
+  libfreenect2::DepthQualityListener *quality_listener_;
+
+  /** Set the pixels of a frame outside @p roi to 0. */
+  static void clearOutsideRoi(Frame *frame, const DepthRoi &roi);
 };
 
 #ifdef LIBFREENECT2_WITH_OPENGL_SUPPORT
@@ -155,17 +238,104 @@ public:
   virtual ~CpuDepthPacketProcessor();
   virtual void setConfiguration(const libfreenect2::DepthPacketProcessor::Config &config);
 
+  /**
+   * Split each frame into row bands processed by this many threads.
+   * @param num_threads Number of threads; 0 selects the value of the
+   * LIBFREENECT2_CPU_THREADS environment variable, or the number of cores if it is unset.
+   */
+  void setNumThreads(size_t num_threads);
+
   virtual void loadP0TablesFromCommandResponse(unsigned char* buffer, size_t buffer_length);
 
   virtual void loadXZTables(const float *xtable, const float *ztable);
+  virtual void loadBinnedXZTables(const float *xtable, const float *ztable);
   virtual void loadLookupTable(const short *lut);
 
   virtual const char *name() { return "CPU"; }
   virtual void process(const DepthPacket &packet);
+protected:
+  /** @param kde Whether to unwrap the phase with the KDE method, see CpuKdeDepthPacketProcessor. */
+  explicit CpuDepthPacketProcessor(bool kde);
 private:
+  /** Apply @p config, reduced to the adaptive quality. */
+  void applyConfiguration(const libfreenect2::DepthPacketProcessor::Config &config);
+
   CpuDepthPacketProcessorImpl *impl_;
 };
 
+/*
+ * The class below implement a depth packet processor using the phase unwrapping
+ * algorithm described in the paper "Efficient Phase Unwrapping using Kernel
+ * Density Estimation", ECCV 2016, Felix Järemo Lawin, Per-Erik Forssen and
+ * Hannes Ovren, see http://www.cvl.isy.liu.se/research/datasets/kinect2-dataset/.
+ */
+
+/**
+ * Depth packet processor using the CPU and the KDE phase unwrapping method.
+ *
+ * Same stages and threads as CpuDepthPacketProcessor up to the phase
+ * unwrapping. The edge aware filter and binning are not used.
+ */
+class CpuKdeDepthPacketProcessor : public CpuDepthPacketProcessor
+{
+public:
+  CpuKdeDepthPacketProcessor();
+
+  virtual const char *name() { return "CPUKde"; }
+};
+
+class ParallelDepthPacketProcessorImpl;
+
+/**
+ * Depth packet processor running several processors on consecutive packets
+ * at once, each in its own thread.
+ *
+ * Packets go to the processors in turn. Frames are passed to the listener in
+ * packet order: a processor which finishes early holds its frames, and takes
+ * no new packet, until the frames of the packets before it are delivered.
+ * Throughput scales with the processors, with up to one frame of latency
+ * per processor.
+ *
+ * Tables, configuration and the quality listener are forwarded to every
+ * processor, which keeps its own copy. Frames go through the listener of
+ * this processor, which must take or release them; the processors allocate
+ * new ones for each packet. With several processors, the temporal filter
+ * and the adaptive depth quality are disabled, since each processor only
+ * sees part of the packets.
+ */
+class ParallelDepthPacketProcessor : public DepthPacketProcessor
+{
+public:
+  /** @param processors Processors, owned by this object. */
+  explicit ParallelDepthPacketProcessor(const std::vector<DepthPacketProcessor *> &processors);
+  virtual ~ParallelDepthPacketProcessor();
+
+  virtual void setConfiguration(const libfreenect2::DepthPacketProcessor::Config &config);
+  virtual void setDepthQualityListener(libfreenect2::DepthQualityListener *listener);
+
+  virtual void loadP0TablesFromCommandResponse(unsigned char* buffer, size_t buffer_length);
+
+  virtual void loadXZTables(const float *xtable, const float *ztable);
+  virtual void loadBinnedXZTables(const float *xtable, const float *ztable);
+  virtual void loadLookupTable(const short *lut);
+
+  /** Whether the processor of the next packet is free. */
+  virtual bool ready();
+  virtual bool good();
+  virtual const char *name() { return "Parallel"; }
+
+  /** Pass the packet to the next processor, waiting for it if it is not ready(). */
+  virtual void process(const DepthPacket &packet);
+
+  /** The buffer of a packet is released when its processor is done with it. */
+  virtual bool releasesBuffers() { return true; }
+
+  /** The buffers of @p count packets, and one for each processor. */
+  virtual void setBufferCapacity(size_t count);
+private:
+  ParallelDepthPacketProcessorImpl *impl_;
+};
+
 #ifdef LIBFREENECT2_WITH_OPENCL_SUPPORT
 class OpenCLDepthPacketProcessorImpl;
 
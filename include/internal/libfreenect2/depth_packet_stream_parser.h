@@ -65,9 +65,26 @@ public:
 
   void setPacketProcessor(libfreenect2::BaseDepthPacketProcessor *processor);
 
+  /**
+   * Pass on only the packets whose sequence number is a multiple of @p divisor.
+   * The data of the others is not copied. 0 or 1 passes on every packet.
+   */
+  void setRateDivisor(size_t divisor);
+
   virtual void onDataReceived(unsigned char* buffer, size_t length);
 private:
+  /** Whether the packet with sequence number @p sequence is dropped, see setRateDivisor(). */
+  bool isDropped(uint32_t sequence) const;
+
   libfreenect2::BaseDepthPacketProcessor *processor_;
+  uint32_t rate_divisor_;
+
+  /**
+   * Whether the data of the subpacket being received is not copied, because
+   * the next subpacket was predicted to belong to a dropped packet. This is
+   * only known for sure at its footer.
+   */
+  bool skip_subpacket_;
 
   size_t buffer_size_;
   DepthPacket packet_;
@@ -36,6 +36,9 @@
 namespace libfreenect2
 {
 
+/** Time in seconds since an arbitrary start, from a monotonic clock. */
+double monotonicTime();
+
 class WithPerfLoggingImpl;
 
 class WithPerfLogging
@@ -45,6 +48,8 @@ public:
   virtual ~WithPerfLogging();
   void startTiming();
   std::ostream &stopTiming(std::ostream &stream);
+  /** Duration of the last startTiming() to stopTiming() in seconds. */
+  double lastTiming() const;
 private:
   WithPerfLoggingImpl *impl_;
 };
@@ -54,6 +54,12 @@ public:
 
   virtual const char *name() { return "a packet processor"; }
 
+  /**
+   * Whether process() keeps the buffer of the packet after it returns, and
+   * releases it itself. Otherwise the caller releases it after process().
+   */
+  virtual bool releasesBuffers() { return false; }
+
   /**
    * A new packet has arrived, process it.
    * @param packet Packet to process.
@@ -75,6 +81,38 @@ public:
     p.memory = NULL;
   }
 
+  /**
+   * Let allocateBuffer() hand out up to @p count buffers at once.
+   * @param count Number of buffers, see Allocator::setCapacity().
+   */
+  virtual void setBufferCapacity(size_t count)
+  {
+    Allocator *a = getAllocator();
+    if (a)
+      a->setCapacity(count);
+  }
+
+  /**
+   * Create buffers ahead of use.
+   * @param eager See Allocator::setEagerAllocation().
+   */
+  virtual void setEagerBufferAllocation(bool eager)
+  {
+    Allocator *a = getAllocator();
+    if (a)
+      a->setEagerAllocation(eager);
+  }
+
+  /**
+   * Use of the buffers given by allocateBuffer().
+   * @return False if the allocator does not keep track of it.
+   */
+  virtual bool getBufferStatistics(BufferStatistics &statistics)
+  {
+    Allocator *a = getAllocator();
+    return a != 0 && a->getStatistics(statistics);
+  }
+
 protected:
   virtual Allocator *getAllocator() { return &default_allocator_; }
 
@@ -0,0 +1,278 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file packet_worker_pool.h Processing of consecutive packets in parallel. */
+
+#ifndef PACKET_WORKER_POOL_H_
+#define PACKET_WORKER_POOL_H_
+
+#include <vector>
+#include <libfreenect2/frame_listener.hpp>
+#include <libfreenect2/threading.h>
+#include <libfreenect2/packet_processor.h>
+
+namespace libfreenect2
+{
+
+/**
+ * Workers processing consecutive packets at once, each in its own thread,
+ * for a processor which passes its packets on with process().
+ *
+ * Packets go to the workers in turn. Frames are passed to the listener in
+ * packet order: a worker which finishes early holds its frames, and takes no
+ * new packet, until the frames of the packets before it are delivered. The
+ * buffer of a packet is released as soon as its worker is done with it.
+ *
+ * @tparam PacketT Type of the packets.
+ */
+template<typename PacketT>
+class PacketWorkerPool
+{
+public:
+  /** Processing of a packet by a worker, in the thread of the worker. */
+  class Job
+  {
+  public:
+    virtual ~Job() {}
+
+    /** Name of the thread. */
+    virtual const char *name() = 0;
+
+    /**
+     * Process a packet. Frames passed to @p frames are owned by the pool.
+     * @param packet Packet, whose buffer is released when this returns.
+     * @param frames Listener collecting the frames of the packet until it is their turn.
+     */
+    virtual void process(const PacketT &packet, FrameListener &frames) = 0;
+  };
+
+  /**
+   * Start a thread for each job.
+   * @param processor Processor owning the packet buffers.
+   * @param listener Listener of the processor, which receives the frames.
+   * @param jobs Jobs, owned by the pool.
+   */
+  PacketWorkerPool(PacketProcessor<PacketT> *processor, FrameListener *const &listener, const std::vector<Job *> &jobs) :
+    processor_(processor),
+    listener_(listener),
+    next_worker_(0),
+    next_delivery_(0)
+  {
+    for(size_t i = 0; i < jobs.size(); ++i)
+      workers_.push_back(new Worker(this, jobs[i]));
+    for(size_t i = 0; i < workers_.size(); ++i)
+      workers_[i]->thread = new libfreenect2::thread(&Worker::static_execute, workers_[i]);
+  }
+
+  ~PacketWorkerPool()
+  {
+    for(size_t i = 0; i < workers_.size(); ++i)
+    {
+      Worker &w = *workers_[i];
+      {
+        libfreenect2::lock_guard l(w.mutex);
+        w.shutdown = true;
+      }
+      w.packet_condition.notify_one();
+      w.idle_condition.notify_all();
+      w.thread->join();
+      delete w.thread;
+
+      if(w.has_packet)
+        processor_->releaseBuffer(w.packet);
+    }
+    for(size_t i = 0; i < workers_.size(); ++i)
+      delete workers_[i];
+  }
+
+  /** Number of workers. */
+  size_t size() const
+  {
+    return workers_.size();
+  }
+
+  /** Whether the worker of the next packet is free. Does not lock, so it can be called from the USB thread. */
+  bool ready()
+  {
+    return workers_[next_worker_]->busy.load() == 0;
+  }
+
+  /** Pass the packet to the next worker, waiting for it if it is not ready(). Call from one thread at a time. */
+  void process(const PacketT &packet)
+  {
+    Worker &w = *workers_[next_worker_];
+    {
+      libfreenect2::unique_lock l(w.mutex);
+      while(!w.shutdown && w.busy.load() != 0)
+        WAIT_CONDITION(w.idle_condition, w.mutex, l);
+
+      w.packet = packet;
+      w.has_packet = true;
+      w.busy.store(1);
+    }
+    w.packet_condition.notify_one();
+
+    next_worker_ = (next_worker_ + 1) % workers_.size();
+  }
+
+private:
+  /**
+   * A job and its thread. It is the frame listener of its job, and collects
+   * the frames of its packet until it is its turn to deliver them.
+   */
+  class Worker : public FrameListener
+  {
+  public:
+    PacketWorkerPool *pool;
+    Job *job;
+
+    libfreenect2::mutex mutex; ///< Mutex of #has_packet and #shutdown, and of changes to #busy.
+    libfreenect2::condition_variable packet_condition; ///< Condition of the thread waiting for a packet.
+    libfreenect2::condition_variable idle_condition; ///< Condition of process() waiting for the worker.
+    PacketT packet;
+    bool has_packet; ///< Whether #packet is waiting to be processed.
+    libfreenect2::atomic_uint32 busy; ///< Whether a packet is queued, processed, or its frames are not delivered yet. Read by ready() without the mutex.
+    bool shutdown;
+
+    std::vector<Frame::Type> frame_types; ///< Types of #frames.
+    std::vector<Frame *> frames; ///< Frames of the last packet, to deliver.
+    bool finished; ///< Whether #frames are complete. Protected by the delivery mutex.
+
+    libfreenect2::thread *thread;
+
+    Worker(PacketWorkerPool *pool, Job *job) :
+      pool(pool),
+      job(job),
+      has_packet(false),
+      busy(0),
+      shutdown(false),
+      finished(false),
+      thread(0)
+    {
+    }
+
+    virtual ~Worker()
+    {
+      for(size_t i = 0; i < frames.size(); ++i)
+        delete frames[i];
+      delete job;
+    }
+
+    virtual unsigned int subscribedFrameTypes() const
+    {
+      FrameListener *listener = pool->listener_;
+      return listener != 0 ? listener->subscribedFrameTypes() : 0;
+    }
+
+    virtual bool onNewFrame(Frame::Type type, Frame *frame)
+    {
+      frame_types.push_back(type);
+      frames.push_back(frame);
+      return true;
+    }
+
+    static void static_execute(void *data)
+    {
+      static_cast<Worker *>(data)->execute();
+    }
+
+    /**
+     * Wait for the next packet.
+     * @return False on shutdown.
+     */
+    bool takePacket(PacketT &next)
+    {
+      libfreenect2::unique_lock l(mutex);
+      while(!shutdown && !has_packet)
+        WAIT_CONDITION(packet_condition, mutex, l);
+
+      if(shutdown)
+        return false;
+
+      next = packet;
+      has_packet = false;
+      return true;
+    }
+
+    void execute()
+    {
+      this_thread::set_name(job->name());
+      PacketT next;
+
+      while(takePacket(next))
+      {
+        job->process(next, *this);
+        pool->processor_->releaseBuffer(next);
+        pool->finish(*this);
+      }
+    }
+  };
+  friend class Worker;
+
+  PacketProcessor<PacketT> *processor_;
+  FrameListener *const &listener_;
+  std::vector<Worker *> workers_;
+  size_t next_worker_; ///< Worker of the next packet.
+
+  libfreenect2::mutex delivery_mutex_; ///< Mutex of #next_delivery_ and of Worker::finished.
+  size_t next_delivery_; ///< Worker whose frames are delivered next.
+
+  /**
+   * Record the frames of @p worker as complete, and deliver the complete
+   * frames in packet order. Workers whose frames are delivered are free for
+   * a new packet.
+   */
+  void finish(Worker &worker)
+  {
+    libfreenect2::lock_guard l(delivery_mutex_);
+    worker.finished = true;
+
+    while(workers_[next_delivery_]->finished)
+    {
+      Worker &w = *workers_[next_delivery_];
+      FrameListener *listener = listener_;
+      for(size_t i = 0; i < w.frames.size(); ++i)
+      {
+        if(listener == 0 || !listener->onNewFrame(w.frame_types[i], w.frames[i]))
+          delete w.frames[i];
+      }
+      w.frames.clear();
+      w.frame_types.clear();
+      w.finished = false;
+
+      {
+        libfreenect2::lock_guard wl(w.mutex);
+        w.busy.store(0);
+      }
+      w.idle_condition.notify_one();
+
+      next_delivery_ = (next_delivery_ + 1) % workers_.size();
+    }
+  }
+};
+
+} /* namespace libfreenect2 */
+#endif /* PACKET_WORKER_POOL_H_ */
@@ -80,14 +80,35 @@ public:
 #ifdef LIBFREENECT2_WITH_TURBOJPEG_SUPPORT
 class TurboJpegRgbPacketProcessorImpl;
 
-/** Processor to decode JPEG to image, using TurboJpeg. */
+/**
+ * Processor to decode JPEG to image, using TurboJpeg.
+ *
+ * With several decoders, consecutive packets are decoded at once, each by
+ * the next decoder in turn on its own thread. Frames are still passed to the
+ * listener in packet order, with up to one frame of latency per decoder.
+ */
 class TurboJpegRgbPacketProcessor : public RgbPacketProcessor
 {
 public:
-  TurboJpegRgbPacketProcessor();
+  /**
+   * @param num_decoders Number of packets decoded at once; 0 selects the value
+   * of the LIBFREENECT2_JPEG_DECODERS environment variable, or 1 if it is unset.
+   */
+  explicit TurboJpegRgbPacketProcessor(size_t num_decoders = 0);
   virtual ~TurboJpegRgbPacketProcessor();
+
+  /** With several decoders, whether the decoder of the next packet is free. */
+  virtual bool ready();
+
+  /** With several decoders, pass the packet to the next decoder, waiting for it if it is not ready(). */
   virtual void process(const libfreenect2::RgbPacket &packet);
   virtual const char *name() { return "TurboJPEG"; }
+
+  /** With several decoders, the buffer of a packet is released when it is decoded. */
+  virtual bool releasesBuffers();
+
+  /** The buffers of @p count packets, and one for each decoder when there are several. */
+  virtual void setBufferCapacity(size_t count);
 private:
   TurboJpegRgbPacketProcessorImpl *impl_; ///< Decoder implementation.
 };
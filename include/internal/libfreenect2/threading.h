@@ -94,6 +94,56 @@ using namespace tthread::this_thread;
 
 #endif
 
+#ifdef LIBFREENECT2_THREADING_STDLIB
+#include <atomic>
+#endif
+
+#include <stdint.h>
+
+namespace libfreenect2
+{
+
+/**
+ * Unsigned 32 bit integer shared by threads without a lock. All accesses are
+ * sequentially consistent.
+ */
+class atomic_uint32
+{
+public:
+  explicit atomic_uint32(uint32_t value = 0) : value_(value) {}
+
+#if defined(LIBFREENECT2_THREADING_STDLIB)
+  uint32_t load() const { return value_.load(); }
+  void store(uint32_t value) { value_.store(value); }
+
+  /** Set to @p desired if it is @p expected, and return whether it was. */
+  bool compare_exchange(uint32_t expected, uint32_t desired) { return value_.compare_exchange_strong(expected, desired); }
+private:
+  std::atomic<uint32_t> value_;
+#elif defined(_MSC_VER)
+  uint32_t load() const { return (uint32_t)InterlockedCompareExchange(const_cast<volatile LONG *>(&value_), 0, 0); }
+  void store(uint32_t value) { InterlockedExchange(&value_, (LONG)value); }
+
+  /** Set to @p desired if it is @p expected, and return whether it was. */
+  bool compare_exchange(uint32_t expected, uint32_t desired) { return InterlockedCompareExchange(&value_, (LONG)desired, (LONG)expected) == (LONG)expected; }
+private:
+  volatile LONG value_;
+#else
+  uint32_t load() const { return __sync_fetch_and_add(const_cast<volatile uint32_t *>(&value_), 0); }
+  void store(uint32_t value) { __sync_synchronize(); value_ = value; __sync_synchronize(); }
+
+  /** Set to @p desired if it is @p expected, and return whether it was. */
+  bool compare_exchange(uint32_t expected, uint32_t desired) { return __sync_bool_compare_and_swap(&value_, expected, desired); }
+private:
+  volatile uint32_t value_;
+#endif
+
+  atomic_uint32(const atomic_uint32 &);
+  atomic_uint32 &operator=(const atomic_uint32 &);
+};
+
+} /* libfreenect2 */
+
 #if defined(__linux__)
 #include <sys/prctl.h>
 #elif defined(__APPLE__)
@@ -40,6 +40,29 @@ namespace libfreenect2
  * Receive decoded image frames, and the frame format.
  */
 
+/** Statistics of the valid pixels of a depth frame, see Frame::depth_statistics. @ingroup frame */
+struct LIBFREENECT2_API DepthStatistics
+{
+  enum
+  {
+    HistogramBins = 16 ///< Number of bins of #histogram.
+  };
+
+  size_t valid_pixels; ///< Number of pixels with a positive finite depth. The others are not counted below.
+  float min_depth;     ///< Unit: millimeter. 0 if there are no valid pixels.
+  float max_depth;     ///< Unit: millimeter. 0 if there are no valid pixels.
+  float mean_depth;    ///< Unit: millimeter. 0 if there are no valid pixels.
+  float histogram_min; ///< Depth at the start of the first bin, in millimeters.
+  float histogram_max; ///< Depth at the end of the last bin, in millimeters.
+  /** Number of pixels in each of HistogramBins equal ranges of depth from
+   * #histogram_min to #histogram_max. Depths outside of it are counted in the first or last bin.
+   */
+  size_t histogram[HistogramBins];
+
+  /** All zero. */
+  DepthStatistics();
+};
+
 /** Frame format and metadata. @ingroup frame */
 class LIBFREENECT2_API Frame
 {
@@ -49,7 +72,11 @@ class LIBFREENECT2_API Frame
   {
     Color = 1, ///< 1920x1080. BGRX or RGBX.
     Ir = 2,    ///< 512x424 float. Range is [0.0, 65535.0].
-    Depth = 4  ///< 512x424 float, unit: millimeter. Non-positive, NaN, and infinity are invalid or missing data.
+    Depth = 4, ///< 512x424 float, unit: millimeter. Non-positive, NaN, and infinity are invalid or missing data.
+    Confidence = 8, ///< 512x424 float. Sum of the amplitudes of the three modulation frequencies, which the depth thresholds are applied to; higher is more reliable. Only sent to listeners subscribing to it, by the CPU and OpenCL pipelines without KDE.
+    DepthHalf = 16, ///< 256x212 float. Depth downsampled by 2, averaging the valid pixels of each 2x2 block that are near the nearest of them. Only sent to listeners subscribing to it, by the CPU pipelines.
+    DepthQuarter = 32, ///< 128x106 float. DepthHalf downsampled by 2 the same way. Only sent to listeners subscribing to it, by the CPU pipelines.
+    DealiasingConfidence = 64 ///< 512x424 float. How well the phases of the three modulation frequencies agree after unwrapping, from 1 where they agree exactly down to 0 at the disagreement where the phase is rejected; 0 where the phase is rejected or the amplitudes are below the thresholds. Only sent to listeners subscribing to it, by the CPU and OpenCL pipelines without KDE.
   };
 
   /** Pixel format. */
@@ -61,6 +88,7 @@ class LIBFREENECT2_API Frame
     BGRX = 4, ///< 4 bytes of B, G, R, and unused per pixel
     RGBX = 5, ///< 4 bytes of R, G, B, and unused per pixel
     Gray = 6, ///< 1 byte of gray per pixel
+    UInt16 = 7, ///< A 2-byte unsigned integer per pixel
   };
 
   size_t width;           ///< Length of a line (in pixels).
@@ -74,6 +102,7 @@ class LIBFREENECT2_API Frame
   float gamma;            ///< From 1.0 (bright) to 6.4 (covered)
   uint32_t status;        ///< zero if ok; non-zero for errors.
   Format format;          ///< Byte format. Informative only, doesn't indicate errors.
+  DepthStatistics depth_statistics; ///< Depth frames of the CPU pipelines with DepthPacketProcessor::Config::EnableDepthStatistics. All zero otherwise.
 
   /** Construct a new frame.
    * @param width Width in pixel
@@ -103,6 +132,13 @@ public:
    * @return true if you want to take ownership of the frame, i.e. reuse/delete it. Will be reused/deleted by caller otherwise.
    */
   virtual bool onNewFrame(Frame::Type type, Frame *frame) = 0;
+
+  /**
+   * Types of frames this listener uses. Processors may skip the work for
+   * other types, and not call onNewFrame() with them.
+   * @return Bitwise or of Frame::Type; Frame::Color | Frame::Ir | Frame::Depth by default.
+   */
+  virtual unsigned int subscribedFrameTypes() const;
 };
 
 } /* namespace libfreenect2 */
@@ -73,6 +73,7 @@ public:
   void release(FrameMap &frame);
 
   virtual bool onNewFrame(Frame::Type type, Frame *frame);
+  virtual unsigned int subscribedFrameTypes() const;
 private:
   SyncMultiFrameListenerImpl *impl_;
 
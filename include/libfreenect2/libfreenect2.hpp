@@ -41,6 +41,8 @@ namespace libfreenect2
  * Find, open, and control Kinect v2 devices. */
 ///@{
 
+class DepthQualityListener;
+
 /** Device control. */
 class LIBFREENECT2_API Freenect2Device
 {
@@ -49,6 +51,18 @@ public:
   static const unsigned int ProductId = 0x02D8;
   static const unsigned int ProductIdPreview = 0x02C4;
 
+  /** Levels of the adaptive depth quality, from the best to the cheapest.
+   * Each level also includes the reductions of the previous ones.
+   * @see Config::EnableAdaptiveDepthQuality
+   */
+  enum DepthQuality
+  {
+    FullQuality = 0,       ///< Processing as configured.
+    NoEdgeAwareFilter = 1, ///< Config::EnableEdgeAwareFilter is off.
+    NoBilateralFilter = 2, ///< Config::EnableBilateralFilter is off.
+    BinnedDepth = 3        ///< Config::EnableDepthBinning is on.
+  };
+
   /** Color camera calibration parameters.
    * Kinect v2 includes factory preset values for these parameters. They are used in Registration.
    */
@@ -120,7 +134,72 @@ public:
     bool EnableBilateralFilter; ///< Remove some "flying pixels".
     bool EnableEdgeAwareFilter; ///< Remove pixels on edges because ToF cameras produce noisy edges.
 
-    /** Default is 0.5, 4.5, true, true */
+    /** Region of interest of the depth and IR frames, in pixels: columns
+     * [DepthRoiX, DepthRoiX + DepthRoiWidth) and rows [DepthRoiY, DepthRoiY + DepthRoiHeight).
+     * The CPU and OpenCL pipelines only compute pixels inside it, and set the
+     * others to 0. A width or height of 0 selects the whole frame.
+     */
+    size_t DepthRoiX, DepthRoiY, DepthRoiWidth, DepthRoiHeight;
+
+    /** Output 256x212 depth and IR frames, each pixel the 2x2 average of the
+     * phase measurements before filtering and phase unwrapping. The region of
+     * interest is still given in 512x424 pixels. Only supported by the CPU
+     * pipeline; Registration does not support binned frames.
+     */
+    bool EnableDepthBinning;
+
+    /** Format of the depth and IR frames: Frame::Float, or Frame::UInt16 for
+     * millimeters and IR rounded to 16-bit integers, written directly by the
+     * last pass. UInt16 is only supported by the CPU pipelines; the others
+     * always output Float.
+     */
+    Frame::Format DepthFormat;
+
+    /** Temporal filter of depth, applied after the edge aware filter: each
+     * pixel becomes the median of its valid depths in the last
+     * TemporalFilterWindow frames, up to 16. 0 or 1 disables it. The history
+     * of a pixel restarts when it is invalid, and when its depth moves by
+     * more than TemporalFilterResetDistance (meter) from one frame to the
+     * next, so that moving objects do not leave trails. Only supported by
+     * the CPU pipelines with a single depth processor.
+     */
+    size_t TemporalFilterWindow;
+    float TemporalFilterResetDistance;
+
+    /** Fill Frame::depth_statistics of depth frames while they are written,
+     * with a histogram from MinDepth to MaxDepth. Only supported by the CPU
+     * pipelines.
+     */
+    bool EnableDepthStatistics;
+
+    /** Process only one depth packet in DepthRateDivisor, e.g. 2 for 15 Hz
+     * or 3 for 10 Hz depth and IR frames. The other packets are dropped by
+     * the stream parser without being copied or processed. 0 or 1 processes
+     * every packet.
+     */
+    size_t DepthRateDivisor;
+
+    /** Keep up with the frame rate at a lower quality when depth processing
+     * is too slow, instead of dropping packets. The processor steps down one
+     * DepthQuality level when its average processing time exceeds
+     * DepthProcessingBudget (second) times DepthRateDivisor, and back up when
+     * there is enough headroom. Changes are reported to the
+     * DepthQualityListener. Only supported by the CPU pipelines with a
+     * single depth processor.
+     */
+    bool EnableAdaptiveDepthQuality;
+    float DepthProcessingBudget;
+
+    /** Number of depth packets queued for processing, including the one
+     * being processed, so that processing hiccups longer than a frame do not
+     * lose packets. DepthQueuePolicy applies when it is full. 0 or 1 only
+     * keeps the packet being processed, and at most 16 are queued. Each
+     * queued packet holds a raw packet buffer of about 3 MB.
+     */
+    size_t DepthQueueSize;
+    PacketPipeline::QueuePolicy DepthQueuePolicy;
+
+    /** Default is 0.5, 4.5, true, true, the whole frame, no binning, Float, no temporal filter, no statistics, every packet, no adaptive quality with a 1/30 s budget, and a queue of 1 dropping new packets */
     LIBFREENECT2_API Config();
   };
 
@@ -159,6 +238,9 @@ public:
   /** Provide your listener to receive IR and depth frames. */
   virtual void setIrAndDepthFrameListener(FrameListener* ir_frame_listener) = 0;
 
+  /** Provide your listener to receive changes of the adaptive depth quality. */
+  virtual void setDepthQualityListener(DepthQualityListener* listener) = 0;
+
   /** Start data processing with both RGB and depth streams.
    * All above configuration must only be called before start() or after stop().
    *
@@ -190,6 +272,21 @@ public:
   virtual bool close() = 0;
 };
 
+/** Callback interface to receive changes of the adaptive depth quality.
+ * @see Freenect2Device::Config::EnableAdaptiveDepthQuality
+ */
+class LIBFREENECT2_API DepthQualityListener
+{
+public:
+  virtual ~DepthQualityListener();
+
+  /** Called by the depth processing thread before the first frame processed at @p quality.
+   * @param quality New quality level.
+   * @param processing_time Average processing time which caused the change (second).
+   */
+  virtual void onDepthQualityChanged(Freenect2Device::DepthQuality quality, float processing_time) = 0;
+};
+
 class Freenect2Impl;
 
 /**
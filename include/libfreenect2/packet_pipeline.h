@@ -48,6 +48,18 @@ class PacketPipelineComponents;
  */
 ///@{
 
+/** Use of the packet buffers of a processor since the pipeline was created, see PacketPipeline::getDepthBufferStatistics(). */
+struct BufferStatistics
+{
+  size_t capacity;            ///< Number of buffers which can be in use at once.
+  size_t allocated_buffers;   ///< Number of buffers created so far.
+  size_t buffers_in_use;      ///< Number of buffers in use now.
+  size_t high_water_mark;     ///< Most buffers in use at once.
+  size_t allocations;         ///< Number of packets given a buffer.
+  size_t blocked_allocations; ///< Number of packets which waited for a buffer to be freed.
+  double blocked_time;        ///< Total time waited for a buffer in seconds.
+};
+
 /** Base class for other pipeline classes.
  * Methods in this class are reserved for internal use.
  */
@@ -56,6 +68,14 @@ class LIBFREENECT2_API PacketPipeline
 public:
   typedef DataCallback PacketParser;
 
+  /** What to do with a new packet when a processing queue is full, see Freenect2Device::Config::DepthQueueSize. */
+  enum QueuePolicy
+  {
+    DropNewest = 0, ///< Drop the new packet.
+    DropOldest = 1, ///< Drop the oldest packet waiting in the queue, or the new one if no packet is waiting.
+    Block = 2       ///< Wait for room in the USB thread, which may lose USB transfers instead.
+  };
+
   PacketPipeline();
   virtual ~PacketPipeline();
 
@@ -64,6 +84,27 @@ public:
 
   virtual RgbPacketProcessor *getRgbPacketProcessor() const;
   virtual DepthPacketProcessor *getDepthPacketProcessor() const;
+
+  /** Drop depth packets in the parser, see Freenect2Device::Config::DepthRateDivisor. */
+  virtual void setDepthRateDivisor(size_t divisor);
+
+  /** Queue depth packets for processing, see Freenect2Device::Config::DepthQueueSize. */
+  virtual void setDepthQueue(size_t size, QueuePolicy policy);
+
+  /** Create the packet buffers of the processors up to their capacity ahead
+   * of use, instead of when they are first needed. Lazy by default.
+   */
+  virtual void setEagerBufferAllocation(bool eager);
+
+  /** Use of the packet buffers of the color processor.
+   * @return False if the processor does not keep track of it.
+   */
+  virtual bool getRgbBufferStatistics(BufferStatistics &statistics) const;
+
+  /** Use of the packet buffers of the depth processor.
+   * @return False if the processor does not keep track of it.
+   */
+  virtual bool getDepthBufferStatistics(BufferStatistics &statistics) const;
 protected:
   PacketPipelineComponents *comp_;
 };
@@ -87,9 +128,34 @@ class LIBFREENECT2_API CpuPacketPipeline : public PacketPipeline
 {
 public:
   CpuPacketPipeline();
+
+  /** Process up to @p num_processors consecutive depth packets at once, each
+   * with its own processor and a share of the cores. Frames are still
+   * delivered in order, with up to one frame of latency per processor.
+   * With several processors, Freenect2Device::Config::TemporalFilterWindow
+   * and Freenect2Device::Config::EnableAdaptiveDepthQuality are ignored.
+   */
+  explicit CpuPacketPipeline(size_t num_processors);
   virtual ~CpuPacketPipeline();
 };
 
+/*
+ * The class below implement a depth packet processor using the phase unwrapping
+ * algorithm described in the paper "Efficient Phase Unwrapping using Kernel
+ * Density Estimation", ECCV 2016, Felix Järemo Lawin, Per-Erik Forssen and
+ * Hannes Ovren, see http://www.cvl.isy.liu.se/research/datasets/kinect2-dataset/.
+ */
+/** Pipeline with CPU depth processing using the KDE phase unwrapping method. */
+class LIBFREENECT2_API CpuKdePacketPipeline : public PacketPipeline
+{
+public:
+  CpuKdePacketPipeline();
+
+  /** @copydoc CpuPacketPipeline::CpuPacketPipeline(size_t) */
+  explicit CpuKdePacketPipeline(size_t num_processors);
+  virtual ~CpuKdePacketPipeline();
+};
+
 #ifdef LIBFREENECT2_WITH_OPENGL_SUPPORT
 /** Pipeline with OpenGL depth processing. */
 class LIBFREENECT2_API OpenGLPacketPipeline : public PacketPipeline
@@ -72,8 +72,8 @@ public:
 
   /** Map color images onto depth images
    * @param rgb Color image (1920x1080 BGRX)
-   * @param depth Depth image (512x424 float)
-   * @param[out] undistorted Undistorted depth image
+   * @param depth Depth image (512x424 float, or UInt16, see Freenect2Device::Config::DepthFormat)
+   * @param[out] undistorted Undistorted depth image (512x424 float)
    * @param[out] registered Color image for the depth image (512x424)
    * @param enable_filter Filter out pixels not visible to both cameras.
    * @param[out] bigdepth If not `NULL`, return mapping of depth onto colors (1920x1082 float). **1082** not 1080, with a blank top and bottom row.
@@ -82,8 +82,8 @@ public:
   void apply(const Frame* rgb, const Frame* depth, Frame* undistorted, Frame* registered, const bool enable_filter = true, Frame* bigdepth = 0, int* color_depth_map = 0) const;
 
   /** Undistort depth
-   * @param depth Depth image (512x424 float)
-   * @param[out] undistorted Undistorted depth image
+   * @param depth Depth image (512x424 float, or UInt16)
+   * @param[out] undistorted Undistorted depth image (512x424 float)
    */
   void undistortDepth(const Frame* depth, Frame* undistorted) const;
 
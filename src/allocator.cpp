@@ -28,6 +28,10 @@
 
 #include "libfreenect2/allocator.h"
 #include "libfreenect2/threading.h"
+#include "libfreenect2/logging.h"
+
+#include <algorithm>
+#include <vector>
 
 namespace libfreenect2
 {
@@ -57,55 +61,117 @@ class PoolAllocatorImpl: public Allocator
 {
 private:
   Allocator *allocator;
-  Buffer *buffers[2];
-  bool used[2];
+  std::vector<Buffer *> buffers;
+  std::vector<bool> used;
+  size_t num_used;
+  size_t capacity;
+  size_t buffer_size; // Size of all buffers, 0 until the first allocate().
+  bool eager;
+  BufferStatistics stats;
   mutex used_lock;
   condition_variable available_cond;
+
+  // Create the missing buffers up to the capacity, once their size is known.
+  void preallocate()
+  {
+    if (!eager || buffer_size == 0)
+      return;
+    for (size_t i = 0; i < capacity; i++) {
+      if (i == buffers.size()) {
+        buffers.push_back(NULL);
+        used.push_back(false);
+      }
+      if (buffers[i] == NULL)
+        buffers[i] = allocator->allocate(buffer_size);
+    }
+  }
 public:
-  PoolAllocatorImpl(Allocator *a): allocator(a), buffers(), used() {}
+  PoolAllocatorImpl(Allocator *a): allocator(a), num_used(0), capacity(2), buffer_size(0), eager(false)
+  {
+    stats.capacity = capacity;
+    stats.allocated_buffers = 0;
+    stats.buffers_in_use = 0;
+    stats.high_water_mark = 0;
+    stats.allocations = 0;
+    stats.blocked_allocations = 0;
+    stats.blocked_time = 0;
+  }
 
   Buffer *allocate(size_t size)
   {
     unique_lock guard(used_lock);
-    while (used[0] && used[1])
-      WAIT_CONDITION(available_cond, used_lock, guard);
-
-    if (!used[0]) {
-      if (buffers[0] == NULL)
-        buffers[0] = allocator->allocate(size);
-      buffers[0]->length = 0;
-      buffers[0]->allocator = this;
-      used[0] = true;
-      return buffers[0];
-    } else if (!used[1]) {
-      if (buffers[1] == NULL)
-        buffers[1] = allocator->allocate(size);
-      buffers[1]->length = 0;
-      buffers[1]->allocator = this;
-      used[1] = true;
-      return buffers[1];
-    } else {
-      // should never happen
-      return NULL;
+    if (num_used >= capacity) {
+      stats.blocked_allocations++;
+      double wait_start = monotonicTime();
+      while (num_used >= capacity)
+        WAIT_CONDITION(available_cond, used_lock, guard);
+      stats.blocked_time += monotonicTime() - wait_start;
     }
+
+    buffer_size = size;
+    preallocate();
+
+    size_t i = 0;
+    while (i < buffers.size() && used[i])
+      i++;
+    if (i == buffers.size()) {
+      buffers.push_back(NULL);
+      used.push_back(false);
+    }
+
+    if (buffers[i] == NULL)
+      buffers[i] = allocator->allocate(size);
+    buffers[i]->length = 0;
+    buffers[i]->allocator = this;
+    used[i] = true;
+    num_used++;
+    stats.allocations++;
+    stats.high_water_mark = std::max(stats.high_water_mark, num_used);
+    return buffers[i];
   }
 
   void free(Buffer *b)
   {
     lock_guard guard(used_lock);
-    if (b == buffers[0]) {
-      used[0] = false;
-      available_cond.notify_one();
-    } else if (b == buffers[1]) {
-      used[1] = false;
-      available_cond.notify_one();
+    for (size_t i = 0; i < buffers.size(); i++) {
+      if (b == buffers[i] && used[i]) {
+        used[i] = false;
+        num_used--;
+        available_cond.notify_one();
+        return;
+      }
     }
   }
 
+  void setCapacity(size_t count)
+  {
+    lock_guard guard(used_lock);
+    capacity = count > 0 ? count : 1;
+    preallocate();
+    available_cond.notify_all();
+  }
+
+  void setEagerAllocation(bool enable)
+  {
+    lock_guard guard(used_lock);
+    eager = enable;
+    preallocate();
+  }
+
+  bool getStatistics(BufferStatistics &statistics)
+  {
+    lock_guard guard(used_lock);
+    statistics = stats;
+    statistics.capacity = capacity;
+    statistics.allocated_buffers = buffers.size() - std::count(buffers.begin(), buffers.end(), (Buffer *)NULL);
+    statistics.buffers_in_use = num_used;
+    return true;
+  }
+
   ~PoolAllocatorImpl()
   {
-    allocator->free(buffers[0]);
-    allocator->free(buffers[1]);
+    for (size_t i = 0; i < buffers.size(); i++)
+      allocator->free(buffers[i]);
     delete allocator;
   }
 };
@@ -134,4 +200,19 @@ void PoolAllocator::free(Buffer *b)
 {
   impl_->free(b);
 }
+
+void PoolAllocator::setCapacity(size_t count)
+{
+  impl_->setCapacity(count);
+}
+
+void PoolAllocator::setEagerAllocation(bool eager)
+{
+  impl_->setEagerAllocation(eager);
+}
+
+bool PoolAllocator::getStatistics(BufferStatistics &statistics)
+{
+  return impl_->getStatistics(statistics);
+}
 } // namespace libfreenect2
@@ -0,0 +1,961 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file cpu_depth_kernels.cpp Scalar and SIMD row kernels of the CPU depth processor. */
+
+#include <libfreenect2/cpu_depth_kernels.h>
+#include <libfreenect2/cpu_depth_kernels_simd.h>
+#include <libfreenect2/logging.h>
+#include <libfreenect2/config.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define LIBFREENECT2_CPU_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace libfreenect2
+{
+
+#ifdef LIBFREENECT2_CPU_X86
+/** Run the CPUID instruction for leaf @p leaf, subleaf 0. */
+static void cpuid(unsigned int leaf, unsigned int regs[4])
+{
+#ifdef _MSC_VER
+  int r[4];
+  __cpuidex(r, leaf, 0);
+  for(int i = 0; i < 4; ++i)
+    regs[i] = r[i];
+#else
+  __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+/** Low word of the XCR0 register: which register states the OS saves. */
+static unsigned int xgetbv0()
+{
+#ifdef _MSC_VER
+  return (unsigned int)_xgetbv(0);
+#else
+  unsigned int eax, edx;
+  __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return eax;
+#endif
+}
+#endif // LIBFREENECT2_CPU_X86
+
+/** CpuDepthKernels::unpackRow with 8 codes per iteration, read with two overlapping 64-bit loads. */
+static void unpackRowScalar(const unsigned char *data, int sub, int y, const int16_t *lut, int x_begin, int x_end, int16_t *out)
+{
+  const unsigned char *row = packedRow(data, sub, y);
+  uint16_t codes[512];
+
+  // Columns [x_begin, x_end) use codes [code_begin, code_end) of each quarter
+  // of the row, rounded out to whole groups of 16 codes.
+  const int code_begin = x_begin / 64 * 16, code_end = (x_end + 63) / 64 * 16;
+
+  // 8 codes take 11 bytes.
+  for(int quarter = 0; quarter < 512; quarter += 128)
+  for(int i = quarter + code_begin; i < quarter + code_end; i += 8)
+  {
+    const unsigned char *bytes = row + i / 8 * 11;
+    uint64_t lo, hi;
+    std::memcpy(&lo, bytes, sizeof(lo));
+    std::memcpy(&hi, bytes + 4, sizeof(hi));
+
+    codes[i + 0] = lo & 2047;
+    codes[i + 1] = (lo >> 11) & 2047;
+    codes[i + 2] = (lo >> 22) & 2047;
+    codes[i + 3] = (lo >> 33) & 2047;
+    codes[i + 4] = (lo >> 44) & 2047;
+    codes[i + 5] = (hi >> 23) & 2047;
+    codes[i + 6] = (hi >> 34) & 2047;
+    codes[i + 7] = (hi >> 45) & 2047;
+  }
+
+  lookUpCodes(codes, lut, x_begin, x_end, out);
+}
+
+/**
+ * Process measurement (all three layers).
+ * @param params Processing parameters.
+ * @param cos_phase Cosine of each of the three #phase_in_rad parameters.
+ * @param sin_phase Sine of each of the three #phase_in_rad parameters.
+ * @param abMultiplierPerFrq Multiplier.
+ * @param p0 P0 table entry of the pixel.
+ * @param zmultiplier Z table entry of the pixel.
+ * @param m Measurement.
+ * @param [out] a_out Processed measurement IR a.
+ * @param [out] b_out Processed measurement IR b.
+ * @param [out] amplitude_out Processed measurement IR amplitude.
+ */
+static void processMeasurementTriple(const DepthPacketProcessor::Parameters &params, const float cos_phase[3], const float sin_phase[3],
+    float abMultiplierPerFrq, uint16_t p0, float zmultiplier, const int32_t* m, float *a_out, float *b_out, float *amplitude_out)
+{
+  if (0 < zmultiplier)
+  {
+    bool saturated = (m[0] == 32767 || m[1] == 32767 || m[2] == 32767);
+    if (!saturated)
+    {
+      float angle = -((float)p0) * float(0.000031 * M_PI);
+      float cos_p0 = std::cos(angle), sin_p0 = std::sin(angle);
+
+      // formula given in Patent US 8,587,771 B2, with cos(p0 + phase_in_rad[i])
+      // and sin(-p0 - phase_in_rad[i]) expanded by the angle sum identities
+      float m_cos = cos_phase[0] * m[0] + cos_phase[1] * m[1] + cos_phase[2] * m[2];
+      float m_sin = sin_phase[0] * m[0] + sin_phase[1] * m[1] + sin_phase[2] * m[2];
+      float ir_image_a = cos_p0 * m_cos - sin_p0 * m_sin;
+      float ir_image_b = -(sin_p0 * m_cos + cos_p0 * m_sin);
+
+      // only if modeMask & 32 != 0;
+      if(true)//(modeMask & 32) != 0)
+      {
+          ir_image_a *= abMultiplierPerFrq;
+          ir_image_b *= abMultiplierPerFrq;
+      }
+      float ir_amplitude = std::sqrt(ir_image_a * ir_image_a + ir_image_b * ir_image_b) * params.ab_multiplier;
+
+      *a_out = ir_image_a;
+      *b_out = ir_image_b;
+      *amplitude_out = ir_amplitude;
+    }
+    else
+    {
+      // Saturated pixel.
+      *a_out = 0;
+      *b_out = 0;
+      *amplitude_out = 65535.0;
+    }
+  }
+  else
+  {
+    // Invalid pixel.
+    *a_out = 0;
+    *b_out = 0;
+    *amplitude_out = 0;
+  }
+}
+
+static void processStage1RowScalar(const DepthPacketProcessor::Parameters &params, const int16_t * const raw[9], const uint16_t * const p0_row[3],
+    const float *z_table_row, int x_begin, int x_end, const Stage1Row &out)
+{
+  float cos_phase[3], sin_phase[3];
+  for(int i = 0; i < 3; ++i)
+  {
+    cos_phase[i] = std::cos(params.phase_in_rad[i]);
+    sin_phase[i] = std::sin(params.phase_in_rad[i]);
+  }
+
+  for(int x = x_begin; x < x_end; ++x)
+  {
+    for(int i = 0; i < 3; ++i)
+    {
+      int32_t m[3] = {raw[3 * i][x], raw[3 * i + 1][x], raw[3 * i + 2][x]};
+      processMeasurementTriple(params, cos_phase, sin_phase, params.ab_multiplier_per_frq[i], p0_row[i][x], z_table_row[x], m,
+          out.a[i] + x, out.b[i] + x, out.amplitude[i] + x);
+    }
+  }
+}
+
+/**
+ * Filter the a and b measurements of a pixel with a joint bilateral filter.
+ * The pixel must not be on the image border.
+ * @param x Horizontal position.
+ * @param params Filter parameters.
+ * @param m Stage 1 output of rows y-1, y and y+1.
+ * @param [out] out Output row.
+ * @param [out] bilateral_max_edge_test Whether the accumulated distance of each image stayed within limits.
+ */
+static void filterPixelStage1(int x, const DepthPacketProcessor::Parameters &params, const Stage1Row *m[3], const FilteredRow &out, bool& bilateral_max_edge_test)
+{
+  bilateral_max_edge_test = true;
+
+  float m_normalized[2];
+  float other_m_normalized[2];
+
+  for(int i = 0; i < 3; ++i)
+  {
+    const float *a_ptr = m[1]->a[i] + x, *b_ptr = m[1]->b[i] + x;
+    float norm2 = a_ptr[0] * a_ptr[0] + b_ptr[0] * b_ptr[0];
+    float inv_norm = 1.0f / std::sqrt(norm2);
+    inv_norm = (inv_norm == inv_norm) ? inv_norm : std::numeric_limits<float>::infinity();
+
+    m_normalized[0] = a_ptr[0] * inv_norm;
+    m_normalized[1] = b_ptr[0] * inv_norm;
+
+    int j = 0;
+
+    float weight_acc = 0.0f;
+    float weighted_m_acc[2] = {0.0f, 0.0f};
+
+    float threshold = (params.joint_bilateral_ab_threshold * params.joint_bilateral_ab_threshold) / (params.ab_multiplier * params.ab_multiplier);
+    float joint_bilateral_exp = params.joint_bilateral_exp;
+
+    if(norm2 < threshold)
+    {
+      threshold = 0.0f;
+      joint_bilateral_exp = 0.0f;
+    }
+
+    float dist_acc = 0.0f;
+
+    for(int yi = -1; yi < 2; ++yi)
+    {
+      for(int xi = -1; xi < 2; ++xi, ++j)
+      {
+        if(yi == 0 && xi == 0)
+        {
+          weight_acc += params.gaussian_kernel[j];
+
+          weighted_m_acc[0] += params.gaussian_kernel[j] * a_ptr[0];
+          weighted_m_acc[1] += params.gaussian_kernel[j] * b_ptr[0];
+          continue;
+        }
+
+        float other_a = m[yi + 1]->a[i][x + xi], other_b = m[yi + 1]->b[i][x + xi];
+        float other_norm2 = other_a * other_a + other_b * other_b;
+        // TODO: maybe fix numeric problems when norm = 0 - original code uses reciprocal square root, which returns +inf for +0
+        float other_inv_norm = 1.0f / std::sqrt(other_norm2);
+        other_inv_norm = (other_inv_norm == other_inv_norm) ? other_inv_norm : std::numeric_limits<float>::infinity();
+
+        other_m_normalized[0] = other_a * other_inv_norm;
+        other_m_normalized[1] = other_b * other_inv_norm;
+
+        float dist = -(other_m_normalized[0] * m_normalized[0] + other_m_normalized[1] * m_normalized[1]);
+        dist += 1.0f;
+        dist *= 0.5f;
+
+        float weight = 0.0f;
+
+        if(other_norm2 >= threshold)
+        {
+          weight = (params.gaussian_kernel[j] * std::exp(-1.442695f * joint_bilateral_exp * dist));
+          dist_acc += dist;
+        }
+
+        weighted_m_acc[0] += weight * other_a;
+        weighted_m_acc[1] += weight * other_b;
+
+        weight_acc += weight;
+      }
+    }
+
+    bilateral_max_edge_test = bilateral_max_edge_test && dist_acc < params.joint_bilateral_max_edge;
+
+    out.a[i][x] = 0.0f < weight_acc ? weighted_m_acc[0] / weight_acc : 0.0f;
+    out.b[i][x] = 0.0f < weight_acc ? weighted_m_acc[1] / weight_acc : 0.0f;
+  }
+}
+
+/** Copy pixel @p x unfiltered, for the image border. */
+static void copyPixelStage1(int x, const Stage1Row &in, const FilteredRow &out)
+{
+  for(int i = 0; i < 3; ++i)
+  {
+    out.a[i][x] = in.a[i][x];
+    out.b[i][x] = in.b[i][x];
+  }
+  out.max_edge_test[x] = 1;
+}
+
+static void processIrRowScalar(const DepthPacketProcessor::Parameters &params, const Stage1Row &amplitude_in, int x_begin, int x_end, float *ir_out)
+{
+  for(int x = x_begin; x < x_end; ++x)
+  {
+    ir_out[x] = std::min((amplitude_in.amplitude[0][x] + amplitude_in.amplitude[1][x] + amplitude_in.amplitude[2][x]) * 0.3333333f * params.ab_output_multiplier, 65535.0f);
+  }
+}
+
+static void filterStage1RowScalar(int y, const DepthPacketProcessor::Parameters &params, const Stage1Row *m[3], int width, int height,
+    int x_begin, int x_end, const FilteredRow &out)
+{
+  if(y < 1 || y > height - 2)
+  {
+    for(int x = x_begin; x < x_end; ++x)
+      copyPixelStage1(x, *m[1], out);
+    return;
+  }
+
+  if(x_begin == 0)
+    copyPixelStage1(0, *m[1], out);
+  for(int x = std::max(x_begin, 1); x < std::min(x_end, width - 1); ++x)
+  {
+    bool max_edge_test_val = true;
+    filterPixelStage1(x, params, m, out, max_edge_test_val);
+    out.max_edge_test[x] = max_edge_test_val ? 1 : 0;
+  }
+  if(x_end == width)
+    copyPixelStage1(width - 1, *m[1], out);
+}
+
+/**
+ * Transform measurement.
+ * @param params Processing parameters.
+ * @param [in, out] m Measurement.
+ */
+static void transformMeasurements(const DepthPacketProcessor::Parameters &params, float* m)
+{
+  float tmp0 = std::atan2((m[1]), (m[0]));
+  tmp0 = tmp0 < 0 ? tmp0 + M_PI * 2.0f : tmp0;
+  tmp0 = (tmp0 != tmp0) ? 0 : tmp0;
+
+  float tmp1 = std::sqrt(m[0] * m[0] + m[1] * m[1]) * params.ab_multiplier;
+
+  m[0] = tmp0; // phase
+  m[1] = tmp1; // ir amplitude - (possibly bilateral filtered)
+}
+
+/**
+ * Unwrap the phase of a pixel and compute its depth.
+ * @param params Processing parameters.
+ * @param [in, out] m0 a, b and amplitude of the first frequency, replaced by phase and amplitude.
+ * @param [in, out] m1 Same for the second frequency.
+ * @param [in, out] m2 Same for the third frequency.
+ * @param xmultiplier X table value of the pixel.
+ * @param zmultiplier Z table value of the pixel.
+ * @param [out] ir_out IR.
+ * @param [out] depth_out Depth.
+ * @param [out] ir_sum_out Sum of the amplitudes, or NULL.
+ * @param [out] dealiasing_out Dealiasing confidence, or NULL.
+ */
+static void processPixelStage2(const DepthPacketProcessor::Parameters &params, float *m0, float *m1, float *m2, float xmultiplier, float zmultiplier, float *ir_out, float *depth_out, float *ir_sum_out,
+    float *dealiasing_out)
+{
+  //// 10th measurement
+  //float m9 = 1; // decodePixelMeasurement(data, 9, x, y);
+  //
+  //// WTF?
+  //bool cond0 = zmultiplier == 0 || (m9 >= 0 && m9 < 32767);
+  //m9 = std::max(-m9, m9);
+  //// if m9 is positive or pixel is invalid (zmultiplier) we set it to 0 otherwise to its absolute value O.o
+  //m9 = cond0 ? 0 : m9;
+
+  transformMeasurements(params, m0);
+  transformMeasurements(params, m1);
+  transformMeasurements(params, m2);
+
+  float ir_sum = m0[1] + m1[1] + m2[1];
+
+  float phase;
+  float dealiasing = 0.0f;
+  // if(DISABLE_DISAMBIGUATION)
+  if(false)
+  {
+#if 0
+      //r0.yz = r3.zx + r4.zx // add
+      //r0.yz = r5.xz + r0.zy // add
+      float phase = m0[0] + m1[0] + m2[0]; // r0.y
+      float tmp1 = m0[2] + m1[2] + m2[2];  // r0.z
+
+      //r7.xyz = r3.zxy + r4.zxy // add
+      //r4.xyz = r5.zyx + r7.xzy // add
+      float tmp2 = m0[0] + m1[0] + m2[0]; // r4.z
+      //r3.zw = r4.xy // mov
+      float tmp3 = m0[2] + m1[2] + m2[2]; // r3.z
+      float tmp4 = m0[1] + m1[1] + m2[1]; // r3.w
+#endif
+  }
+  else
+  {
+    float ir_min = std::min(std::min(m0[1], m1[1]), m2[1]);
+
+    if (ir_min < params.individual_ab_threshold || ir_sum < params.ab_threshold)
+    {
+      phase = 0;
+    }
+    else
+    {
+      float t0 = m0[0] / (2.0f * M_PI) * 3.0f;
+      float t1 = m1[0] / (2.0f * M_PI) * 15.0f;
+      float t2 = m2[0] / (2.0f * M_PI) * 2.0f;
+
+      float t5 = (std::floor((t1 - t0) * 0.333333f + 0.5f) * 3.0f + t0);
+      float t3 = (-t2 + t5);
+      float t4 = t3 * 2.0f;
+
+      bool c1 = t4 >= -t4; // true if t4 positive
+
+      float f1 = c1 ? 2.0f : -2.0f;
+      float f2 = c1 ? 0.5f : -0.5f;
+      t3 *= f2;
+      t3 = (t3 - std::floor(t3)) * f1;
+
+      bool c2 = 0.5f < std::abs(t3) && std::abs(t3) < 1.5f;
+
+      float t6 = c2 ? t5 + 15.0f : t5;
+      float t7 = c2 ? t1 + 15.0f : t1;
+
+      float t8 = (std::floor((-t2 + t6) * 0.5f + 0.5f) * 2.0f + t2) * 0.5f;
+
+      t6 *= 0.333333f; // = / 3
+      t7 *= 0.066667f; // = / 15
+
+      float t9 = (t8 + t6 + t7); // transformed phase measurements (they are transformed and divided by the values the original values were multiplied with)
+      float t10 = t9 * 0.333333f; // some avg
+
+      t6 *= 2.0f * M_PI;
+      t7 *= 2.0f * M_PI;
+      t8 *= 2.0f * M_PI;
+
+      // some cross product
+      float t8_new = t7 * 0.826977f - t8 * 0.110264f;
+      float t6_new = t8 * 0.551318f - t6 * 0.826977f;
+      float t7_new = t6 * 0.110264f - t7 * 0.551318f;
+
+      t8 = t8_new;
+      t6 = t6_new;
+      t7 = t7_new;
+
+      float norm = t8 * t8 + t6 * t6 + t7 * t7;
+      float mask = t9 >= 0.0f ? 1.0f : 0.0f;
+      t10 *= mask;
+
+      bool slope_positive = 0 < params.ab_confidence_slope;
+
+      float ir_min_ = std::min(std::min(m0[1], m1[1]), m2[1]);
+      float ir_max_ = std::max(std::max(m0[1], m1[1]), m2[1]);
+
+      float ir_x = slope_positive ? ir_min_ : ir_max_;
+
+      ir_x = std::log(ir_x);
+      ir_x = (ir_x * params.ab_confidence_slope * 0.301030f + params.ab_confidence_offset) * 3.321928f;
+      ir_x = std::exp(ir_x);
+      ir_x = std::min(params.max_dealias_confidence, std::max(params.min_dealias_confidence, ir_x));
+      ir_x *= ir_x;
+
+      float mask2 = ir_x >= norm ? 1.0f : 0.0f;
+
+      float t11 = t10 * mask2;
+
+      float mask3 = params.max_dealias_confidence * params.max_dealias_confidence >= norm ? 1.0f : 0.0f;
+      t10 *= mask3;
+      phase = true/*(modeMask & 2) != 0*/ ? t11 : t10;
+
+      // norm is the disagreement of the unwrapped phases, ir_x the largest one accepted
+      dealiasing = 0 < phase ? std::max(0.0f, 1.0f - norm / ir_x) : 0.0f;
+    }
+  }
+
+  // this seems to be the phase to depth mapping :)
+  phase = 0 < phase ? phase + params.phase_offset : phase;
+
+  float depth_linear = zmultiplier * phase;
+  float max_depth = phase * params.unambigious_dist * 2;
+
+  bool cond1 = /*(modeMask & 32) != 0*/ true && 0 < depth_linear && 0 < max_depth;
+
+  xmultiplier = (xmultiplier * 90) / (max_depth * max_depth * 8192.0);
+
+  float depth_fit = depth_linear / (-depth_linear * xmultiplier + 1);
+
+  depth_fit = depth_fit < 0 ? 0 : depth_fit;
+  float depth = cond1 ? depth_fit : depth_linear; // r1.y -> later r2.z
+
+  // depth
+  *depth_out = depth;
+  if(ir_sum_out != 0)
+  {
+    *ir_sum_out = ir_sum;
+  }
+  if(dealiasing_out != 0)
+  {
+    *dealiasing_out = dealiasing;
+  }
+
+  // ir
+  //*ir_out = std::min((m1[2]) * ab_output_multiplier, 65535.0f);
+  // ir avg
+  *ir_out = std::min((m0[2] + m1[2] + m2[2]) * 0.3333333f * params.ab_output_multiplier, 65535.0f);
+  //ir_out[0] = std::min(m0[2] * ab_output_multiplier, 65535.0f);
+  //ir_out[1] = std::min(m1[2] * ab_output_multiplier, 65535.0f);
+  //ir_out[2] = std::min(m2[2] * ab_output_multiplier, 65535.0f);
+}
+
+static void processStage2RowScalar(const DepthPacketProcessor::Parameters &params, const FilteredRow &in, const Stage1Row &amplitude_in, const float *x_table_row, const float *z_table_row,
+    int x_begin, int x_end, float *ir_out, float *depth_out, float *ir_sum_out, float *dealiasing_out)
+{
+  float ir_unused;
+
+  for(int x = x_begin; x < x_end; ++x)
+  {
+    float m0[3] = {in.a[0][x], in.b[0][x], amplitude_in.amplitude[0][x]};
+    float m1[3] = {in.a[1][x], in.b[1][x], amplitude_in.amplitude[1][x]};
+    float m2[3] = {in.a[2][x], in.b[2][x], amplitude_in.amplitude[2][x]};
+
+    processPixelStage2(params, m0, m1, m2, x_table_row[x], z_table_row[x], ir_out != 0 ? ir_out + x : &ir_unused, depth_out + x, ir_sum_out != 0 ? ir_sum_out + x : 0,
+        dealiasing_out != 0 ? dealiasing_out + x : 0);
+  }
+}
+
+/*
+ * The KDE kernels below implement the phase unwrapping algorithm described in
+ * the paper "Efficient Phase Unwrapping using Kernel Density Estimation",
+ * ECCV 2016, Felix Järemo Lawin, Per-Erik Forssen and Hannes Ovren, see
+ * http://www.cvl.isy.liu.se/research/datasets/kinect2-dataset/. They follow
+ * opencl_kde_depth_packet_processor.cl.
+ */
+
+const float kde_k_list[KDE_NUM_HYPOTHESES] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f};
+const float kde_n_list[KDE_NUM_HYPOTHESES] = {0.0f, 0.0f, 1.0f, 1.0f, 2.0f, 1.0f, 2.0f, 2.0f, 3.0f, 3.0f, 4.0f, 4.0f, 3.0f, 4.0f, 4.0f, 5.0f, 5.0f, 5.0f, 6.0f, 5.0f, 6.0f, 6.0f, 7.0f, 7.0f, 8.0f, 8.0f, 7.0f, 8.0f, 9.0f, 9.0f};
+const float kde_m_list[KDE_NUM_HYPOTHESES] = {0.0f, 1.0f, 1.0f, 2.0f, 2.0f, 3.0f, 3.0f, 4.0f, 4.0f, 5.0f, 5.0f, 6.0f, 6.0f, 7.0f, 7.0f, 7.0f, 7.0f, 8.0f, 8.0f, 9.0f, 9.0f, 10.0f, 10.0f, 11.0f, 11.0f, 12.0f, 12.0f, 13.0f, 13.0f, 14.0f};
+
+/**
+ * Rank all phase unwrapping hypotheses of a pixel.
+ * @param t0 Phase of the first frequency, scaled to [0, 3).
+ * @param t1 Phase of the second frequency, scaled to [0, 15).
+ * @param t2 Phase of the third frequency, scaled to [0, 2).
+ * @param num_hyps Number of hypotheses to keep, at most 3.
+ * @param [out] phase Fused phase of the most likely hypotheses, most likely first.
+ * @param [out] err Residual of these hypotheses.
+ */
+static void phaseUnwrapper(float t0, float t1, float t2, size_t num_hyps, float phase[3], float err[3])
+{
+  //unwrapping weight for cost function
+  const float w1 = 1.0f;
+  const float w2 = 10.0f;
+  const float w3 = 1.0218f;
+
+  float err_min[3] = {100000.0f, 200000.0f, 300000.0f};
+  int ind_min[3] = {0, 0, 0};
+
+  for(int i = 0; i < KDE_NUM_HYPOTHESES; ++i)
+  {
+    const float k = kde_k_list[i], n = kde_n_list[i], m = kde_m_list[i];
+
+    //phase unwrapping equation residuals
+    float err1 = 3.0f * n - 15.0f * k - (t1 - t0);
+    float err2 = 3.0f * n - 2.0f * m - (t2 - t0);
+    float err3 = 15.0f * k - 2.0f * m - (t2 - t1);
+    float e = w1 * err1 * err1 + w2 * err2 * err2 + w3 * err3 * err3;
+
+    for(size_t j = 0; j < num_hyps; ++j)
+    {
+      if(e < err_min[j])
+      {
+        for(size_t l = num_hyps - 1; l > j; --l)
+        {
+          err_min[l] = err_min[l - 1];
+          ind_min[l] = ind_min[l - 1];
+        }
+        err_min[j] = e;
+        ind_min[j] = i;
+        break;
+      }
+    }
+  }
+
+  for(size_t j = 0; j < num_hyps; ++j)
+  {
+    //Weighted phases for phase fusion weighted average
+    float phi2_out = (t2 / 2.0f + kde_m_list[ind_min[j]]);
+    float phi1_out = (t1 / 15.0f + kde_k_list[ind_min[j]]);
+    float phi0_out = (t0 / 3.0f + kde_n_list[ind_min[j]]);
+
+    phase[j] = (phi2_out + phi1_out + phi0_out) / 3.0f;
+    err[j] = err_min[j];
+  }
+}
+
+/**
+ * Predict the phase variance of the three frequencies from their amplitude.
+ *
+ * Model: sigma = atan(sqrt(1/(gamma0*a+gamma1*a^2+gamma2)-1)). The gammas are
+ * optimized using lsqnonlin in matlab. For more details see the paper
+ * "Efficient Phase Unwrapping using Kernel Density Estimation", section 3.3 and 4.4.
+ * @param ir Amplitudes.
+ * @param [out] var Variances.
+ */
+static void calculatePhaseUnwrappingVar(const float ir[3], float var[3])
+{
+  static const float gamma[3][3] =
+  {
+    {0.8211288451f, 0.002601348899f, 3.549793908f},
+    {1.259642407f, 0.005478390508f, 4.335841127f},
+    {0.6447928035f, 0.0009627273649f, 3.368205575f},
+  };
+  static const float roots[3] = {5.64173671f, 4.31705182f, 6.84453530f};
+
+  for(int i = 0; i < 3; ++i)
+  {
+    float q = gamma[i][0] * ir[i] - gamma[i][1] * ir[i] * ir[i] - gamma[i][2];
+    q *= q;
+
+    float sigma;
+    if(1.0f < q)
+      sigma = std::atan(std::sqrt(1.0f / (q - 1.0f)));
+    else
+      sigma = roots[i] < ir[i] ? roots[i] * 0.5f * float(M_PI) / ir[i] : 0.5f * float(M_PI);
+
+    sigma = sigma < 0.001f ? 0.001f : sigma;
+    var[i] = sigma * sigma;
+  }
+}
+
+/**
+ * Rank the phase unwrapping hypotheses of a pixel and compute their likelihood.
+ * @param params Processing parameters.
+ * @param a a of the three frequencies.
+ * @param b b of the three frequencies.
+ * @param [out] phase Phase of the Parameters::num_hyps most likely hypotheses.
+ * @param [out] conf Likelihood of these hypotheses.
+ */
+static void processKdePhasePixel(const DepthPacketProcessor::Parameters &params, const float a[3], const float b[3], float phase[3], float conf[3])
+{
+  float wrapped_phase[3], ir[3];
+
+  for(int i = 0; i < 3; ++i)
+  {
+    float m[2] = {a[i], b[i]};
+    transformMeasurements(params, m);
+    wrapped_phase[i] = m[0];
+    ir[i] = m[1];
+  }
+
+  float ir_sum = ir[0] + ir[1] + ir[2];
+
+  //scale with least common multiples of modulation frequencies
+  float t0 = wrapped_phase[0] / float(2.0 * M_PI) * 3.0f;
+  float t1 = wrapped_phase[1] / float(2.0 * M_PI) * 15.0f;
+  float t2 = wrapped_phase[2] / float(2.0 * M_PI) * 2.0f;
+
+  float err[3];
+  phaseUnwrapper(t0, t1, t2, params.num_hyps, phase, err);
+
+  float phase_likelihood = 0.0f;
+
+  //check if near saturation
+  if(ir_sum < 0.4f * 65535.0f)
+  {
+    //calculate phase likelihood from amplitude
+    float var[3];
+    calculatePhaseUnwrappingVar(ir, var);
+    phase_likelihood = std::exp(-(var[0] + var[1] + var[2]) / (2.0f * params.phase_confidence_scale));
+    phase_likelihood = phase_likelihood == phase_likelihood ? phase_likelihood : 0.0f;
+  }
+
+  const float max_phase = params.max_depth * 9.0f / 18750.0f;
+
+  for(size_t j = 0; j < params.num_hyps; ++j)
+  {
+    //merge unwrapping likelihood with phase likelihood
+    conf[j] = phase_likelihood * std::exp(-err[j] / (2.0f * params.unwrapping_likelihood_scale));
+
+    //suppress confidence if phase is beyond allowed range
+    conf[j] = phase[j] > max_phase || conf[j] < KDE_MIN_CONF ? 0.0f : conf[j];
+  }
+}
+
+static void processKdePhaseRowScalar(const DepthPacketProcessor::Parameters &params, const FilteredRow &in, const Stage1Row &amplitude_in,
+    int x_begin, int x_end, float *ir_out, const KdePlanes &out, int y)
+{
+  const int row = y * out.stride;
+
+  for(int x = x_begin; x < x_end; ++x)
+  {
+    float a[3] = {in.a[0][x], in.a[1][x], in.a[2][x]};
+    float b[3] = {in.b[0][x], in.b[1][x], in.b[2][x]};
+    float phase[3], conf[3];
+
+    processKdePhasePixel(params, a, b, phase, conf);
+
+    for(size_t j = 0; j < params.num_hyps; ++j)
+    {
+      out.phase[j][row + x] = phase[j];
+      out.conf[j][row + x] = conf[j];
+    }
+
+    if(ir_out != 0)
+    {
+      ir_out[x] = std::min((amplitude_in.amplitude[0][x] + amplitude_in.amplitude[1][x] + amplitude_in.amplitude[2][x]) * 0.3333333f * params.ab_output_multiplier, 65535.0f);
+    }
+  }
+}
+
+/**
+ * Select the hypothesis of a pixel with the highest kernel density, and compute its depth.
+ * @param params Processing parameters.
+ * @param in Hypotheses of the whole frame.
+ * @param x Horizontal position.
+ * @param y Vertical position.
+ * @param gauss Spatial weights.
+ * @param xmultiplier X table value of the pixel.
+ * @param zmultiplier Z table value of the pixel.
+ * @param [out] depth_out Depth.
+ */
+static void filterKdePixel(const DepthPacketProcessor::Parameters &params, const KdePlanes &in, int x, int y, const float *gauss,
+    float xmultiplier, float zmultiplier, float *depth_out)
+{
+  const int num_hyps = (int)params.num_hyps;
+  const int size = (int)params.kde_neigborhood_size;
+  const int offset = y * in.stride + x;
+
+  float phase_local[3], kde_val[3] = {0.0f, 0.0f, 0.0f};
+
+  for(int j = 0; j < num_hyps; ++j)
+  {
+    phase_local[j] = in.phase[j][offset];
+  }
+
+  if(x >= 1 && x < 511)
+  {
+    float sum[3] = {0.0f, 0.0f, 0.0f};
+    float sum_gauss = 0.0f;
+
+    //calculate KDE for all hypothesis within the neigborhood; pixels outside of it have no likelihood
+    for(int k = -size; k <= size; ++k)
+    {
+      for(int l = -size; l <= size; ++l)
+      {
+        const int ind = offset + k * in.stride + l;
+        const float gauss_kl = gauss[k + size] * gauss[l + size];
+
+        float conf_sum = 0.0f;
+        for(int h = 0; h < num_hyps; ++h)
+        {
+          conf_sum += in.conf[h][ind];
+        }
+        sum_gauss += gauss_kl * conf_sum;
+
+        for(int j = 0; j < num_hyps; ++j)
+        {
+          float density = 0.0f;
+          for(int h = 0; h < num_hyps; ++h)
+          {
+            float diff = in.phase[h][ind] - phase_local[j];
+            float exponent = -diff * diff / (2.0f * params.kde_sigma_sqr);
+            density += in.conf[h][ind] * (exponent < KDE_MIN_EXPONENT ? 0.0f : std::exp(exponent));
+          }
+          sum[j] += gauss_kl * density;
+        }
+      }
+    }
+
+    for(int j = 0; j < num_hyps; ++j)
+    {
+      kde_val[j] = sum_gauss > 0.5f ? sum[j] / sum_gauss : sum[j] * 2.0f;
+    }
+  }
+
+  //select hypothesis
+  int best = 0;
+  if(kde_val[1] > kde_val[0] || (num_hyps == 3 && kde_val[2] > kde_val[0]))
+  {
+    best = num_hyps == 3 && kde_val[2] > kde_val[1] ? 2 : 1;
+  }
+
+  float phase_final = phase_local[best];
+  float max_val = kde_val[best];
+
+  float depth_linear = zmultiplier * phase_final;
+  float max_depth = phase_final * params.unambigious_dist * 2.0f;
+
+  bool cond1 = 0.0f < depth_linear && 0.0f < max_depth;
+
+  xmultiplier = (xmultiplier * 90.0f) / (max_depth * max_depth * 8192.0f);
+
+  float depth_fit = depth_linear / (-depth_linear * xmultiplier + 1);
+  depth_fit = depth_fit < 0.0f ? 0.0f : depth_fit;
+
+  float d = cond1 ? depth_fit : depth_linear; // r1.y -> later r2.z
+
+  // Like the OpenCL kernels, the three hypothesis variant checks the range of the linear depth.
+  float range_depth = num_hyps == 3 ? depth_linear : d;
+  max_val = range_depth < params.min_depth || range_depth > params.max_depth ? 0.0f : max_val;
+
+  //set to zero if confidence is low
+  *depth_out = max_val >= params.kde_threshold ? d : 0.0f;
+}
+
+static void filterKdeRowScalar(const DepthPacketProcessor::Parameters &params, const KdePlanes &in, int y, const float *gauss,
+    const float *x_table_row, const float *z_table_row, int x_begin, int x_end, float *depth_out)
+{
+  for(int x = x_begin; x < x_end; ++x)
+  {
+    filterKdePixel(params, in, x, y, gauss, x_table_row[x], z_table_row[x], depth_out + x);
+  }
+}
+
+template<typename T>
+static void mapDepthToColorScalar(const T *depth, const int *map_dist, const float *map_x, const int *map_yi,
+    float shift_m, float fx, float cx, int size_color, int count, float *undistorted, int *color_offset)
+{
+  for(int i = 0; i < count; ++i)
+  {
+    // getting index of distorted depth pixel
+    const int index = map_dist[i];
+
+    // check if distorted depth pixel is outside of the depth image
+    if(index < 0){
+      color_offset[i] = -1;
+      undistorted[i] = 0;
+      continue;
+    }
+
+    // getting depth value for current pixel
+    const float z = depth[index];
+    undistorted[i] = z;
+
+    // checking for invalid depth value
+    if(z <= 0.0f){
+      color_offset[i] = -1;
+      continue;
+    }
+
+    // calculating x offset for rgb image based on depth value
+    const float rx = (map_x[i] + (shift_m / z)) * fx + cx;
+    const int c_off = (int)rx + map_yi[i] * 1920; // same as round for positive numbers (0.5f was already added to cx)
+
+    // check if c_off is outside of rgb image
+    // checking rx/cx is not needed because the color image is much wider then the depth image
+    color_offset[i] = c_off < 0 || c_off >= size_color ? -1 : c_off;
+  }
+}
+
+static const CpuDepthKernels scalar_kernels =
+{
+  "scalar",
+  &unpackRowScalar,
+  &processStage1RowScalar,
+  &processIrRowScalar,
+  &filterStage1RowScalar,
+  &processStage2RowScalar,
+  &processKdePhaseRowScalar,
+  &filterKdeRowScalar,
+  &mapDepthToColorScalar<float>,
+  &mapDepthToColorScalar<uint16_t>,
+};
+
+#if defined(LIBFREENECT2_SIMD_SSE2) || defined(LIBFREENECT2_SIMD_NEON)
+#define LIBFREENECT2_CPU_DEPTH_SIMD
+
+static const CpuDepthKernels simd_kernels =
+{
+#ifdef LIBFREENECT2_SIMD_SSE2
+  "sse2",
+  &unpackRowSse2,
+#else
+  "neon",
+  &unpackRowScalar,
+#endif
+  &processStage1RowSimd<F32x4>,
+  &processIrRowSimd<F32x4>,
+  &filterStage1RowSimd<F32x4>,
+  &processStage2RowSimd<F32x4>,
+  &processKdePhaseRowSimd<F32x4>,
+  &filterKdeRowSimd<F32x4>,
+  &mapDepthToColorSimd<F32x4, float>,
+  &mapDepthToColorSimd<F32x4, uint16_t>,
+};
+
+#endif // LIBFREENECT2_SIMD_SSE2 || LIBFREENECT2_SIMD_NEON
+
+#ifdef LIBFREENECT2_WITH_AVX2_KERNELS
+/** Defined in cpu_depth_kernels_avx2.cpp, which is compiled for AVX2 and FMA. */
+extern const CpuDepthKernels cpu_depth_kernels_avx2;
+#endif
+
+/** Whether the CPU and the OS support AVX2 and FMA. */
+static bool cpuSupportsAvx2()
+{
+#ifdef LIBFREENECT2_CPU_X86
+  unsigned int regs[4]; // eax, ebx, ecx, edx
+
+  cpuid(0, regs);
+  if(regs[0] < 7)
+    return false;
+
+  cpuid(1, regs);
+  const bool fma = (regs[2] & (1u << 12)) != 0;
+  const bool osxsave = (regs[2] & (1u << 27)) != 0;
+  const bool avx = (regs[2] & (1u << 28)) != 0;
+  if(!fma || !osxsave || !avx)
+    return false;
+
+  // The OS must save the YMM registers on context switches.
+  if((xgetbv0() & 6) != 6)
+    return false;
+
+  cpuid(7, regs);
+  return (regs[1] & (1u << 5)) != 0;
+#else
+  return false;
+#endif
+}
+
+const CpuDepthKernels *findCpuDepthKernels(const char *isa)
+{
+  const CpuDepthKernels *all[4];
+  size_t count = 0;
+
+#ifdef LIBFREENECT2_WITH_AVX2_KERNELS
+  if(cpuSupportsAvx2())
+    all[count++] = &cpu_depth_kernels_avx2;
+#endif
+#ifdef LIBFREENECT2_CPU_DEPTH_SIMD
+  // SSE2 is part of x86-64 and NEON of AArch64.
+  all[count++] = &simd_kernels;
+#endif
+  all[count++] = &scalar_kernels;
+
+  if(isa == 0)
+    return all[0];
+
+  for(size_t i = 0; i < count; ++i)
+  {
+    if(std::strcmp(isa, all[i]->isa) == 0)
+      return all[i];
+  }
+  return 0;
+}
+
+const CpuDepthKernels &selectCpuDepthKernels()
+{
+  const char *isa = std::getenv("LIBFREENECT2_CPU_ISA");
+  const CpuDepthKernels *kernels = findCpuDepthKernels(isa);
+
+  if(kernels == 0)
+  {
+    LOG_WARNING << "instruction set '" << isa << "' is not supported, using the default";
+    kernels = findCpuDepthKernels(0);
+  }
+  LOG_INFO << "using " << kernels->isa << " kernels";
+
+  return *kernels;
+}
+
+} /* namespace libfreenect2 */
@@ -0,0 +1,60 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/**
+ * @file cpu_depth_kernels_avx2.cpp AVX2 instances of the SIMD row kernels.
+ *
+ * This file is compiled with AVX2 and FMA enabled, and only used after
+ * checking that the CPU supports them. It must not define anything that
+ * other files could link to instead of their own copy, see cpu_simd.h.
+ */
+
+#include <libfreenect2/cpu_depth_kernels_simd.h>
+
+#ifndef __AVX2__
+#error This file must be compiled with AVX2 enabled.
+#endif
+
+namespace libfreenect2
+{
+
+extern const CpuDepthKernels cpu_depth_kernels_avx2;
+
+const CpuDepthKernels cpu_depth_kernels_avx2 =
+{
+  "avx2",
+  &unpackRowSse2,
+  &processStage1RowSimd<F32x8>,
+  &processIrRowSimd<F32x8>,
+  &filterStage1RowSimd<F32x8>,
+  &processStage2RowSimd<F32x8>,
+  &processKdePhaseRowSimd<F32x8>,
+  &filterKdeRowSimd<F32x8>,
+  &mapDepthToColorSimd<F32x8, float>,
+  &mapDepthToColorSimd<F32x8, uint16_t>,
+};
+
+} /* namespace libfreenect2 */
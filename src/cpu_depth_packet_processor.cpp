@@ -30,8 +30,14 @@
 #include <libfreenect2/resource.h>
 #include <libfreenect2/protocol/response.h>
 #include <libfreenect2/logging.h>
+#include <libfreenect2/threading.h>
+#include <libfreenect2/cpu_depth_kernels.h>
 
 #include <fstream>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 
 #include <limits>
 
@@ -41,17 +47,6 @@
 #include <cmath>
 #include <limits>
 
-/**
- * Vector class.
- * @tparam ScalarT Type of the elements.
- * @tparam Size Number of elements in the vector.
- */
-template<typename ScalarT, int Size>
-struct Vec
-{
-  ScalarT val[Size];
-};
-
 /**
  * Matrix class.
  * @tparam ScalarT Eelement type of the matrix.
@@ -261,47 +256,552 @@ void flipHorizontal(const Mat<ScalarT> &in, Mat<ScalarT>& out)
 namespace libfreenect2
 {
 
+/**
+ * Fixed set of worker threads, running the CPU depth pipeline over horizontal
+ * bands of rows.
+ *
+ * The calling thread always works on the first band itself, so a pool of size
+ * 1 has no extra threads and runs everything serially.
+ */
+class CpuDepthWorkerPool
+{
+public:
+  /** Work on rows [y_begin, y_end) of band number \a band. */
+  typedef void (*BandFunction)(void *context, size_t band, int y_begin, int y_end);
+
+  CpuDepthWorkerPool() :
+    shutdown_(false),
+    generation_(0),
+    pending_(0),
+    function_(0),
+    context_(0),
+    row_begin_(0),
+    row_end_(0),
+    row_alignment_(1)
+  {
+  }
+
+  ~CpuDepthWorkerPool()
+  {
+    stopWorkers();
+  }
+
+  /** Number of bands a frame is split into, including the calling thread. */
+  size_t size() const
+  {
+    return workers_.size() + 1;
+  }
+
+  /**
+   * Restart with a different number of threads.
+   * Must not be called while run() is in progress.
+   * @param num_threads Total number of threads, including the calling thread.
+   */
+  void resize(size_t num_threads)
+  {
+    stopWorkers();
+
+    for(size_t i = 1; i < num_threads; ++i)
+    {
+      Worker *w = new Worker;
+      w->pool = this;
+      w->index = i;
+      w->generation = generation_;
+      w->thread = new libfreenect2::thread(&CpuDepthWorkerPool::static_execute, w);
+      workers_.push_back(w);
+    }
+  }
+
+  /**
+   * Run a function over all bands and wait for all of them to finish.
+   * @param function Function to run.
+   * @param context Argument passed to \a function.
+   * @param row_begin First row.
+   * @param row_end Row after the last one.
+   * @param row_alignment Bands other than the first start on a multiple of this row.
+   */
+  void run(BandFunction function, void *context, int row_begin, int row_end, int row_alignment = 1)
+  {
+    if(workers_.empty())
+    {
+      function(context, 0, row_begin, row_end);
+      return;
+    }
+
+    {
+      libfreenect2::lock_guard l(mutex_);
+      function_ = function;
+      context_ = context;
+      row_begin_ = row_begin;
+      row_end_ = row_end;
+      row_alignment_ = row_alignment;
+      pending_ = workers_.size();
+      ++generation_;
+    }
+    start_condition_.notify_all();
+
+    function(context, 0, bandBegin(0), bandBegin(1));
+
+    libfreenect2::unique_lock l(mutex_);
+    while(pending_ > 0)
+    {
+      WAIT_CONDITION(done_condition_, mutex_, l);
+    }
+  }
+
+private:
+  struct Worker
+  {
+    CpuDepthWorkerPool *pool;
+    size_t index;
+    unsigned int generation; ///< Last generation of work seen by this worker.
+    libfreenect2::thread *thread;
+  };
+
+  std::vector<Worker *> workers_;
+  bool shutdown_;
+  unsigned int generation_; ///< Incremented for each pass started by run().
+  size_t pending_;          ///< Number of workers still busy with the current pass.
+  BandFunction function_;
+  void *context_;
+  int row_begin_, row_end_; ///< Rows of the current pass.
+  int row_alignment_;
+
+  libfreenect2::mutex mutex_;
+  libfreenect2::condition_variable start_condition_;
+  libfreenect2::condition_variable done_condition_;
+
+  /** First row of band \a index out of size() bands. May be empty. */
+  int bandBegin(size_t index) const
+  {
+    const int row = row_begin_ + (int)((row_end_ - row_begin_) * index / size());
+    if(index == 0 || index >= size())
+      return row;
+    return std::max(row / row_alignment_ * row_alignment_, row_begin_);
+  }
+
+  void stopWorkers()
+  {
+    {
+      libfreenect2::lock_guard l(mutex_);
+      shutdown_ = true;
+    }
+    start_condition_.notify_all();
+
+    for(size_t i = 0; i < workers_.size(); ++i)
+    {
+      workers_[i]->thread->join();
+      delete workers_[i]->thread;
+      delete workers_[i];
+    }
+    workers_.clear();
+    shutdown_ = false;
+  }
+
+  static void static_execute(void *data)
+  {
+    Worker *w = static_cast<Worker *>(data);
+    w->pool->execute(*w);
+  }
+
+  void execute(Worker &w)
+  {
+    this_thread::set_name("CPU worker");
+    libfreenect2::unique_lock l(mutex_);
+
+    while(true)
+    {
+      while(!shutdown_ && w.generation == generation_)
+      {
+        WAIT_CONDITION(start_condition_, mutex_, l);
+      }
+
+      if(shutdown_)
+        break;
+
+      w.generation = generation_;
+      BandFunction function = function_;
+      void *context = context_;
+      int y_begin = bandBegin(w.index), y_end = bandBegin(w.index + 1);
+
+      mutex_.unlock();
+      function(context, w.index, y_begin, y_end);
+      mutex_.lock();
+
+      if(--pending_ == 0)
+        done_condition_.notify_one();
+    }
+  }
+};
+
+/**
+ * Single aligned allocation carved into image planes.
+ *
+ * The CPU depth pipeline allocates all its intermediate images once from an
+ * arena, instead of on every frame, to keep allocator traffic and page faults
+ * out of the per-frame path.
+ */
+class ScratchArena
+{
+public:
+  static const size_t alignment = 64;
+
+  ScratchArena() : rawdata_(0), data_(0), capacity_(0), used_(0) {}
+
+  ~ScratchArena()
+  {
+    delete[] rawdata_;
+  }
+
+  /** Number of arena bytes taken by an array of \a count elements of type \a T. */
+  template<typename T>
+  static size_t bytesFor(size_t count)
+  {
+    return (count * sizeof(T) + alignment - 1) & ~(alignment - 1);
+  }
+
+  /**
+   * Replace the arena with a new zero-filled one, invalidating all planes.
+   * @param capacity Size in bytes, see bytesFor().
+   */
+  void create(size_t capacity)
+  {
+    delete[] rawdata_;
+    // Value-initialize to touch every page now rather than in the first frame.
+    rawdata_ = new unsigned char[capacity + alignment]();
+    uintptr_t ptr = reinterpret_cast<uintptr_t>(rawdata_);
+    uintptr_t aligned = (ptr - 1u + alignment) & -alignment;
+    data_ = reinterpret_cast<unsigned char *>(aligned);
+    capacity_ = capacity;
+    used_ = 0;
+  }
+
+  /** Take an aligned array of \a count elements from the arena. */
+  template<typename T>
+  T *allocate(size_t count)
+  {
+    size_t bytes = bytesFor<T>(count);
+    if(used_ + bytes > capacity_)
+    {
+      LOG_ERROR << "scratch arena too small";
+      return 0;
+    }
+    T *result = reinterpret_cast<T *>(data_ + used_);
+    used_ += bytes;
+    return result;
+  }
+
+private:
+  unsigned char *rawdata_;
+  unsigned char *data_;
+  size_t capacity_;
+  size_t used_;
+
+  ScratchArena(const ScratchArena &);
+  ScratchArena &operator=(const ScratchArena &);
+};
+
 inline int bfi(int width, int offset, int src2, int src3)
 {
   int bitmask = (((1 << width)-1) << offset) & 0xffffffff;
   return ((src2 << offset) & bitmask) | (src3 & ~bitmask);
 }
 
+/** Partial DepthStatistics of the depth rows of one worker. */
+struct DepthStatisticsSum
+{
+  size_t valid_pixels;
+  double sum;
+  float min_depth, max_depth;
+  size_t histogram[DepthStatistics::HistogramBins];
+
+  void reset()
+  {
+    valid_pixels = 0;
+    sum = 0.0;
+    min_depth = std::numeric_limits<float>::infinity();
+    max_depth = 0.0f;
+    std::fill(histogram, histogram + DepthStatistics::HistogramBins, 0);
+  }
+
+  void add(const DepthStatisticsSum &other)
+  {
+    valid_pixels += other.valid_pixels;
+    sum += other.sum;
+    min_depth = std::min(min_depth, other.min_depth);
+    max_depth = std::max(max_depth, other.max_depth);
+    for(int i = 0; i < DepthStatistics::HistogramBins; ++i)
+      histogram[i] += other.histogram[i];
+  }
+};
+
+/**
+ * Rolling row buffers of one worker thread.
+ *
+ * Each worker runs all passes back-to-back on its band, one row at a time. A
+ * pass over row y reads rows y-1..y+1 of the previous pass, so the last few
+ * rows of each pass are kept in rings indexed by y % RING_SIZE. All buffers of
+ * a worker fit in L2 cache, instead of full-frame intermediates going through
+ * memory between passes.
+ */
+struct WorkerScratch
+{
+  static const int RING_SIZE = 4;
+
+  int16_t *raw[9]; ///< Unpacked measurements of the row going into stage 1.
+  Stage1Row unbinned[2]; ///< Stage 1 output of the two rows of a binned row.
+  Stage1Row stage1[RING_SIZE];
+  FilteredRow filtered;
+  Stage2Row stage2[RING_SIZE];
+  float *ir_row, *depth_row; ///< Output rows, before their conversion to UInt16 frames.
+  float *pyramid_row; ///< First depth row of a pair being downsampled.
+  DepthStatisticsSum statistics; ///< Statistics of the depth rows of the worker in the current frame.
+
+  /** Bytes of ScratchArena needed by one worker. */
+  static size_t arenaBytes()
+  {
+    return RING_SIZE * (12 * ScratchArena::bytesFor<float>(512) + ScratchArena::bytesFor<unsigned char>(512))
+        + 2 * 9 * ScratchArena::bytesFor<float>(512)
+        + 6 * ScratchArena::bytesFor<float>(512) + ScratchArena::bytesFor<unsigned char>(512)
+        + 3 * ScratchArena::bytesFor<float>(512)
+        + 9 * ScratchArena::bytesFor<int16_t>(512);
+  }
+
+  void allocate(ScratchArena &arena)
+  {
+    for(int i = 0; i < 9; ++i)
+    {
+      raw[i] = arena.allocate<int16_t>(512);
+    }
+    for(int r = 0; r < 2; ++r)
+    {
+      for(int i = 0; i < 3; ++i)
+      {
+        unbinned[r].a[i] = arena.allocate<float>(512);
+        unbinned[r].b[i] = arena.allocate<float>(512);
+        unbinned[r].amplitude[i] = arena.allocate<float>(512);
+      }
+    }
+    for(int r = 0; r < RING_SIZE; ++r)
+    {
+      for(int i = 0; i < 3; ++i)
+      {
+        stage1[r].a[i] = arena.allocate<float>(512);
+        stage1[r].b[i] = arena.allocate<float>(512);
+        stage1[r].amplitude[i] = arena.allocate<float>(512);
+      }
+      stage2[r].raw_depth = arena.allocate<float>(512);
+      stage2[r].edge_test_depth = arena.allocate<float>(512);
+      stage2[r].ir_sum = arena.allocate<float>(512);
+      stage2[r].max_edge_test = arena.allocate<unsigned char>(512);
+    }
+    ir_row = arena.allocate<float>(512);
+    depth_row = arena.allocate<float>(512);
+    pyramid_row = arena.allocate<float>(512);
+    for(int i = 0; i < 3; ++i)
+    {
+      filtered.a[i] = arena.allocate<float>(512);
+      filtered.b[i] = arena.allocate<float>(512);
+    }
+    filtered.max_edge_test = arena.allocate<unsigned char>(512);
+  }
+};
+
+/**
+ * Average 2x2 pixels of two rows of a stage 1 output plane, see
+ * Config::EnableDepthBinning.
+ * @param row0 First row.
+ * @param row1 Second row.
+ * @param x_begin First binned column.
+ * @param x_end Binned column after the last one.
+ * @param [out] out Binned row.
+ */
+static void binRows(const float *row0, const float *row1, int x_begin, int x_end, float *out)
+{
+  for(int x = x_begin; x < x_end; ++x)
+  {
+    out[x] = 0.25f * ((row0[2 * x] + row0[2 * x + 1]) + (row1[2 * x] + row1[2 * x + 1]));
+  }
+}
+
+/**
+ * Round a row of depth or IR to 16-bit integers, see Config::DepthFormat.
+ * Values above 65535 saturate, and 0 or invalid values become 0.
+ * @param in Float row.
+ * @param x_begin First column.
+ * @param x_end Column after the last one.
+ * @param [out] out UInt16 row.
+ */
+static void convertRowToUInt16(const float *in, int x_begin, int x_end, uint16_t *out)
+{
+  for(int x = x_begin; x < x_end; ++x)
+  {
+    const float v = in[x];
+    out[x] = v > 0.0f ? (uint16_t)(std::min(v, 65535.0f) + 0.5f) : 0;
+  }
+}
+
+/**
+ * Pixels of a 2x2 block further than this fraction of the depth of the
+ * nearest pixel are left out of the downsampled depth, see Frame::DepthHalf,
+ * so that it does not mix depths across edges.
+ */
+static const float PYRAMID_MAX_DEPTH_RATIO = 0.03f;
+
+/**
+ * Downsample two depth rows by 2, see Frame::DepthHalf.
+ * @param row0 First row, or NULL if it is invalid.
+ * @param row1 Second row.
+ * @param x_begin First valid column.
+ * @param x_end Column after the last valid one.
+ * @param [out] out Columns [x_begin / 2, (x_end + 1) / 2) of the downsampled row.
+ */
+static void downsampleDepthRows(const float *row0, const float *row1, int x_begin, int x_end, float *out)
+{
+  for(int x = x_begin / 2; x < (x_end + 1) / 2; ++x)
+  {
+    float depth[4];
+    int n = 0;
+    for(int c = std::max(2 * x, x_begin); c < std::min(2 * x + 2, x_end); ++c)
+    {
+      if(row0 != 0 && row0[c] > 0.0f)
+        depth[n++] = row0[c];
+      if(row1[c] > 0.0f)
+        depth[n++] = row1[c];
+    }
+
+    float nearest = std::numeric_limits<float>::infinity();
+    for(int i = 0; i < n; ++i)
+    {
+      nearest = std::min(nearest, depth[i]);
+    }
+
+    float sum = 0.0f;
+    int count = 0;
+    for(int i = 0; i < n; ++i)
+    {
+      if(depth[i] - nearest <= PYRAMID_MAX_DEPTH_RATIO * nearest)
+      {
+        sum += depth[i];
+        ++count;
+      }
+    }
+    out[x] = count > 0 ? sum / count : 0.0f;
+  }
+}
+
+/** Largest window of the temporal filter, see Config::TemporalFilterWindow. */
+static const int MAX_TEMPORAL_WINDOW = 16;
+
 class CpuDepthPacketProcessorImpl: public WithPerfLogging
 {
 public:
+  /**
+   * Phase offset of each pixel, per frequency. Stage 1 computes its sine and
+   * cosine on the fly: trigonometry tables would be 12 times as large.
+   */
   Mat<uint16_t> p0_table0, p0_table1, p0_table2;
   Mat<float> x_table, z_table;
+  Mat<float> x_table_binned, z_table_binned; ///< x/z tables of 2x2 binned pixels.
 
   int16_t lut11to16[2048];
 
-  float trig_table0[512*424][6];
-  float trig_table1[512*424][6];
-  float trig_table2[512*424][6];
+  bool binning; ///< Whether stage 1 output is 2x2 binned, see Config::EnableDepthBinning.
+  int width, height; ///< Size of the output frames, and of everything after stage 1.
+  bool uint16_output; ///< Whether the frames are UInt16 instead of Float, see Config::DepthFormat.
 
   bool enable_bilateral_filter, enable_edge_filter;
+  CpuDepthWorkerPool::BandFunction process_band; ///< processBand() specialized for the filters enabled.
   DepthPacketProcessor::Parameters params;
 
-  Frame *ir_frame, *depth_frame;
+  /**
+   * Region of interest, and the columns each pass computes so that the
+   * filters have their input. Rows are in processing order, upside down
+   * relative to the frames. See setRoi().
+   */
+  int roi_y_begin, roi_y_end, roi_x_begin, roi_x_end;
+  int band_y_begin, band_y_end; ///< Rows of the first pass, with the halo of the KDE.
+  int stage1_x_begin, stage1_x_end;
+  int stage2_x_begin, stage2_x_end;
+  int aligned_x_begin, aligned_x_end; ///< Region of interest rounded out to CPU_DEPTH_COLUMN_ALIGNMENT.
+  DepthRoi output_roi; ///< Region of interest, in pixels of the output frames.
+
+  Frame *ir_frame, *depth_frame, *confidence_frame, *dealiasing_frame;
+  Frame *half_frame, *quarter_frame; ///< Depth pyramid levels, see Frame::DepthHalf.
 
   bool flip_ptables;
 
-  CpuDepthPacketProcessorImpl()
+  const CpuDepthKernels *kernels; ///< Instruction set specific row kernels.
+
+  CpuDepthWorkerPool workers;
+
+  std::vector<WorkerScratch> scratch; ///< Row buffers of each worker.
+  ScratchArena arena;
+
+  unsigned char *data; ///< Packet being processed.
+  unsigned char *ir_out, *depth_out; ///< Frame data being written.
+  float *confidence_out; ///< Confidence frame data being written, or NULL.
+  float *dealiasing_out; ///< Dealiasing confidence frame data being written, or NULL.
+  float *half_out, *quarter_out; ///< Depth pyramid frame data being written, or NULL.
+  DepthStatistics *statistics_out; ///< Statistics of the depth frame being written, or NULL.
+  bool enable_statistics; ///< See Config::EnableDepthStatistics.
+
+  bool kde; ///< Whether to unwrap the phase with kernel density estimation, see CpuKdeDepthPacketProcessor.
+  KdePlanes kde_planes; ///< Phase hypotheses of the whole frame, written by the first pass.
+  std::vector<float> kde_gauss; ///< Spatial weights of the KDE.
+  ScratchArena kde_arena;
+
+  /**
+   * Temporal filter state. The depths of the last #temporal_window frames
+   * are kept in a ring of planes, in processing row order; the plane of the
+   * current frame is #temporal_slot.
+   */
+  int temporal_window; ///< Number of frames of the temporal filter, or 0 if it is disabled.
+  float temporal_reset_distance; ///< Depth change restarting the history of a pixel, in millimeters.
+  int temporal_slot;
+  std::vector<float> temporal_history;
+  std::vector<unsigned char> temporal_count; ///< Number of frames in the history of each pixel.
+
+  DepthQualityController quality; ///< See Config::EnableAdaptiveDepthQuality.
+
+  CpuDepthPacketProcessorImpl(bool kde) : kde(kde)
   {
+    binning = false;
+    width = 512;
+    height = 424;
+    uint16_output = false;
     newIrFrame();
     newDepthFrame();
+    newConfidenceFrame();
+    newDealiasingFrame();
+    newHalfFrame();
+    newQuarterFrame();
 
     enable_bilateral_filter = true;
-    enable_edge_filter = true;
+    enable_edge_filter = !kde;
+    selectProcessBand();
+    setRoi(DepthRoi());
 
     flip_ptables = true;
+
+    kernels = &selectCpuDepthKernels();
+    setNumThreads(0);
+
+    if(kde)
+      allocateKdePlanes();
+
+    temporal_window = 0;
+    temporal_reset_distance = 0.0f;
+    temporal_slot = 0;
+
+    enable_statistics = false;
   }
 
   /** Allocate a new IR frame. */
   void newIrFrame()
   {
-    ir_frame = new Frame(512, 424, 4);
-    ir_frame->format = Frame::Float;
+    ir_frame = new Frame(width, height, uint16_output ? 2 : 4);
+    ir_frame->format = uint16_output ? Frame::UInt16 : Frame::Float;
     //ir_frame = new Frame(512, 424, 12);
   }
 
@@ -309,502 +809,702 @@ public:
   {
     delete ir_frame;
     delete depth_frame;
+    delete confidence_frame;
+    delete dealiasing_frame;
+    delete half_frame;
+    delete quarter_frame;
   }
 
   /** Allocate a new depth frame. */
   void newDepthFrame()
   {
-    depth_frame = new Frame(512, 424, 4);
-    depth_frame->format = Frame::Float;
+    depth_frame = new Frame(width, height, uint16_output ? 2 : 4);
+    depth_frame->format = uint16_output ? Frame::UInt16 : Frame::Float;
   }
 
-  int32_t decodePixelMeasurement(unsigned char* data, int sub, int x, int y)
+  /** Allocate a new confidence frame. It is Float whatever the depth format. */
+  void newConfidenceFrame()
   {
-    if (x < 1 || y < 0 || 510 < x || 423 < y)
-    {
-      return lut11to16[0];
-    }
+    confidence_frame = new Frame(width, height, 4);
+    confidence_frame->format = Frame::Float;
+  }
 
-    int r1zi = (x >> 2) + ((x & 0x3) << 7); // Range 1..510
-    r1zi = r1zi * 11L; // Range 11..5610
+  /** Allocate a new dealiasing confidence frame. */
+  void newDealiasingFrame()
+  {
+    dealiasing_frame = new Frame(width, height, 4);
+    dealiasing_frame->format = Frame::Float;
+  }
 
-    // 298496 = 512 * 424 * 11 / 8 = number of bytes per sub image
-    uint16_t *ptr = reinterpret_cast<uint16_t *>(data + 298496 * sub);
-    int i = y < 212 ? y + 212 : 423 - y;
-    ptr += 352*i;
+  /** Allocate a new 2x downsampled depth frame. */
+  void newHalfFrame()
+  {
+    half_frame = new Frame(width / 2, height / 2, 4);
+    half_frame->format = Frame::Float;
+  }
 
-    int r1yi = r1zi >> 4; // Range 0..350
-    r1zi = r1zi & 15;
+  /** Allocate a new 4x downsampled depth frame. */
+  void newQuarterFrame()
+  {
+    quarter_frame = new Frame(width / 4, height / 4, 4);
+    quarter_frame->format = Frame::Float;
+  }
 
-    int i1 = ptr[r1yi];
-    int i2 = ptr[r1yi + 1];
-    i1 = i1 >> r1zi;
-    i2 = i2 << (16 - r1zi);
+  /** Switch between full resolution and 2x2 binned frames, and between Float and UInt16 frames. */
+  void setFrameLayout(bool enable_binning, bool enable_uint16_output)
+  {
+    binning = enable_binning;
+    uint16_output = enable_uint16_output;
+    width = binning ? 256 : 512;
+    height = binning ? 212 : 424;
 
-    return lut11to16[((i1 | i2) & 2047)];
+    delete ir_frame;
+    delete depth_frame;
+    delete confidence_frame;
+    delete dealiasing_frame;
+    delete half_frame;
+    delete quarter_frame;
+    newIrFrame();
+    newDepthFrame();
+    newConfidenceFrame();
+    newDealiasingFrame();
+    newHalfFrame();
+    newQuarterFrame();
   }
 
-  /**
-   * Initialize cos and sin trigonometry tables for each of the three #phase_in_rad parameters.
-   * @param p0table Angle at every (x, y) position.
-   * @param [out] trig_tables (3 cos tables, followed by 3 sin tables for the three phases.
-   */
-  void fillTrigTable(Mat<uint16_t> &p0table, float trig_table[512*424][6])
+  /** Allocate the hypothesis planes, with a zero border wide enough for the KDE neighbourhood. */
+  void allocateKdePlanes()
   {
-    int i = 0;
+    const int size = (int)params.kde_neigborhood_size;
+    const size_t plane_size = (size_t)(512 + 2 * size) * (424 + 2 * size);
 
-    for(int y = 0; y < 424; ++y)
-      for(int x = 0; x < 512; ++x, ++i)
-      {
-        float p0 = -((float)p0table.at(y, x)) * 0.000031 * M_PI;
-
-        float tmp0 = p0 + params.phase_in_rad[0];
-        float tmp1 = p0 + params.phase_in_rad[1];
-        float tmp2 = p0 + params.phase_in_rad[2];
+    kde_arena.create(2 * params.num_hyps * ScratchArena::bytesFor<float>(plane_size));
+    kde_planes.stride = 512 + 2 * size;
+    for(size_t j = 0; j < 3; ++j)
+    {
+      const bool used = j < params.num_hyps;
+      kde_planes.phase[j] = used ? kde_arena.allocate<float>(plane_size) + size * kde_planes.stride + size : 0;
+      kde_planes.conf[j] = used ? kde_arena.allocate<float>(plane_size) + size * kde_planes.stride + size : 0;
+    }
 
-        trig_table[i][0] = std::cos(tmp0);
-        trig_table[i][1] = std::cos(tmp1);
-        trig_table[i][2] = std::cos(tmp2);
+    // Gaussian with a standard deviation of half the neighbourhood size.
+    const float sigma = 0.5f * size;
+    kde_gauss.resize(2 * size + 1);
+    for(int i = -size; i <= size; ++i)
+      kde_gauss[i + size] = std::exp(-0.5f * i * i / (sigma * sigma));
+  }
 
-        trig_table[i][3] = std::sin(-tmp0);
-        trig_table[i][4] = std::sin(-tmp1);
-        trig_table[i][5] = std::sin(-tmp2);
-      }
+  /**
+   * Filter a pixel of the image border in stage 2: only the depth range applies.
+   * @param x Horizontal position.
+   * @param m Stage 2 output of the row.
+   * @param [out] depth_out Filtered depth.
+   */
+  void filterBorderPixelStage2(int x, const Stage2Row &m, float *depth_out)
+  {
+    float raw_depth = m.raw_depth[x];
+    *depth_out = raw_depth >= params.min_depth && raw_depth <= params.max_depth ? raw_depth : 0.0f;
   }
 
   /**
-   * Process measurement (all three layers).
-   * @param [in] trig_table Trigonometry tables.
-   * @param abMultiplierPerFrq Multiplier.
-   * @param x X position in the image.
-   * @param y Y position in the image.
-   * @param m Measurement.
-   * @param [out] m_out Processed measurement (IR a, IR b, IR amplitude).
+   * Filter pixels in stage 2, except on the image border.
+   * @param x Horizontal position.
+   * @param m Stage 2 output of rows y-1, y and y+1.
+   * @param [out] depth_out Filtered depth.
    */
-  void processMeasurementTriple(float trig_table[512*424][6], float abMultiplierPerFrq, int x, int y, const int32_t* m, float* m_out)
+  void filterPixelStage2(int x, const Stage2Row *m[3], float *depth_out)
   {
-    float zmultiplier = z_table.at(y, x);
-    if (0 < zmultiplier)
+    float raw_depth = m[1]->raw_depth[x], ir_sum = m[1]->ir_sum[x];
+    bool max_edge_test_ok = m[1]->max_edge_test[x] == 1;
+
+    if(raw_depth >= params.min_depth && raw_depth <= params.max_depth)
     {
-      bool saturated = (m[0] == 32767 || m[1] == 32767 || m[2] == 32767);
-      if (!saturated)
+      float ir_sum_acc = ir_sum, squared_ir_sum_acc = ir_sum * ir_sum, min_depth = raw_depth, max_depth = raw_depth;
+
+      for(int yi = -1; yi < 2; ++yi)
       {
-        int offset = y * 512 + x;
-        float cos_tmp0 = trig_table[offset][0];
-        float cos_tmp1 = trig_table[offset][1];
-        float cos_tmp2 = trig_table[offset][2];
+        for(int xi = -1; xi < 2; ++xi)
+        {
+          if(yi == 0 && xi == 0) continue;
 
-        float sin_negtmp0 = trig_table[offset][3];
-        float sin_negtmp1 = trig_table[offset][4];
-        float sin_negtmp2 = trig_table[offset][5];
+          float other_ir_sum = m[yi + 1]->ir_sum[x + xi], other_depth = m[yi + 1]->edge_test_depth[x + xi];
 
-        // formula given in Patent US 8,587,771 B2
-        float ir_image_a = cos_tmp0 * m[0] + cos_tmp1 * m[1] + cos_tmp2 * m[2];
-        float ir_image_b = sin_negtmp0 * m[0] + sin_negtmp1 * m[1] + sin_negtmp2 * m[2];
+          ir_sum_acc += other_ir_sum;
+          squared_ir_sum_acc += other_ir_sum * other_ir_sum;
 
-        // only if modeMask & 32 != 0;
-        if(true)//(modeMask & 32) != 0)
-        {
-            ir_image_a *= abMultiplierPerFrq;
-            ir_image_b *= abMultiplierPerFrq;
+          if(0.0f < other_depth)
+          {
+            min_depth = std::min(min_depth, other_depth);
+            max_depth = std::max(max_depth, other_depth);
+          }
         }
-        float ir_amplitude = std::sqrt(ir_image_a * ir_image_a + ir_image_b * ir_image_b) * params.ab_multiplier;
-
-        m_out[0] = ir_image_a;
-        m_out[1] = ir_image_b;
-        m_out[2] = ir_amplitude;
       }
-      else
+
+      float tmp0 = std::sqrt(squared_ir_sum_acc * 9.0f - ir_sum_acc * ir_sum_acc) / 9.0f;
+      float edge_avg = std::max(ir_sum_acc / 9.0f, params.edge_ab_avg_min_value);
+      tmp0 /= edge_avg;
+
+      float abs_min_diff = std::abs(raw_depth - min_depth);
+      float abs_max_diff = std::abs(raw_depth - max_depth);
+
+      float avg_diff = (abs_min_diff + abs_max_diff) * 0.5f;
+      float max_abs_diff = std::max(abs_min_diff, abs_max_diff);
+
+      bool cond0 =
+          0.0f < raw_depth &&
+          tmp0 >= params.edge_ab_std_dev_threshold &&
+          params.edge_close_delta_threshold < abs_min_diff &&
+          params.edge_far_delta_threshold < abs_max_diff &&
+          params.edge_max_delta_threshold < max_abs_diff &&
+          params.edge_avg_delta_threshold < avg_diff;
+
+      *depth_out = cond0 ? 0.0f : raw_depth;
+
+      if(!cond0)
       {
-        // Saturated pixel.
-        m_out[0] = 0;
-        m_out[1] = 0;
-        m_out[2] = 65535.0;
+        if(max_edge_test_ok)
+        {
+          //float tmp1 = 1500.0f > raw_depth ? 30.0f : 0.02f * raw_depth;
+          float edge_count = 0.0f;
+
+          *depth_out = edge_count > params.max_edge_count ? 0.0f : raw_depth;
+        }
+        else
+        {
+          *depth_out = !max_edge_test_ok ? 0.0f : raw_depth;
+          *depth_out = true ? *depth_out : raw_depth;
+        }
       }
     }
     else
     {
-      // Invalid pixel.
-      m_out[0] = 0;
-      m_out[1] = 0;
-      m_out[2] = 0;
+      *depth_out = 0.0f;
     }
   }
 
   /**
-   * Transform measurement.
-   * @param [in, out] m Measurement.
+   * Where to write row @p y of an output frame: the frame itself if it is
+   * Float, or else @p scratch_row, which storeRow() then converts.
    */
-  void transformMeasurements(float* m)
+  float *outputRow(unsigned char *frame_data, float *scratch_row, int y) const
   {
-    float tmp0 = std::atan2((m[1]), (m[0]));
-    tmp0 = tmp0 < 0 ? tmp0 + M_PI * 2.0f : tmp0;
-    tmp0 = (tmp0 != tmp0) ? 0 : tmp0;
-
-    float tmp1 = std::sqrt(m[0] * m[0] + m[1] * m[1]) * params.ab_multiplier;
-
-    m[0] = tmp0; // phase
-    m[1] = tmp1; // ir amplitude - (possibly bilateral filtered)
+    if(uint16_output)
+      return scratch_row;
+    return reinterpret_cast<float *>(frame_data) + (height - 1 - y) * width;
   }
 
-  /**
-   * Process first pixel stage.
-   * @param x Horizontal position.
-   * @param y Vertical position.
-   * @param data
-   * @param [out] m0_out First layer output.
-   * @param [out] m1_out Second layer output.
-   * @param [out] m2_out Third layer output.
-   */
-  void processPixelStage1(int x, int y, unsigned char* data, float *m0_out, float *m1_out, float *m2_out)
+  /** Convert the region of interest of an outputRow() into a UInt16 frame. */
+  void storeRow(unsigned char *frame_data, const float *row, int y) const
   {
-    int32_t m0_raw[3], m1_raw[3], m2_raw[3];
-
-    m0_raw[0] = decodePixelMeasurement(data, 0, x, y);
-    m0_raw[1] = decodePixelMeasurement(data, 1, x, y);
-    m0_raw[2] = decodePixelMeasurement(data, 2, x, y);
-    m1_raw[0] = decodePixelMeasurement(data, 3, x, y);
-    m1_raw[1] = decodePixelMeasurement(data, 4, x, y);
-    m1_raw[2] = decodePixelMeasurement(data, 5, x, y);
-    m2_raw[0] = decodePixelMeasurement(data, 6, x, y);
-    m2_raw[1] = decodePixelMeasurement(data, 7, x, y);
-    m2_raw[2] = decodePixelMeasurement(data, 8, x, y);
-
-    processMeasurementTriple(trig_table0, params.ab_multiplier_per_frq[0], x, y, m0_raw, m0_out);
-    processMeasurementTriple(trig_table1, params.ab_multiplier_per_frq[1], x, y, m1_raw, m1_out);
-    processMeasurementTriple(trig_table2, params.ab_multiplier_per_frq[2], x, y, m2_raw, m2_out);
+    if(uint16_output)
+      convertRowToUInt16(row, roi_x_begin, roi_x_end, reinterpret_cast<uint16_t *>(frame_data) + (height - 1 - y) * width);
   }
 
   /**
-   * Filter pixels in stage 1.
-   * @param x Horizontal position.
-   * @param y Vertical position.
-   * @param m Input data?
-   * @param [out] Output data.
-   * @param [out] bilateral_max_edge_test Whether the accumulated distance of each image stayed within limits.
+   * Temporal filter of the region of interest of depth row @p y, see
+   * Config::TemporalFilterWindow.
    */
-  void filterPixelStage1(int x, int y, const Mat<Vec<float, 9> >& m, float* m_out, bool& bilateral_max_edge_test)
+  void filterTemporalRow(int y, float *depth_row)
   {
-    const float *m_ptr = (m.ptr(y, x)->val);
-    bilateral_max_edge_test = true;
+    const size_t plane = (size_t)width * height, offset = (size_t)y * width;
+    unsigned char *count = &temporal_count[offset];
+    float *current = &temporal_history[temporal_slot * plane + offset];
 
-    if(x < 1 || y < 1 || x > 510 || y > 422)
+    // Row of the frame i frames ago, for each i in the window.
+    const float *history[MAX_TEMPORAL_WINDOW];
+    for(int i = 0; i < temporal_window; ++i)
     {
-      for(int i = 0; i < 9; ++i)
-        m_out[i] = m_ptr[i];
+      history[i] = &temporal_history[((temporal_slot + temporal_window - i) % temporal_window) * plane + offset];
     }
-    else
-    {
-      float m_normalized[2];
-      float other_m_normalized[2];
 
-      int offset = 0;
+    for(int x = roi_x_begin; x < roi_x_end; ++x)
+    {
+      const float depth = depth_row[x];
+      current[x] = depth;
 
-      for(int i = 0; i < 3; ++i, m_ptr += 3, m_out += 3, offset += 3)
+      if(!(depth > 0.0f))
       {
-        float norm2 = m_ptr[0] * m_ptr[0] + m_ptr[1] * m_ptr[1];
-        float inv_norm = 1.0f / std::sqrt(norm2);
-        inv_norm = (inv_norm == inv_norm) ? inv_norm : std::numeric_limits<float>::infinity();
+        count[x] = 0;
+        continue;
+      }
+      if(count[x] > 0 && std::abs(depth - history[1][x]) > temporal_reset_distance)
+      {
+        count[x] = 0;
+      }
+      const int n = count[x] = (unsigned char)std::min(count[x] + 1, temporal_window);
+      if(n == 1)
+        continue;
 
-        m_normalized[0] = m_ptr[0] * inv_norm;
-        m_normalized[1] = m_ptr[1] * inv_norm;
+      float values[MAX_TEMPORAL_WINDOW];
+      for(int i = 0; i < n; ++i)
+      {
+        values[i] = history[i][x];
+      }
+      const int mid = n / 2;
+      std::nth_element(values, values + mid, values + n);
+      depth_row[x] = n % 2 == 1 ? values[mid] : 0.5f * (values[mid] + *std::max_element(values, values + mid));
+    }
+  }
 
-        int j = 0;
+  /**
+   * Depth pyramid levels from depth row @p y, see Frame::DepthHalf.
+   *
+   * Each pair of rows is downsampled when its second row is finished, and
+   * each pair of half rows when the second one is. The bands of the pass are
+   * aligned to 4 rows so that all rows of a 4x4 block are in the same band;
+   * rows outside the region of interest are invalid.
+   */
+  void downsampleDepthRow(WorkerScratch &w, const float *depth_row, int y)
+  {
+    if(y != std::min(y | 1, roi_y_end - 1))
+    {
+      std::copy(depth_row + roi_x_begin, depth_row + roi_x_end, w.pyramid_row + roi_x_begin);
+      return;
+    }
 
-        float weight_acc = 0.0f;
-        float weighted_m_acc[2] = {0.0f, 0.0f};
+    const int half_y = y / 2, half_width = width / 2, half_height = height / 2;
+    const float *first_row = (y & 1) != 0 && y - 1 >= roi_y_begin ? w.pyramid_row : 0;
+    float *half_row = half_out + (half_height - 1 - half_y) * half_width;
+    downsampleDepthRows(first_row, depth_row, roi_x_begin, roi_x_end, half_row);
 
-        float threshold = (params.joint_bilateral_ab_threshold * params.joint_bilateral_ab_threshold) / (params.ab_multiplier * params.ab_multiplier);
-        float joint_bilateral_exp = params.joint_bilateral_exp;
+    const int half_y_begin = roi_y_begin / 2, half_y_end = (roi_y_end + 1) / 2;
+    if(quarter_out == 0 || half_y != std::min(half_y | 1, half_y_end - 1))
+      return;
 
-        if(norm2 < threshold)
-        {
-          threshold = 0.0f;
-          joint_bilateral_exp = 0.0f;
-        }
+    const float *first_half_row = (half_y & 1) != 0 && half_y - 1 >= half_y_begin ? half_row + half_width : 0;
+    float *quarter_row = quarter_out + (height / 4 - 1 - half_y / 2) * (width / 4);
+    downsampleDepthRows(first_half_row, half_row, roi_x_begin / 2, (roi_x_end + 1) / 2, quarter_row);
+  }
 
-        float dist_acc = 0.0f;
+  /**
+   * Add a depth row to the statistics of its worker. The row is summed in
+   * locals first, so that workers do not write the cache lines of their
+   * neighbours' statistics for every pixel.
+   */
+  void accumulateDepthStatistics(WorkerScratch &w, const float *depth_row)
+  {
+    const int bins = DepthStatistics::HistogramBins;
+    const float bin_scale = bins / (statistics_out->histogram_max - statistics_out->histogram_min);
+    DepthStatisticsSum row;
+    row.reset();
 
-        for(int yi = -1; yi < 2; ++yi)
-        {
-          for(int xi = -1; xi < 2; ++xi, ++j)
-          {
-            if(yi == 0 && xi == 0)
-            {
-              weight_acc += params.gaussian_kernel[j];
+    for(int x = roi_x_begin; x < roi_x_end; ++x)
+    {
+      const float d = depth_row[x];
+      // Also false for NaN.
+      if(!(d > 0.0f && d < std::numeric_limits<float>::infinity()))
+        continue;
+
+      ++row.valid_pixels;
+      row.sum += d;
+      row.min_depth = std::min(row.min_depth, d);
+      row.max_depth = std::max(row.max_depth, d);
+      const float bin = (d - statistics_out->histogram_min) * bin_scale;
+      ++row.histogram[!(bin > 0.0f) ? 0 : std::min((int)bin, bins - 1)];
+    }
+    w.statistics.add(row);
+  }
 
-              weighted_m_acc[0] += params.gaussian_kernel[j] * m_ptr[0];
-              weighted_m_acc[1] += params.gaussian_kernel[j] * m_ptr[1];
-              continue;
-            }
+  /** Finish depth row @p y from outputRow(): temporal filter, pyramid, statistics, and storeRow(). */
+  void storeDepthRow(WorkerScratch &w, float *depth_row, int y)
+  {
+    if(temporal_window > 1)
+      filterTemporalRow(y, depth_row);
+    if(half_out != 0)
+      downsampleDepthRow(w, depth_row, y);
+    if(statistics_out != 0)
+      accumulateDepthStatistics(w, depth_row);
+    storeRow(depth_out, depth_row, y);
+  }
 
-            const float *other_m_ptr = (m.ptr(y + yi, x + xi)->val) + offset;
-            float other_norm2 = other_m_ptr[0] * other_m_ptr[0] + other_m_ptr[1] * other_m_ptr[1];
-            // TODO: maybe fix numeric problems when norm = 0 - original code uses reciprocal square root, which returns +inf for +0
-            float other_inv_norm = 1.0f / std::sqrt(other_norm2);
-            other_inv_norm = (other_inv_norm == other_inv_norm) ? other_inv_norm : std::numeric_limits<float>::infinity();
+  /** Start the statistics of the depth frame, or clear them if @p enable is false. */
+  void beginDepthStatistics(bool enable)
+  {
+    depth_frame->depth_statistics = DepthStatistics();
+    statistics_out = enable ? &depth_frame->depth_statistics : 0;
+    if(!enable)
+      return;
+
+    statistics_out->histogram_min = params.min_depth;
+    statistics_out->histogram_max = params.max_depth;
+    for(size_t i = 0; i < scratch.size(); ++i)
+      scratch[i].statistics.reset();
+  }
 
-            other_m_normalized[0] = other_m_ptr[0] * other_inv_norm;
-            other_m_normalized[1] = other_m_ptr[1] * other_inv_norm;
+  /** Merge the statistics of the workers into the depth frame. */
+  void endDepthStatistics()
+  {
+    if(statistics_out == 0)
+      return;
 
-            float dist = -(other_m_normalized[0] * m_normalized[0] + other_m_normalized[1] * m_normalized[1]);
-            dist += 1.0f;
-            dist *= 0.5f;
+    DepthStatisticsSum total;
+    total.reset();
+    for(size_t i = 0; i < scratch.size(); ++i)
+      total.add(scratch[i].statistics);
 
-            float weight = 0.0f;
+    statistics_out->valid_pixels = total.valid_pixels;
+    if(total.valid_pixels > 0)
+    {
+      statistics_out->min_depth = total.min_depth;
+      statistics_out->max_depth = total.max_depth;
+      statistics_out->mean_depth = (float)(total.sum / total.valid_pixels);
+    }
+    std::copy(total.histogram, total.histogram + DepthStatistics::HistogramBins, statistics_out->histogram);
+  }
 
-            if(other_norm2 >= threshold)
-            {
-              weight = (params.gaussian_kernel[j] * std::exp(-1.442695f * joint_bilateral_exp * dist));
-              dist_acc += dist;
-            }
+  /** Number of frames of the temporal filter for Config::TemporalFilterWindow @p window, or 0 if it is disabled. */
+  static int temporalWindow(int window)
+  {
+    return window > 1 ? std::min(window, MAX_TEMPORAL_WINDOW) : 0;
+  }
 
-            weighted_m_acc[0] += weight * other_m_ptr[0];
-            weighted_m_acc[1] += weight * other_m_ptr[1];
+  /** Whether the temporal filter is set up with @p window and @p reset_distance, see setTemporalFilter(). */
+  bool hasTemporalFilter(int window, float reset_distance) const
+  {
+    return temporal_window == temporalWindow(window) && temporal_reset_distance == reset_distance;
+  }
 
-            weight_acc += weight;
-          }
-        }
+  /** Set up the temporal filter, and forget the history. */
+  void setTemporalFilter(int window, float reset_distance)
+  {
+    temporal_window = temporalWindow(window);
+    temporal_reset_distance = reset_distance;
+    temporal_slot = 0;
 
-        bilateral_max_edge_test = bilateral_max_edge_test && dist_acc < params.joint_bilateral_max_edge;
+    const size_t plane = (size_t)width * height;
+    std::vector<float>(temporal_window * plane).swap(temporal_history);
+    std::vector<unsigned char>(temporal_window > 0 ? plane : 0).swap(temporal_count);
+  }
 
-        m_out[0] = 0.0f < weight_acc ? weighted_m_acc[0] / weight_acc : 0.0f;
-        m_out[1] = 0.0f < weight_acc ? weighted_m_acc[1] / weight_acc : 0.0f;
-        m_out[2] = m_ptr[2];
-      }
+  /** Stage 1 of columns [x_begin, x_end) of sensor row @p y. */
+  void processSensorRow(int y, int16_t * const raw[9], int x_begin, int x_end, const Stage1Row &out)
+  {
+    for(int sub = 0; sub < 9; ++sub)
+    {
+      kernels->unpackRow(data, sub, y, lut11to16, x_begin, x_end, raw[sub]);
     }
+
+    const uint16_t *p0_row[3] = {p0_table0.ptr(y, 0), p0_table1.ptr(y, 0), p0_table2.ptr(y, 0)};
+    kernels->processStage1Row(params, raw, p0_row, z_table.ptr(y, 0), x_begin, x_end, out);
   }
 
-  void processPixelStage2(int x, int y, float *m0, float *m1, float *m2, float *ir_out, float *depth_out, float *ir_sum_out)
+  /**
+   * Stage 1 of columns [x_begin, x_end) of row @p y, binning two sensor rows
+   * into it when binning is enabled.
+   */
+  void processStage1Row(int y, WorkerScratch &w, int x_begin, int x_end, const Stage1Row &out)
   {
-    //// 10th measurement
-    //float m9 = 1; // decodePixelMeasurement(data, 9, x, y);
-    //
-    //// WTF?
-    //bool cond0 = zmultiplier == 0 || (m9 >= 0 && m9 < 32767);
-    //m9 = std::max(-m9, m9);
-    //// if m9 is positive or pixel is invalid (zmultiplier) we set it to 0 otherwise to its absolute value O.o
-    //m9 = cond0 ? 0 : m9;
+    if(!binning)
+    {
+      processSensorRow(y, w.raw, x_begin, x_end, out);
+      return;
+    }
 
-    transformMeasurements(m0);
-    transformMeasurements(m1);
-    transformMeasurements(m2);
+    for(int r = 0; r < 2; ++r)
+    {
+      processSensorRow(2 * y + r, w.raw, 2 * x_begin, 2 * x_end, w.unbinned[r]);
+    }
+    for(int i = 0; i < 3; ++i)
+    {
+      binRows(w.unbinned[0].a[i], w.unbinned[1].a[i], x_begin, x_end, out.a[i]);
+      binRows(w.unbinned[0].b[i], w.unbinned[1].b[i], x_begin, x_end, out.b[i]);
+      binRows(w.unbinned[0].amplitude[i], w.unbinned[1].amplitude[i], x_begin, x_end, out.amplitude[i]);
+    }
+  }
 
-    float ir_sum = m0[1] + m1[1] + m2[1];
+  /**
+   * @tparam EdgeFilter Whether the edge filter is enabled.
+   * @param y Row.
+   * @param in Stage 1 or bilateral filter output.
+   * @param amplitude_in Stage 1 output.
+   * @param out Output row if the edge filter is enabled.
+   * @param ir_out_row IR output row, or NULL if it is written by another band.
+   * @param depth_out_row Depth output row if neither the edge filter nor the KDE is enabled.
+   * @param confidence_out_row Confidence output row, or NULL. Not written by the KDE.
+   * @param dealiasing_out_row Dealiasing confidence output row, or NULL. Not written by the KDE.
+   */
+  template<bool EdgeFilter>
+  void processStage2Row(int y, const FilteredRow &in, const Stage1Row &amplitude_in, const Stage2Row &out, float *ir_out_row, float *depth_out_row,
+      float *confidence_out_row, float *dealiasing_out_row)
+  {
+    const Mat<float> &x_table_stage2 = binning ? x_table_binned : x_table, &z_table_stage2 = binning ? z_table_binned : z_table;
+    const float *x_table_row = x_table_stage2.ptr(y, 0), *z_table_row = z_table_stage2.ptr(y, 0);
 
-    float phase;
-    // if(DISABLE_DISAMBIGUATION)
-    if(false)
+    if(kde)
     {
-#if 0
-        //r0.yz = r3.zx + r4.zx // add
-        //r0.yz = r5.xz + r0.zy // add
-        float phase = m0[0] + m1[0] + m2[0]; // r0.y
-        float tmp1 = m0[2] + m1[2] + m2[2];  // r0.z
+      kernels->processKdePhaseRow(params, in, amplitude_in, stage2_x_begin, stage2_x_end, ir_out_row, kde_planes, y);
 
-        //r7.xyz = r3.zxy + r4.zxy // add
-        //r4.xyz = r5.zyx + r7.xzy // add
-        float tmp2 = m0[0] + m1[0] + m2[0]; // r4.z
-        //r3.zw = r4.xy // mov
-        float tmp3 = m0[2] + m1[2] + m2[2]; // r3.z
-        float tmp4 = m0[1] + m1[1] + m2[1]; // r3.w
-#endif
+      // Like the OpenCL kernel, the KDE leaves out the first and last column
+      // and the last row of the output frame.
+      for(size_t j = 0; j < params.num_hyps; ++j)
+      {
+        float *conf_row = kde_planes.conf[j] + y * kde_planes.stride;
+        if(y == 423)
+        {
+          std::fill(conf_row, conf_row + 512, 0.0f);
+        }
+        conf_row[0] = 0.0f;
+        conf_row[511] = 0.0f;
+      }
     }
-    else
+    else if(EdgeFilter)
     {
-      float ir_min = std::min(std::min(m0[1], m1[1]), m2[1]);
+      kernels->processStage2Row(params, in, amplitude_in, x_table_row, z_table_row, stage2_x_begin, stage2_x_end,
+          ir_out_row, out.raw_depth, out.ir_sum, dealiasing_out_row);
 
-      if (ir_min < params.individual_ab_threshold || ir_sum < params.ab_threshold)
+      for(int x = stage2_x_begin; x < stage2_x_end; ++x)
       {
-        phase = 0;
+        out.max_edge_test[x] = in.max_edge_test[x];
+        out.edge_test_depth[x] = in.max_edge_test[x] == 1 ? out.raw_depth[x] : 0;
       }
-      else
-      {
-        float t0 = m0[0] / (2.0f * M_PI) * 3.0f;
-        float t1 = m1[0] / (2.0f * M_PI) * 15.0f;
-        float t2 = m2[0] / (2.0f * M_PI) * 2.0f;
-
-        float t5 = (std::floor((t1 - t0) * 0.333333f + 0.5f) * 3.0f + t0);
-        float t3 = (-t2 + t5);
-        float t4 = t3 * 2.0f;
-
-        bool c1 = t4 >= -t4; // true if t4 positive
-
-        float f1 = c1 ? 2.0f : -2.0f;
-        float f2 = c1 ? 0.5f : -0.5f;
-        t3 *= f2;
-        t3 = (t3 - std::floor(t3)) * f1;
-
-        bool c2 = 0.5f < std::abs(t3) && std::abs(t3) < 1.5f;
-
-        float t6 = c2 ? t5 + 15.0f : t5;
-        float t7 = c2 ? t1 + 15.0f : t1;
-
-        float t8 = (std::floor((-t2 + t6) * 0.5f + 0.5f) * 2.0f + t2) * 0.5f;
-
-        t6 *= 0.333333f; // = / 3
-        t7 *= 0.066667f; // = / 15
-
-        float t9 = (t8 + t6 + t7); // transformed phase measurements (they are transformed and divided by the values the original values were multiplied with)
-        float t10 = t9 * 0.333333f; // some avg
-
-        t6 *= 2.0f * M_PI;
-        t7 *= 2.0f * M_PI;
-        t8 *= 2.0f * M_PI;
-
-        // some cross product
-        float t8_new = t7 * 0.826977f - t8 * 0.110264f;
-        float t6_new = t8 * 0.551318f - t6 * 0.826977f;
-        float t7_new = t6 * 0.110264f - t7 * 0.551318f;
-
-        t8 = t8_new;
-        t6 = t6_new;
-        t7 = t7_new;
-
-        float norm = t8 * t8 + t6 * t6 + t7 * t7;
-        float mask = t9 >= 0.0f ? 1.0f : 0.0f;
-        t10 *= mask;
-
-        bool slope_positive = 0 < params.ab_confidence_slope;
-
-        float ir_min_ = std::min(std::min(m0[1], m1[1]), m2[1]);
-        float ir_max_ = std::max(std::max(m0[1], m1[1]), m2[1]);
-
-        float ir_x = slope_positive ? ir_min_ : ir_max_;
-
-        ir_x = std::log(ir_x);
-        ir_x = (ir_x * params.ab_confidence_slope * 0.301030f + params.ab_confidence_offset) * 3.321928f;
-        ir_x = std::exp(ir_x);
-        ir_x = std::min(params.max_dealias_confidence, std::max(params.min_dealias_confidence, ir_x));
-        ir_x *= ir_x;
-
-        float mask2 = ir_x >= norm ? 1.0f : 0.0f;
+      // The edge filter reads the amplitude sums of the neighbours too, so
+      // they go to the ring and are copied out.
+      if(confidence_out_row != 0)
+        std::copy(out.ir_sum + roi_x_begin, out.ir_sum + roi_x_end, confidence_out_row + roi_x_begin);
+    }
+    else
+    {
+      kernels->processStage2Row(params, in, amplitude_in, x_table_row, z_table_row, stage2_x_begin, stage2_x_end,
+          ir_out_row, depth_out_row, confidence_out_row, dealiasing_out_row);
+    }
+  }
 
-        float t11 = t10 * mask2;
+  /**
+   * Edge filter of row @p y.
+   * @param m Stage 2 output of rows y-1, y and y+1.
+   * @param w Scratch of the worker.
+   */
+  void filterStage2Row(int y, const Stage2Row *m[3], WorkerScratch &w)
+  {
+    float *depth_out_row = outputRow(depth_out, w.depth_row, y);
 
-        float mask3 = params.max_dealias_confidence * params.max_dealias_confidence >= norm ? 1.0f : 0.0f;
-        t10 *= mask3;
-        phase = true/*(modeMask & 2) != 0*/ ? t11 : t10;
+    if(y < 1 || y > height - 2)
+    {
+      for(int x = roi_x_begin; x < roi_x_end; ++x)
+      {
+        filterBorderPixelStage2(x, *m[1], depth_out_row + x);
       }
+      storeDepthRow(w, depth_out_row, y);
+      return;
     }
 
-    // this seems to be the phase to depth mapping :)
-    float zmultiplier = z_table.at(y, x);
-    float xmultiplier = x_table.at(y, x);
-
-    phase = 0 < phase ? phase + params.phase_offset : phase;
-
-    float depth_linear = zmultiplier * phase;
-    float max_depth = phase * params.unambigious_dist * 2;
-
-    bool cond1 = /*(modeMask & 32) != 0*/ true && 0 < depth_linear && 0 < max_depth;
+    if(roi_x_begin == 0)
+      filterBorderPixelStage2(0, *m[1], depth_out_row);
+    for(int x = std::max(roi_x_begin, 1); x < std::min(roi_x_end, width - 1); ++x)
+    {
+      filterPixelStage2(x, m, depth_out_row + x);
+    }
+    if(roi_x_end == width)
+      filterBorderPixelStage2(width - 1, *m[1], depth_out_row + width - 1);
+    storeDepthRow(w, depth_out_row, y);
+  }
 
-    xmultiplier = (xmultiplier * 90) / (max_depth * max_depth * 8192.0);
+  /**
+   * Run all passes on rows [y_begin, y_end).
+   *
+   * The filters need a 1-row halo of their input, so stage 2 also runs on the
+   * row just outside the band when the edge filter is enabled, and stage 1 on
+   * one more row when the bilateral filter is enabled.
+   *
+   * @tparam BilateralFilter Whether the bilateral filter is enabled.
+   * @tparam EdgeFilter Whether the edge filter is enabled.
+   */
+  template<bool BilateralFilter, bool EdgeFilter>
+  void processBand(WorkerScratch &w, int y_begin, int y_end)
+  {
+    if(y_begin >= y_end)
+      return;
 
-    float depth_fit = depth_linear / (-depth_linear * xmultiplier + 1);
+    const int ring = WorkerScratch::RING_SIZE;
+    const int stage2_halo = EdgeFilter ? 1 : 0;
+    const int stage1_halo = BilateralFilter ? 1 : 0;
 
-    depth_fit = depth_fit < 0 ? 0 : depth_fit;
-    float depth = cond1 ? depth_fit : depth_linear; // r1.y -> later r2.z
+    const int stage2_begin = std::max(0, y_begin - stage2_halo);
+    const int stage2_end = std::min(height, y_end + stage2_halo);
+    int stage1_next = std::max(0, stage2_begin - stage1_halo);
+    int filter2_next = y_begin;
 
-    // depth
-    *depth_out = depth;
-    if(ir_sum_out != 0)
+    FilteredRow in = w.filtered;
+    if(!BilateralFilter)
     {
-      *ir_sum_out = ir_sum;
+      std::fill(in.max_edge_test, in.max_edge_test + 512, 1);
     }
 
-    // ir
-    //*ir_out = std::min((m1[2]) * ab_output_multiplier, 65535.0f);
-    // ir avg
-    *ir_out = std::min((m0[2] + m1[2] + m2[2]) * 0.3333333f * params.ab_output_multiplier, 65535.0f);
-    //ir_out[0] = std::min(m0[2] * ab_output_multiplier, 65535.0f);
-    //ir_out[1] = std::min(m1[2] * ab_output_multiplier, 65535.0f);
-    //ir_out[2] = std::min(m2[2] * ab_output_multiplier, 65535.0f);
-  }
+    for(int y = stage2_begin; y < stage2_end; ++y)
+    {
+      const int stage1_last = std::min(height - 1, y + stage1_halo);
+      for(; stage1_next <= stage1_last; ++stage1_next)
+      {
+        processStage1Row(stage1_next, w, stage1_x_begin, stage1_x_end, w.stage1[stage1_next % ring]);
+      }
 
-  void filterPixelStage2(int x, int y, Mat<Vec<float, 3> > &m, bool max_edge_test_ok, float *depth_out)
-  {
-    Vec<float, 3> &depth_and_ir_sum = m.at(y, x);
-    float &raw_depth = depth_and_ir_sum.val[0], &ir_sum = depth_and_ir_sum.val[2];
+      const Stage1Row &stage1 = w.stage1[y % ring];
 
-    if(raw_depth >= params.min_depth && raw_depth <= params.max_depth)
-    {
-      if(x < 1 || y < 1 || x > 510 || y > 422)
+      if(BilateralFilter)
       {
-        *depth_out = raw_depth;
+        // Neighbours of the first and last row are never read.
+        const Stage1Row *m[3] = {&w.stage1[(y + ring - 1) % ring], &stage1, &w.stage1[(y + 1) % ring]};
+        kernels->filterStage1Row(y, params, m, width, height, stage2_x_begin, stage2_x_end, in);
       }
       else
       {
-        float ir_sum_acc = ir_sum, squared_ir_sum_acc = ir_sum * ir_sum, min_depth = raw_depth, max_depth = raw_depth;
-
-        for(int yi = -1; yi < 2; ++yi)
+        for(int i = 0; i < 3; ++i)
         {
-          for(int xi = -1; xi < 2; ++xi)
-          {
-            if(yi == 0 && xi == 0) continue;
+          in.a[i] = stage1.a[i];
+          in.b[i] = stage1.b[i];
+        }
+      }
 
-            Vec<float, 3> &other = m.at(y + yi, x + xi);
+      float *ir_out_row = ir_out != 0 && y_begin <= y && y < y_end ? outputRow(ir_out, w.ir_row, y) : 0;
+      float *depth_out_row = !EdgeFilter && !kde ? outputRow(depth_out, w.depth_row, y) : 0;
+      float *confidence_out_row = confidence_out != 0 && y_begin <= y && y < y_end ? confidence_out + (height - 1 - y) * width : 0;
+      float *dealiasing_out_row = dealiasing_out != 0 && y_begin <= y && y < y_end ? dealiasing_out + (height - 1 - y) * width : 0;
+      processStage2Row<EdgeFilter>(y, in, stage1, w.stage2[y % ring], ir_out_row, depth_out_row, confidence_out_row, dealiasing_out_row);
+      if(ir_out_row)
+        storeRow(ir_out, ir_out_row, y);
+      if(depth_out_row)
+        storeDepthRow(w, depth_out_row, y);
+
+      // The edge filter of the previous row now has all its input.
+      for(; EdgeFilter && filter2_next < y_end && filter2_next + 1 <= y; ++filter2_next)
+      {
+        const int yf = filter2_next;
+        const Stage2Row *m[3] = {&w.stage2[(yf + ring - 1) % ring], &w.stage2[yf % ring], &w.stage2[(yf + 1) % ring]};
+        filterStage2Row(yf, m, w);
+      }
+    }
 
-            ir_sum_acc += other.val[2];
-            squared_ir_sum_acc += other.val[2] * other.val[2];
+    // The last row of the frame has no row below it.
+    for(; EdgeFilter && filter2_next < y_end; ++filter2_next)
+    {
+      const int yf = filter2_next;
+      const Stage2Row *m[3] = {&w.stage2[(yf + ring - 1) % ring], &w.stage2[yf % ring], &w.stage2[yf % ring]};
+      filterStage2Row(yf, m, w);
+    }
+  }
 
-            if(0.0f < other.val[1])
-            {
-              min_depth = std::min(min_depth, other.val[1]);
-              max_depth = std::max(max_depth, other.val[1]);
-            }
-          }
-        }
+  /** CpuDepthWorkerPool::BandFunction running processBand(). */
+  template<bool BilateralFilter, bool EdgeFilter>
+  static void processBandTask(void *context, size_t band, int y_begin, int y_end)
+  {
+    CpuDepthPacketProcessorImpl *impl = static_cast<CpuDepthPacketProcessorImpl *>(context);
+    impl->processBand<BilateralFilter, EdgeFilter>(impl->scratch[band], y_begin, y_end);
+  }
 
-        float tmp0 = std::sqrt(squared_ir_sum_acc * 9.0f - ir_sum_acc * ir_sum_acc) / 9.0f;
-        float edge_avg = std::max(ir_sum_acc / 9.0f, params.edge_ab_avg_min_value);
-        tmp0 /= edge_avg;
+  /** CpuDepthWorkerPool::BandFunction computing only IR, for listeners without depth. */
+  static void processIrBandTask(void *context, size_t band, int y_begin, int y_end)
+  {
+    CpuDepthPacketProcessorImpl *impl = static_cast<CpuDepthPacketProcessorImpl *>(context);
+    WorkerScratch &w = impl->scratch[band];
 
-        float abs_min_diff = std::abs(raw_depth - min_depth);
-        float abs_max_diff = std::abs(raw_depth - max_depth);
+    for(int y = y_begin; y < y_end; ++y)
+    {
+      float *ir_out_row = impl->outputRow(impl->ir_out, w.ir_row, y);
+      impl->processStage1Row(y, w, impl->aligned_x_begin, impl->aligned_x_end, w.stage1[0]);
+      impl->kernels->processIrRow(impl->params, w.stage1[0], impl->aligned_x_begin, impl->aligned_x_end, ir_out_row);
+      impl->storeRow(impl->ir_out, ir_out_row, y);
+    }
+  }
 
-        float avg_diff = (abs_min_diff + abs_max_diff) * 0.5f;
-        float max_abs_diff = std::max(abs_min_diff, abs_max_diff);
+  /** Choose the variant of processBand() for the current filter configuration. */
+  void selectProcessBand()
+  {
+    if(enable_bilateral_filter)
+      process_band = enable_edge_filter ? &processBandTask<true, true> : &processBandTask<true, false>;
+    else
+      process_band = enable_edge_filter ? &processBandTask<false, true> : &processBandTask<false, false>;
+  }
 
-        bool cond0 =
-            0.0f < raw_depth &&
-            tmp0 >= params.edge_ab_std_dev_threshold &&
-            params.edge_close_delta_threshold < abs_min_diff &&
-            params.edge_far_delta_threshold < abs_max_diff &&
-            params.edge_max_delta_threshold < max_abs_diff &&
-            params.edge_avg_delta_threshold < avg_diff;
+  /** Round a column down to a multiple of CPU_DEPTH_COLUMN_ALIGNMENT, within the frame. */
+  static int alignColumnBegin(int x)
+  {
+    return std::max(x, 0) / CPU_DEPTH_COLUMN_ALIGNMENT * CPU_DEPTH_COLUMN_ALIGNMENT;
+  }
 
-        *depth_out = cond0 ? 0.0f : raw_depth;
+  /** Round a column up to a multiple of CPU_DEPTH_COLUMN_ALIGNMENT, within the frame. */
+  int alignColumnEnd(int x) const
+  {
+    return std::min((x + CPU_DEPTH_COLUMN_ALIGNMENT - 1) / CPU_DEPTH_COLUMN_ALIGNMENT * CPU_DEPTH_COLUMN_ALIGNMENT, width);
+  }
 
-        if(!cond0)
-        {
-          if(max_edge_test_ok)
-          {
-            //float tmp1 = 1500.0f > raw_depth ? 30.0f : 0.02f * raw_depth;
-            float edge_count = 0.0f;
+  /**
+   * Compute the rows and columns of each pass for a region of interest, in
+   * pixels of the output frames. Depends on the filter and binning configuration.
+   */
+  void setRoi(const DepthRoi &roi)
+  {
+    output_roi = roi;
+
+    const int kde_halo = kde ? (int)params.kde_neigborhood_size : 0;
+    const int edge_halo = enable_edge_filter ? 1 : 0;
+    const int bilateral_halo = enable_bilateral_filter ? 1 : 0;
+
+    roi_x_begin = roi.x_begin;
+    roi_x_end = roi.x_end;
+    roi_y_begin = height - roi.y_end;
+    roi_y_end = height - roi.y_begin;
+
+    band_y_begin = std::max(roi_y_begin - kde_halo, 0);
+    band_y_end = std::min(roi_y_end + kde_halo, height);
+
+    aligned_x_begin = alignColumnBegin(roi_x_begin);
+    aligned_x_end = alignColumnEnd(roi_x_end);
+    stage2_x_begin = alignColumnBegin(aligned_x_begin - kde_halo - edge_halo);
+    stage2_x_end = alignColumnEnd(aligned_x_end + kde_halo + edge_halo);
+    stage1_x_begin = alignColumnBegin(stage2_x_begin - bilateral_halo);
+    stage1_x_end = alignColumnEnd(stage2_x_end + bilateral_halo);
+  }
 
-            *depth_out = edge_count > params.max_edge_count ? 0.0f : raw_depth;
-          }
-          else
-          {
-            *depth_out = !max_edge_test_ok ? 0.0f : raw_depth;
-            *depth_out = true ? *depth_out : raw_depth;
-          }
-        }
-      }
+  /** Second pass of the KDE method, once the hypotheses of all rows are known. */
+  static void filterKdeBand(void *context, size_t band, int y_begin, int y_end)
+  {
+    CpuDepthPacketProcessorImpl *impl = static_cast<CpuDepthPacketProcessorImpl *>(context);
+    WorkerScratch &w = impl->scratch[band];
+
+    for(int y = y_begin; y < y_end; ++y)
+    {
+      float *depth_out_row = impl->outputRow(impl->depth_out, w.depth_row, y);
+      impl->kernels->filterKdeRow(impl->params, impl->kde_planes, y, &impl->kde_gauss[0],
+          impl->x_table.ptr(y, 0), impl->z_table.ptr(y, 0), impl->aligned_x_begin, impl->aligned_x_end, depth_out_row);
+      impl->storeDepthRow(w, depth_out_row, y);
     }
-    else
+  }
+
+  /** @copydoc CpuDepthPacketProcessor::setNumThreads */
+  void setNumThreads(size_t num_threads)
+  {
+    if(num_threads == 0)
     {
-      *depth_out = 0.0f;
+      const char *env = std::getenv("LIBFREENECT2_CPU_THREADS");
+      if(env)
+        num_threads = std::atoi(env) > 0 ? std::atoi(env) : 1;
+      else
+        num_threads = libfreenect2::thread::hardware_concurrency();
     }
+    // Every band needs at least one row of its own.
+    num_threads = std::max<size_t>(1, std::min<size_t>(num_threads, 424));
+
+    if(num_threads != scratch.size())
+    {
+      workers.resize(num_threads);
 
-    // override raw depth
-    depth_and_ir_sum.val[0] = depth_and_ir_sum.val[1];
+      scratch.resize(num_threads);
+      arena.create(num_threads * WorkerScratch::arenaBytes());
+      for(size_t i = 0; i < num_threads; ++i)
+        scratch[i].allocate(arena);
+
+      LOG_INFO << "using " << num_threads << " thread(s)";
+    }
   }
 };
 
 CpuDepthPacketProcessor::CpuDepthPacketProcessor() :
-    impl_(new CpuDepthPacketProcessorImpl())
+    impl_(new CpuDepthPacketProcessorImpl(false))
+{
+}
+
+CpuDepthPacketProcessor::CpuDepthPacketProcessor(bool kde) :
+    impl_(new CpuDepthPacketProcessorImpl(kde))
 {
 }
 
@@ -813,14 +1513,50 @@ CpuDepthPacketProcessor::~CpuDepthPacketProcessor()
   delete impl_;
 }
 
+void CpuDepthPacketProcessor::setNumThreads(size_t num_threads)
+{
+  impl_->setNumThreads(num_threads);
+}
+
 void CpuDepthPacketProcessor::setConfiguration(const libfreenect2::DepthPacketProcessor::Config &config)
 {
   DepthPacketProcessor::setConfiguration(config);
-  
+
+  Config reducible = config;
+  if(impl_->kde)
+  {
+    // The KDE has no edge aware filter and no binning to give up.
+    reducible.EnableEdgeAwareFilter = false;
+    reducible.EnableDepthBinning = true;
+  }
+  impl_->quality.setConfiguration(reducible);
+  applyConfiguration(config);
+}
+
+void CpuDepthPacketProcessor::applyConfiguration(const libfreenect2::DepthPacketProcessor::Config &config)
+{
   impl_->params.min_depth = config.MinDepth * 1000.0f;
   impl_->params.max_depth = config.MaxDepth * 1000.0f;
   impl_->enable_bilateral_filter = config.EnableBilateralFilter;
-  impl_->enable_edge_filter = config.EnableEdgeAwareFilter;
+  impl_->enable_edge_filter = config.EnableEdgeAwareFilter && !impl_->kde;
+  impl_->selectProcessBand();
+
+  const bool binning = config.EnableDepthBinning && !impl_->kde;
+  const bool uint16_output = config.DepthFormat == Frame::UInt16;
+  const DepthRoi roi = binning ? roi_.binned() : roi_;
+  const bool layout_changed = binning != impl_->binning || uint16_output != impl_->uint16_output;
+  const bool roi_changed = roi != impl_->output_roi;
+  if(layout_changed)
+    impl_->setFrameLayout(binning, uint16_output);
+  impl_->setRoi(roi);
+
+  // Each adaptive quality step applies the configuration again: keep the
+  // temporal history unless the filter or the pixels it covers change.
+  const int window = (int)config.TemporalFilterWindow;
+  const float reset_distance = config.TemporalFilterResetDistance * 1000.0f;
+  if(layout_changed || roi_changed || !impl_->hasTemporalFilter(window, reset_distance))
+    impl_->setTemporalFilter(window, reset_distance);
+  impl_->enable_statistics = config.EnableDepthStatistics;
 }
 
 /**
@@ -852,10 +1588,6 @@ void CpuDepthPacketProcessor::loadP0TablesFromCommandResponse(unsigned char* buf
     Mat<uint16_t>(424, 512, p0table->p0table1).copyTo(impl_->p0_table1);
     Mat<uint16_t>(424, 512, p0table->p0table2).copyTo(impl_->p0_table2);
   }
-
-  impl_->fillTrigTable(impl_->p0_table0, impl_->trig_table0);
-  impl_->fillTrigTable(impl_->p0_table1, impl_->trig_table1);
-  impl_->fillTrigTable(impl_->p0_table2, impl_->trig_table2);
 }
 
 void CpuDepthPacketProcessor::loadXZTables(const float *xtable, const float *ztable)
@@ -867,6 +1599,15 @@ void CpuDepthPacketProcessor::loadXZTables(const float *xtable, const float *zta
   std::copy(ztable, ztable + TABLE_SIZE, impl_->z_table.ptr(0,0));
 }
 
+void CpuDepthPacketProcessor::loadBinnedXZTables(const float *xtable, const float *ztable)
+{
+  impl_->x_table_binned.create(212, 256);
+  std::copy(xtable, xtable + BINNED_TABLE_SIZE, impl_->x_table_binned.ptr(0,0));
+
+  impl_->z_table_binned.create(212, 256);
+  std::copy(ztable, ztable + BINNED_TABLE_SIZE, impl_->z_table_binned.ptr(0,0));
+}
+
 void CpuDepthPacketProcessor::loadLookupTable(const short *lut)
 {
   std::copy(lut, lut + LUT_SIZE, impl_->lut11to16);
@@ -880,100 +1621,121 @@ void CpuDepthPacketProcessor::process(const DepthPacket &packet)
 {
   if(listener_ == 0) return;
 
+  // Skip the passes of frame types the listener does not use.
+  const unsigned int frame_types = listener_->subscribedFrameTypes();
+  const bool want_ir = (frame_types & Frame::Ir) != 0, want_depth = (frame_types & Frame::Depth) != 0;
+  const bool want_confidence = (frame_types & Frame::Confidence) != 0 && !impl_->kde;
+  const bool want_dealiasing = (frame_types & Frame::DealiasingConfidence) != 0 && !impl_->kde;
+  const bool want_half = (frame_types & Frame::DepthHalf) != 0, want_quarter = (frame_types & Frame::DepthQuarter) != 0;
+  if(!want_ir && !want_depth && !want_confidence && !want_dealiasing && !want_half && !want_quarter) return;
+
+  // The confidences and the pyramid come out of the depth passes, so depth is
+  // computed for them even if it is not delivered.
+  const bool run_depth = want_depth || want_confidence || want_dealiasing || want_half || want_quarter;
+
   impl_->startTiming();
 
   impl_->ir_frame->timestamp = packet.timestamp;
   impl_->depth_frame->timestamp = packet.timestamp;
+  impl_->confidence_frame->timestamp = packet.timestamp;
   impl_->ir_frame->sequence = packet.sequence;
   impl_->depth_frame->sequence = packet.sequence;
-
-  Mat<Vec<float, 9> >
-      m(424, 512),
-      m_filtered(424, 512)
-  ;
-  Mat<unsigned char> m_max_edge_test(424, 512);
-
-  float *m_ptr = (m.ptr(0, 0)->val);
-
-  for(int y = 0; y < 424; ++y)
-    for(int x = 0; x < 512; ++x, m_ptr += 9)
+  impl_->confidence_frame->sequence = packet.sequence;
+  impl_->dealiasing_frame->timestamp = packet.timestamp;
+  impl_->dealiasing_frame->sequence = packet.sequence;
+  impl_->half_frame->timestamp = packet.timestamp;
+  impl_->quarter_frame->timestamp = packet.timestamp;
+  impl_->half_frame->sequence = packet.sequence;
+  impl_->quarter_frame->sequence = packet.sequence;
+
+  impl_->data = packet.buffer;
+  impl_->ir_out = want_ir ? impl_->ir_frame->data : 0;
+  impl_->depth_out = run_depth ? impl_->depth_frame->data : 0;
+  impl_->confidence_out = want_confidence ? reinterpret_cast<float *>(impl_->confidence_frame->data) : 0;
+  impl_->dealiasing_out = want_dealiasing ? reinterpret_cast<float *>(impl_->dealiasing_frame->data) : 0;
+  impl_->half_out = want_half || want_quarter ? reinterpret_cast<float *>(impl_->half_frame->data) : 0;
+  impl_->quarter_out = want_quarter ? reinterpret_cast<float *>(impl_->quarter_frame->data) : 0;
+  const int row_alignment = want_quarter ? 4 : want_half ? 2 : 1;
+  impl_->beginDepthStatistics(want_depth && impl_->enable_statistics);
+
+  if(run_depth)
+  {
+    if(impl_->temporal_window > 0)
+      impl_->temporal_slot = (impl_->temporal_slot + 1) % impl_->temporal_window;
+    if(impl_->kde)
     {
-      impl_->processPixelStage1(x, y, packet.buffer, m_ptr + 0, m_ptr + 3, m_ptr + 6);
+      impl_->workers.run(impl_->process_band, impl_, impl_->band_y_begin, impl_->band_y_end);
+      impl_->workers.run(&CpuDepthPacketProcessorImpl::filterKdeBand, impl_, impl_->roi_y_begin, impl_->roi_y_end, row_alignment);
+    }
+    else
+    {
+      impl_->workers.run(impl_->process_band, impl_, impl_->band_y_begin, impl_->band_y_end, row_alignment);
     }
-
-  // bilateral filtering
-  if(impl_->enable_bilateral_filter)
-  {
-    float *m_filtered_ptr = (m_filtered.ptr(0, 0)->val);
-    unsigned char *m_max_edge_test_ptr = m_max_edge_test.ptr(0, 0);
-
-    for(int y = 0; y < 424; ++y)
-      for(int x = 0; x < 512; ++x, m_filtered_ptr += 9, ++m_max_edge_test_ptr)
-      {
-        bool max_edge_test_val = true;
-        impl_->filterPixelStage1(x, y, m, m_filtered_ptr, max_edge_test_val);
-        *m_max_edge_test_ptr = max_edge_test_val ? 1 : 0;
-      }
-
-    m_ptr = (m_filtered.ptr(0, 0)->val);
   }
   else
   {
-    m_ptr = (m.ptr(0, 0)->val);
+    impl_->workers.run(&CpuDepthPacketProcessorImpl::processIrBandTask, impl_, impl_->roi_y_begin, impl_->roi_y_end);
   }
+  impl_->endDepthStatistics();
+
+  if(want_ir)
+    clearOutsideRoi(impl_->ir_frame, impl_->output_roi);
+  if(want_depth)
+    clearOutsideRoi(impl_->depth_frame, impl_->output_roi);
+  if(want_confidence)
+    clearOutsideRoi(impl_->confidence_frame, impl_->output_roi);
+  if(want_dealiasing)
+    clearOutsideRoi(impl_->dealiasing_frame, impl_->output_roi);
+  if(want_half)
+    clearOutsideRoi(impl_->half_frame, impl_->output_roi.binned());
+  if(want_quarter)
+    clearOutsideRoi(impl_->quarter_frame, impl_->output_roi.binned().binned());
 
-  Mat<float> out_ir(424, 512, impl_->ir_frame->data), out_depth(424, 512, impl_->depth_frame->data);
+  impl_->stopTiming(LOG_INFO);
 
-  if(impl_->enable_edge_filter)
+  if(want_ir && listener_->onNewFrame(Frame::Ir, impl_->ir_frame))
   {
-    Mat<Vec<float, 3> > depth_ir_sum(424, 512);
-    Vec<float, 3> *depth_ir_sum_ptr = depth_ir_sum.ptr(0, 0);
-    unsigned char *m_max_edge_test_ptr = m_max_edge_test.ptr(0, 0);
-
-    for(int y = 0; y < 424; ++y)
-      for(int x = 0; x < 512; ++x, m_ptr += 9, ++m_max_edge_test_ptr, ++depth_ir_sum_ptr)
-      {
-        float raw_depth, ir_sum;
-
-        impl_->processPixelStage2(x, y, m_ptr + 0, m_ptr + 3, m_ptr + 6, out_ir.ptr(423 - y, x), &raw_depth, &ir_sum);
-
-        depth_ir_sum_ptr->val[0] = raw_depth;
-        depth_ir_sum_ptr->val[1] = *m_max_edge_test_ptr == 1 ? raw_depth : 0;
-        depth_ir_sum_ptr->val[2] = ir_sum;
-      }
+    impl_->newIrFrame();
+  }
 
-    m_max_edge_test_ptr = m_max_edge_test.ptr(0, 0);
+  if(want_depth && listener_->onNewFrame(Frame::Depth, impl_->depth_frame))
+  {
+    impl_->newDepthFrame();
+  }
 
-    for(int y = 0; y < 424; ++y)
-      for(int x = 0; x < 512; ++x, ++m_max_edge_test_ptr)
-      {
-        impl_->filterPixelStage2(x, y, depth_ir_sum, *m_max_edge_test_ptr == 1, out_depth.ptr(423 - y, x));
-      }
+  if(want_confidence && listener_->onNewFrame(Frame::Confidence, impl_->confidence_frame))
+  {
+    impl_->newConfidenceFrame();
   }
-  else
+
+  if(want_dealiasing && listener_->onNewFrame(Frame::DealiasingConfidence, impl_->dealiasing_frame))
   {
-    for(int y = 0; y < 424; ++y)
-      for(int x = 0; x < 512; ++x, m_ptr += 9)
-      {
-        impl_->processPixelStage2(x, y, m_ptr + 0, m_ptr + 3, m_ptr + 6, out_ir.ptr(423 - y, x), out_depth.ptr(423 - y, x), 0);
-      }
+    impl_->newDealiasingFrame();
   }
 
-  impl_->stopTiming(LOG_INFO);
+  if(want_half && listener_->onNewFrame(Frame::DepthHalf, impl_->half_frame))
+  {
+    impl_->newHalfFrame();
+  }
 
-  if (listener_ != 0 ){
-    if(listener_->onNewFrame(Frame::Ir, impl_->ir_frame))
-    {
-      impl_->newIrFrame();
-    }
+  if(want_quarter && listener_->onNewFrame(Frame::DepthQuarter, impl_->quarter_frame))
+  {
+    impl_->newQuarterFrame();
+  }
 
-    if(listener_->onNewFrame(Frame::Depth, impl_->depth_frame))
-    {
-      impl_->newDepthFrame();
-    }
+  // After the frames are delivered, since a change of binning reallocates them.
+  if(impl_->quality.update(impl_->lastTiming()))
+  {
+    LOG_INFO << "depth quality level " << impl_->quality.quality() << ", average time " << impl_->quality.averageTime() * 1000.0f << "ms";
+    applyConfiguration(impl_->quality.apply(config_));
+    if(quality_listener_ != 0)
+      quality_listener_->onDepthQualityChanged(impl_->quality.quality(), impl_->quality.averageTime());
   }
+}
 
+CpuKdeDepthPacketProcessor::CpuKdeDepthPacketProcessor() :
+    CpuDepthPacketProcessor(true)
+{
 }
 
 } /* namespace libfreenect2 */
-
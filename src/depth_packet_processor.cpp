@@ -29,6 +29,7 @@
 #include <libfreenect2/depth_packet_processor.h>
 #include <libfreenect2/async_packet_processor.h>
 
+#include <algorithm>
 #include <cstring>
 
 namespace libfreenect2
@@ -97,8 +98,129 @@ DepthPacketProcessor::Parameters::Parameters()
   max_depth = 4500.0f; //set to > 8000 for best performance when using the kde pipeline
 }
 
+DepthRoi::DepthRoi() :
+  x_begin(0), x_end(512), y_begin(0), y_end(424)
+{
+}
+
+DepthRoi::DepthRoi(const Freenect2Device::Config &config) :
+  x_begin(0), x_end(512), y_begin(0), y_end(424)
+{
+  if(config.DepthRoiWidth == 0 || config.DepthRoiHeight == 0 || config.DepthRoiX >= 512 || config.DepthRoiY >= 424)
+    return;
+
+  x_begin = (int)config.DepthRoiX;
+  y_begin = (int)config.DepthRoiY;
+  x_end = x_begin + (int)std::min<size_t>(config.DepthRoiWidth, 512 - x_begin);
+  y_end = y_begin + (int)std::min<size_t>(config.DepthRoiHeight, 424 - y_begin);
+}
+
+DepthRoi DepthRoi::binned() const
+{
+  DepthRoi roi;
+  roi.x_begin = x_begin / 2;
+  roi.x_end = (x_end + 1) / 2;
+  roi.y_begin = y_begin / 2;
+  roi.y_end = (y_end + 1) / 2;
+  return roi;
+}
+
+bool DepthRoi::operator==(const DepthRoi &other) const
+{
+  return x_begin == other.x_begin && x_end == other.x_end && y_begin == other.y_begin && y_end == other.y_end;
+}
+
+/** Weight of a new processing time in the average of DepthQualityController. */
+static const double QUALITY_AVERAGE_WEIGHT = 1.0 / 8;
+/** Packets after a change before the next step down. */
+static const int QUALITY_DOWN_DELAY = 15;
+/** Packets after a change before the next step up, and its maximum after failed steps up. */
+static const int QUALITY_UP_DELAY = 90, QUALITY_MAX_UP_DELAY = 900;
+/** Fraction of the budget below which the average has to be to step up. */
+static const double QUALITY_UP_HEADROOM = 0.6;
+
+DepthQualityController::DepthQualityController()
+{
+  setConfiguration(Freenect2Device::Config());
+}
+
+void DepthQualityController::setConfiguration(const Freenect2Device::Config &config)
+{
+  config_ = config;
+  enabled_ = config.EnableAdaptiveDepthQuality && config.DepthProcessingBudget > 0;
+  budget_ = config.DepthProcessingBudget * (double)std::max<size_t>(config.DepthRateDivisor, 1);
+  average_ = 0;
+  frames_ = 0;
+  up_delay_ = QUALITY_UP_DELAY;
+  last_up_ = false;
+  quality_ = Freenect2Device::FullQuality;
+}
+
+bool DepthQualityController::update(double seconds)
+{
+  if(!enabled_)
+    return false;
+
+  average_ = frames_ == 0 ? seconds : average_ + (seconds - average_) * QUALITY_AVERAGE_WEIGHT;
+  ++frames_;
+
+  if(average_ > budget_ && frames_ >= QUALITY_DOWN_DELAY)
+  {
+    if(last_up_ && frames_ < up_delay_)
+      up_delay_ = std::min(up_delay_ * 2, QUALITY_MAX_UP_DELAY);
+    return step(1);
+  }
+  if(average_ < budget_ * QUALITY_UP_HEADROOM && frames_ >= up_delay_)
+    return step(-1);
+  return false;
+}
+
+bool DepthQualityController::reduces(int quality) const
+{
+  switch(quality)
+  {
+  case Freenect2Device::NoEdgeAwareFilter:
+    return config_.EnableEdgeAwareFilter;
+  case Freenect2Device::NoBilateralFilter:
+    return config_.EnableBilateralFilter;
+  case Freenect2Device::BinnedDepth:
+    return !config_.EnableDepthBinning;
+  default:
+    return false;
+  }
+}
+
+bool DepthQualityController::step(int direction)
+{
+  int quality = quality_;
+  do
+  {
+    quality += direction;
+    if(quality < Freenect2Device::FullQuality || quality > Freenect2Device::BinnedDepth)
+      return false;
+  } while(quality != Freenect2Device::FullQuality && !reduces(quality));
+
+  quality_ = (Freenect2Device::DepthQuality)quality;
+  last_up_ = direction < 0;
+  frames_ = 0;
+  return true;
+}
+
+Freenect2Device::Config DepthQualityController::apply(const Freenect2Device::Config &config) const
+{
+  Freenect2Device::Config reduced = config;
+  if(quality_ >= Freenect2Device::NoEdgeAwareFilter)
+    reduced.EnableEdgeAwareFilter = false;
+  if(quality_ >= Freenect2Device::NoBilateralFilter)
+    reduced.EnableBilateralFilter = false;
+  if(quality_ >= Freenect2Device::BinnedDepth)
+    reduced.EnableDepthBinning = true;
+  return reduced;
+}
+
 DepthPacketProcessor::DepthPacketProcessor() :
-    listener_(0)
+    listener_(0),
+    quality_listener_(0)
 {
 }
 
@@ -109,6 +231,28 @@ DepthPacketProcessor::~DepthPacketProcessor()
 void DepthPacketProcessor::setConfiguration(const libfreenect2::DepthPacketProcessor::Config &config)
 {
   config_ = config;
+  roi_ = DepthRoi(config);
+}
+
+void DepthPacketProcessor::loadBinnedXZTables(const float * /*xtable*/, const float * /*ztable*/)
+{
+}
+
+void DepthPacketProcessor::clearOutsideRoi(Frame *frame, const DepthRoi &roi)
+{
+  const int width = (int)frame->width, height = (int)frame->height;
+  if(roi.x_begin == 0 && roi.x_end == width && roi.y_begin == 0 && roi.y_end == height)
+    return;
+
+  const size_t bpp = frame->bytes_per_pixel, stride = width * bpp;
+  unsigned char *data = frame->data;
+  std::memset(data, 0, roi.y_begin * stride);
+  for(int y = roi.y_begin; y < roi.y_end; ++y)
+  {
+    std::memset(data + y * stride, 0, roi.x_begin * bpp);
+    std::memset(data + y * stride + roi.x_end * bpp, 0, (width - roi.x_end) * bpp);
+  }
+  std::memset(data + roi.y_end * stride, 0, (height - roi.y_end) * stride);
 }
 
 void DepthPacketProcessor::setFrameListener(libfreenect2::FrameListener *listener)
@@ -116,6 +260,11 @@ void DepthPacketProcessor::setFrameListener(libfreenect2::FrameListener *listene
   listener_ = listener;
 }
 
+void DepthPacketProcessor::setDepthQualityListener(libfreenect2::DepthQualityListener *listener)
+{
+  quality_listener_ = listener;
+}
+
 DumpDepthPacketProcessor::DumpDepthPacketProcessor()
   : p0table_(NULL), xtable_(NULL), ztable_(NULL), lut_(NULL) {
 }
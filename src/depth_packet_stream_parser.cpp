@@ -35,6 +35,8 @@ namespace libfreenect2
 
 DepthPacketStreamParser::DepthPacketStreamParser() :
     processor_(noopProcessor<DepthPacket>()),
+    rate_divisor_(1),
+    skip_subpacket_(false),
     processed_packets_(-1),
     current_sequence_(0),
     current_subsequence_(0)
@@ -61,6 +63,16 @@ void DepthPacketStreamParser::setPacketProcessor(libfreenect2::BaseDepthPacketPr
   processor_->allocateBuffer(packet_, buffer_size_);
 }
 
+void DepthPacketStreamParser::setRateDivisor(size_t divisor)
+{
+  rate_divisor_ = divisor > 1 ? (uint32_t)divisor : 1;
+}
+
+bool DepthPacketStreamParser::isDropped(uint32_t sequence) const
+{
+  return sequence % rate_divisor_ != 0;
+}
+
 void DepthPacketStreamParser::onDataReceived(unsigned char* buffer, size_t in_length)
 {
   if (packet_.memory == NULL || packet_.memory->data == NULL)
@@ -94,7 +106,8 @@ void DepthPacketStreamParser::onDataReceived(unsigned char* buffer, size_t in_le
       return;
     }
 
-    memcpy(wb.data + wb.length, buffer, in_length);
+    if(!skip_subpacket_)
+      memcpy(wb.data + wb.length, buffer, in_length);
     wb.length += in_length;
 
     if(footer_found)
@@ -109,7 +122,12 @@ void DepthPacketStreamParser::onDataReceived(unsigned char* buffer, size_t in_le
         {
           if(current_subsequence_ == 0x3ff)
           {
-            if(processor_->ready())
+            bool passed = true;
+            if(isDropped(current_sequence_))
+            {
+              // Dropped on purpose, not lost.
+            }
+            else if(processor_->ready())
             {
               DepthPacket &packet = packet_;
               packet.sequence = current_sequence_;
@@ -119,7 +137,15 @@ void DepthPacketStreamParser::onDataReceived(unsigned char* buffer, size_t in_le
 
               processor_->process(packet);
               processor_->allocateBuffer(packet_, buffer_size_);
+            }
+            else
+            {
+              LOG_DEBUG << "skipping depth packet";
+              passed = false;
+            }
 
+            if(passed)
+            {
               processed_packets_++;
               if (processed_packets_ == 0)
                 processed_packets_ = current_sequence_;
@@ -131,10 +157,6 @@ void DepthPacketStreamParser::onDataReceived(unsigned char* buffer, size_t in_le
                 processed_packets_ = current_sequence_;
               }
             }
-            else
-            {
-              LOG_DEBUG << "skipping depth packet";
-            }
           }
           else
           {
@@ -146,20 +168,33 @@ void DepthPacketStreamParser::onDataReceived(unsigned char* buffer, size_t in_le
         }
 
         Buffer &fb = *packet_.memory;
+        const bool dropped = isDropped(footer->sequence);
 
-        // set the bit corresponding to the subsequence number to 1
-        current_subsequence_ |= 1 << footer->subsequence;
-
-        if(footer->subsequence * footer->length > fb.capacity)
+        if(skip_subpacket_ && !dropped)
         {
-          LOG_DEBUG << "front buffer too short! subsequence number is " << footer->subsequence;
+          // Mispredicted after lost subpackets: the packet is incomplete.
+          LOG_DEBUG << "subpacket was not copied! subsequence number is " << footer->subsequence;
         }
         else
         {
-          memcpy(fb.data + (footer->subsequence * footer->length), wb.data + (wb.length - footer->length), footer->length);
+          // set the bit corresponding to the subsequence number to 1
+          current_subsequence_ |= 1 << footer->subsequence;
+
+          if(footer->subsequence * footer->length > fb.capacity)
+          {
+            LOG_DEBUG << "front buffer too short! subsequence number is " << footer->subsequence;
+          }
+          else if(!dropped)
+          {
+            memcpy(fb.data + (footer->subsequence * footer->length), wb.data + (wb.length - footer->length), footer->length);
+          }
         }
       }
 
+      // The next subpacket is normally the next one of this packet, or the
+      // first one of the next packet after the last subsequence.
+      skip_subpacket_ = isDropped(footer->subsequence == 9 ? footer->sequence + 1 : footer->sequence);
+
       // reset working buffer
       wb.length = 0;
     }
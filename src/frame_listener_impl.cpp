@@ -32,6 +32,18 @@
 namespace libfreenect2
 {
 
+DepthStatistics::DepthStatistics() :
+  valid_pixels(0),
+  min_depth(0.f),
+  max_depth(0.f),
+  mean_depth(0.f),
+  histogram_min(0.f),
+  histogram_max(0.f)
+{
+  for (int i = 0; i < HistogramBins; ++i)
+    histogram[i] = 0;
+}
+
 Frame::Frame(size_t width, size_t height, size_t bytes_per_pixel, unsigned char *data_) :
   width(width),
   height(height),
@@ -61,6 +73,11 @@ Frame::~Frame()
 
 FrameListener::~FrameListener() {}
 
+unsigned int FrameListener::subscribedFrameTypes() const
+{
+  return Frame::Color | Frame::Ir | Frame::Depth;
+}
+
 /** Implementation class for synchronizing different types of frames. */
 class SyncMultiFrameListenerImpl
 {
@@ -160,6 +177,11 @@ void SyncMultiFrameListener::release(FrameMap &frame)
   }
 }
 
+unsigned int SyncMultiFrameListener::subscribedFrameTypes() const
+{
+  return impl_->subscribed_frame_types_;
+}
+
 bool SyncMultiFrameListener::onNewFrame(Frame::Type type, Frame *frame)
 {
   if((impl_->subscribed_frame_types_ & type) == 0) return false;
@@ -100,32 +100,26 @@ struct IrCameraTables: Freenect2Device::IrCameraParams
 {
   std::vector<float> xtable;
   std::vector<float> ztable;
+  std::vector<float> xtable_binned; ///< xtable of 2x2 binned pixels, see Config::EnableDepthBinning.
+  std::vector<float> ztable_binned; ///< ztable of 2x2 binned pixels.
   std::vector<short> lut;
 
   IrCameraTables(const Freenect2Device::IrCameraParams &parent):
     Freenect2Device::IrCameraParams(parent),
     xtable(DepthPacketProcessor::TABLE_SIZE),
     ztable(DepthPacketProcessor::TABLE_SIZE),
+    xtable_binned(DepthPacketProcessor::BINNED_TABLE_SIZE),
+    ztable_binned(DepthPacketProcessor::BINNED_TABLE_SIZE),
     lut(DepthPacketProcessor::LUT_SIZE)
   {
-    const double scaling_factor = 8192;
-    const double unambigious_dist = 6250.0/3;
-    size_t divergence = 0;
-    for (size_t i = 0; i < DepthPacketProcessor::TABLE_SIZE; i++)
-    {
-      size_t xi = i % 512;
-      size_t yi = i / 512;
-      double xd = (xi + 0.5 - cx)/fx;
-      double yd = (yi + 0.5 - cy)/fy;
-      double xu, yu;
-      divergence += !undistort(xd, yd, xu, yu);
-      xtable[i] = scaling_factor*xu;
-      ztable[i] = unambigious_dist/sqrt(xu*xu + yu*yu + 1);
-    }
-
+    size_t divergence = fillXZTables(1, xtable, ztable);
     if (divergence > 0)
       LOG_ERROR << divergence << " pixels in x/ztable have incorrect undistortion.";
 
+    divergence = fillXZTables(2, xtable_binned, ztable_binned);
+    if (divergence > 0)
+      LOG_ERROR << divergence << " pixels in binned x/ztable have incorrect undistortion.";
+
     short y = 0;
     for (int x = 0; x < 1024; x++)
     {
@@ -137,6 +131,28 @@ struct IrCameraTables: Freenect2Device::IrCameraParams
     lut[1024] = 32767;
   }
 
+  //Fill x/ztable for pixels of bin x bin sensor pixels, sampled at their center
+  //Return the number of pixels whose undistortion did not converge
+  size_t fillXZTables(size_t bin, std::vector<float> &xtable, std::vector<float> &ztable) const
+  {
+    const double scaling_factor = 8192;
+    const double unambigious_dist = 6250.0/3;
+    const size_t width = 512 / bin;
+    size_t divergence = 0;
+    for (size_t i = 0; i < xtable.size(); i++)
+    {
+      size_t xi = i % width;
+      size_t yi = i / width;
+      double xd = (bin*xi + 0.5*bin - cx)/fx;
+      double yd = (bin*yi + 0.5*bin - cy)/fy;
+      double xu, yu;
+      divergence += !undistort(xd, yd, xu, yu);
+      xtable[i] = scaling_factor*xu;
+      ztable[i] = unambigious_dist/sqrt(xu*xu + yu*yu + 1);
+    }
+    return divergence;
+  }
+
   //x,y: undistorted, normalized coordinates
   //xd,yd: distorted, normalized coordinates
   void distort(double x, double y, double &xd, double &yd) const
@@ -252,6 +268,7 @@ public:
 
   virtual void setColorFrameListener(libfreenect2::FrameListener* rgb_frame_listener);
   virtual void setIrAndDepthFrameListener(libfreenect2::FrameListener* ir_frame_listener);
+  virtual void setDepthQualityListener(libfreenect2::DepthQualityListener* listener);
   virtual bool start();
   virtual bool startStreams(bool rgb, bool depth);
   virtual bool stop();
@@ -513,6 +530,10 @@ Freenect2Device::~Freenect2Device()
 {
 }
 
+DepthQualityListener::~DepthQualityListener()
+{
+}
+
 Freenect2DeviceImpl::Freenect2DeviceImpl(Freenect2Impl *context, const PacketPipeline *pipeline, libusb_device *usb_device, libusb_device_handle *usb_device_handle, const std::string &serial) :
   state_(Created),
   has_usb_interfaces_(false),
@@ -597,6 +618,7 @@ void Freenect2DeviceImpl::setIrCameraParams(const Freenect2Device::IrCameraParam
   {
     IrCameraTables tables(params);
     proc->loadXZTables(&tables.xtable[0], &tables.ztable[0]);
+    proc->loadBinnedXZTables(&tables.xtable_binned[0], &tables.ztable_binned[0]);
     proc->loadLookupTable(&tables.lut[0]);
   }
 }
@@ -605,13 +627,29 @@ Freenect2Device::Config::Config() :
   MinDepth(0.5f),
   MaxDepth(4.5f), //set to > 8000 for best performance when using the kde pipeline
   EnableBilateralFilter(true),
-  EnableEdgeAwareFilter(true) {}
+  EnableEdgeAwareFilter(true),
+  DepthRoiX(0),
+  DepthRoiY(0),
+  DepthRoiWidth(0),
+  DepthRoiHeight(0),
+  EnableDepthBinning(false),
+  DepthFormat(Frame::Float),
+  TemporalFilterWindow(0),
+  TemporalFilterResetDistance(0.05f),
+  EnableDepthStatistics(false),
+  DepthRateDivisor(1),
+  EnableAdaptiveDepthQuality(false),
+  DepthProcessingBudget(1.0f / 30.0f),
+  DepthQueueSize(1),
+  DepthQueuePolicy(PacketPipeline::DropNewest) {}
 
 void Freenect2DeviceImpl::setConfiguration(const Freenect2Device::Config &config)
 {
   DepthPacketProcessor *proc = pipeline_->getDepthPacketProcessor();
   if (proc != 0)
     proc->setConfiguration(config);
+  pipeline_->setDepthRateDivisor(config.DepthRateDivisor);
+  pipeline_->setDepthQueue(config.DepthQueueSize, config.DepthQueuePolicy);
 }
 
 void Freenect2DeviceImpl::setColorFrameListener(libfreenect2::FrameListener* rgb_frame_listener)
@@ -628,6 +666,12 @@ void Freenect2DeviceImpl::setIrAndDepthFrameListener(libfreenect2::FrameListener
     pipeline_->getDepthPacketProcessor()->setFrameListener(ir_frame_listener);
 }
 
+void Freenect2DeviceImpl::setDepthQualityListener(libfreenect2::DepthQualityListener* listener)
+{
+  if(pipeline_->getDepthPacketProcessor() != 0)
+    pipeline_->getDepthPacketProcessor()->setDepthQualityListener(listener);
+}
+
 bool Freenect2DeviceImpl::open()
 {
   LOG_INFO << "opening...";
@@ -914,6 +958,8 @@ PacketPipeline *createPacketPipelineByName(std::string name)
 #endif
   if (name == "cpu")
     return new CpuPacketPipeline();
+  if (name == "cpukde")
+    return new CpuKdePacketPipeline();
   return NULL;
 }
 
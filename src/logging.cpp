@@ -39,12 +39,12 @@
 #include <cmath>
 #endif
 
-#ifdef LIBFREENECT2_WITH_CXX11_SUPPORT
+#if defined(LIBFREENECT2_WITH_CXX11_SUPPORT)
 #include <chrono>
-#endif
-
-#ifdef LIBFREENECT2_WITH_OPENGL_SUPPORT
-#include <GLFW/glfw3.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
 #endif
 
 namespace libfreenect2
@@ -190,18 +190,32 @@ void setGlobalLogger(Logger *logger)
   userLogger_ = logger;
 }
 
+double monotonicTime()
+{
+#if defined(LIBFREENECT2_WITH_CXX11_SUPPORT)
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#elif defined(_WIN32)
+  LARGE_INTEGER frequency, counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+#endif
+}
+
 /** Timer for measuring performance. */
 class Timer
 {
  public:
   double duration;
   size_t count;
+  double time_start;
 
   Timer()
   {
-#if defined(LIBFREENECT2_WITH_OPENGL_SUPPORT)
-    glfwInit();
-#endif
     reset();
   }
 
@@ -211,61 +225,38 @@ class Timer
     count = 0;
   }
 
-#ifdef LIBFREENECT2_WITH_CXX11_SUPPORT
-  std::chrono::time_point<std::chrono::high_resolution_clock> time_start;
-
-  void start()
-  {
-    time_start = std::chrono::high_resolution_clock::now();
-  }
-
-  double stop()
-  {
-    auto time_diff = std::chrono::high_resolution_clock::now() - time_start;
-    double this_duration = std::chrono::duration_cast<std::chrono::duration<double>>(time_diff).count();
-    duration += this_duration;
-    count++;
-    return this_duration;
-  }
-#elif defined(LIBFREENECT2_WITH_OPENGL_SUPPORT)
-  double time_start;
-
   void start()
   {
-    time_start = glfwGetTime();
+    time_start = monotonicTime();
   }
 
   double stop()
   {
-    double this_duration = glfwGetTime() - time_start;
+    double this_duration = monotonicTime() - time_start;
     duration += this_duration;
     count++;
     return this_duration;
   }
-#else
-  void start()
-  {
-  }
-
-  double stop()
-  {
-    return 0;
-  }
-#endif
 };
 
 class WithPerfLoggingImpl: public Timer
 {
 public:
+  double last_duration;
+
 #ifdef LIBFREENECT2_WITH_PROFILING
   std::vector<double> stats;
   std::string name;
+#endif
 
-  WithPerfLoggingImpl()
+  WithPerfLoggingImpl() : last_duration(0)
   {
+#ifdef LIBFREENECT2_WITH_PROFILING
     stats.reserve(30*100);
+#endif
   }
 
+#ifdef LIBFREENECT2_WITH_PROFILING
   ~WithPerfLoggingImpl()
   {
     if (stats.size() < 2)
@@ -287,9 +278,10 @@ public:
   std::ostream &stop(std::ostream &stream)
   {
 #ifndef LIBFREENECT2_WITH_PROFILING
-    Timer::stop();
+    last_duration = Timer::stop();
 #else
     double this_duration = Timer::stop();
+    last_duration = this_duration;
     if (name.empty())
     {
       std::stringstream &ss = static_cast<std::stringstream &>(stream);
@@ -329,4 +321,9 @@ std::ostream &WithPerfLogging::stopTiming(std::ostream &stream)
   return impl_->stop(stream);
 }
 
+double WithPerfLogging::lastTiming() const
+{
+  return impl_->last_duration;
+}
+
 } /* namespace libfreenect2 */
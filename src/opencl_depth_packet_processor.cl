@@ -176,7 +176,7 @@ void kernel filterPixelStage1(global const float3 *a, global const float3 *b, gl
  * Process pixel stage 2
  ******************************************************************************/
 void kernel processPixelStage2(global const float3 *a_in, global const float3 *b_in, global const float *x_table, global const float *z_table,
-                               global float *depth, global float *ir_sums)
+                               global float *depth, global float *ir_sums, global float *dealiasing)
 {
   const uint i = get_global_id(0);
   float3 a = a_in[i];
@@ -192,6 +192,7 @@ void kernel processPixelStage2(global const float3 *a_in, global const float3 *b
   float ir_max = max(ir.x, max(ir.y, ir.z));
 
   float phase_final = 0.0f;
+  float dealiasing_final = 0.0f;
 
   if(ir_min >= INDIVIDUAL_AB_THRESHOLD && ir_sum >= AB_THRESHOLD)
   {
@@ -259,6 +260,9 @@ void kernel processPixelStage2(global const float3 *a_in, global const float3 *b
     float mask3 = MAX_DEALIAS_CONFIDENCE * MAX_DEALIAS_CONFIDENCE >= norm ? 1.0f : 0.0f;
     t10 *= mask3;
     phase_final = true/*(modeMask & 2) != 0*/ ? t11 : t10;
+
+    // norm is the disagreement of the unwrapped phases, ir_x the largest one accepted
+    dealiasing_final = 0.0f < phase_final ? max(0.0f, 1.0f - norm / ir_x) : 0.0f;
   }
 
   float zmultiplier = z_table[i];
@@ -279,6 +283,7 @@ void kernel processPixelStage2(global const float3 *a_in, global const float3 *b
   float d = cond1 ? depth_fit : depth_linear; // r1.y -> later r2.z
   depth[i] = d;
   ir_sums[i] = ir_sum;
+  dealiasing[i] = dealiasing_final;
 }
 
 /*******************************************************************************
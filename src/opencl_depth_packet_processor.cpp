@@ -32,6 +32,7 @@
 #include <libfreenect2/logging.h>
 
 #include <sstream>
+#include <algorithm>
 
 #define _USE_MATH_DEFINES
 #include <math.h>
@@ -166,12 +167,15 @@ public:
   static const size_t LUT_SIZE = 2048;
 
   libfreenect2::DepthPacketProcessor::Config config;
+  DepthRoi roi;
   DepthPacketProcessor::Parameters params;
 
-  Frame *ir_frame, *depth_frame;
+  Frame *ir_frame, *depth_frame, *confidence_frame, *dealiasing_frame;
   Allocator *input_buffer_allocator;
   Allocator *ir_buffer_allocator;
   Allocator *depth_buffer_allocator;
+  Allocator *confidence_buffer_allocator;
+  Allocator *dealiasing_buffer_allocator;
 
   cl::Context context;
   cl::Device device;
@@ -207,6 +211,7 @@ public:
   size_t buf_edge_test_size;
   size_t buf_depth_size;
   size_t buf_ir_sum_size;
+  size_t buf_dealiasing_size;
   size_t buf_filtered_size;
 
   cl::Buffer buf_a;
@@ -218,6 +223,7 @@ public:
   cl::Buffer buf_edge_test;
   cl::Buffer buf_depth;
   cl::Buffer buf_ir_sum;
+  cl::Buffer buf_dealiasing;
   cl::Buffer buf_filtered;
 
   bool deviceInitialized;
@@ -247,9 +253,13 @@ public:
     input_buffer_allocator = new PoolAllocator(new OpenCLAllocator(context, queue, true));
     ir_buffer_allocator = new PoolAllocator(new OpenCLAllocator(context, queue, false));
     depth_buffer_allocator = new PoolAllocator(new OpenCLAllocator(context, queue, false));
+    confidence_buffer_allocator = new PoolAllocator(new OpenCLAllocator(context, queue, false));
+    dealiasing_buffer_allocator = new PoolAllocator(new OpenCLAllocator(context, queue, false));
 
     newIrFrame();
     newDepthFrame();
+    newConfidenceFrame();
+    newDealiasingFrame();
 
     const int CL_ICDL_VERSION = 2;
     typedef cl_int (*icdloader_func)(int, size_t, void*, size_t*);
@@ -281,9 +291,13 @@ public:
   {
     delete ir_frame;
     delete depth_frame;
+    delete confidence_frame;
+    delete dealiasing_frame;
     delete input_buffer_allocator;
     delete ir_buffer_allocator;
     delete depth_buffer_allocator;
+    delete confidence_buffer_allocator;
+    delete dealiasing_buffer_allocator;
   }
 
   void generateOptions(std::string &options) const
@@ -486,6 +500,7 @@ public:
     buf_edge_test_size = IMAGE_SIZE * sizeof(cl_uchar);
     buf_depth_size = IMAGE_SIZE * sizeof(cl_float);
     buf_ir_sum_size = IMAGE_SIZE * sizeof(cl_float);
+    buf_dealiasing_size = IMAGE_SIZE * sizeof(cl_float);
     buf_filtered_size = IMAGE_SIZE * sizeof(cl_float);
 
     CHECK_CL_PARAM(buf_a = cl::Buffer(context, CL_MEM_READ_WRITE, buf_a_size, NULL, &err));
@@ -497,6 +512,7 @@ public:
     CHECK_CL_PARAM(buf_edge_test = cl::Buffer(context, CL_MEM_READ_WRITE, buf_edge_test_size, NULL, &err));
     CHECK_CL_PARAM(buf_depth = cl::Buffer(context, CL_MEM_READ_WRITE, buf_depth_size, NULL, &err));
     CHECK_CL_PARAM(buf_ir_sum = cl::Buffer(context, CL_MEM_READ_WRITE, buf_ir_sum_size, NULL, &err));
+    CHECK_CL_PARAM(buf_dealiasing = cl::Buffer(context, CL_MEM_WRITE_ONLY, buf_dealiasing_size, NULL, &err));
     CHECK_CL_PARAM(buf_filtered = cl::Buffer(context, CL_MEM_WRITE_ONLY, buf_filtered_size, NULL, &err));
 
     return true;
@@ -538,6 +554,7 @@ public:
     CHECK_CL_RETURN(kernel_processPixelStage2.setArg(3, buf_z_table));
     CHECK_CL_RETURN(kernel_processPixelStage2.setArg(4, buf_depth));
     CHECK_CL_RETURN(kernel_processPixelStage2.setArg(5, buf_ir_sum));
+    CHECK_CL_RETURN(kernel_processPixelStage2.setArg(6, buf_dealiasing));
 
     CHECK_CL_PARAM(kernel_filterPixelStage2 = cl::Kernel(program, "filterPixelStage2", &err));
     CHECK_CL_RETURN(kernel_filterPixelStage2.setArg(0, buf_depth));
@@ -549,40 +566,123 @@ public:
     return true;
   }
 
-  bool run(const DepthPacket &packet)
+  /**
+   * Rows each kernel runs on: the rows of the region of interest, and the
+   * 1-row halo each filter needs of its input.
+   */
+  void roiRows(int &stage1_begin, int &stage1_end, int &stage2_begin, int &stage2_end) const
+  {
+    const int edge_halo = config.EnableEdgeAwareFilter ? 1 : 0;
+    const int bilateral_halo = config.EnableBilateralFilter ? 1 : 0;
+
+    stage2_begin = std::max(roi.y_begin - edge_halo, 0);
+    stage2_end = std::min(roi.y_end + edge_halo, 424);
+    stage1_begin = std::max(stage2_begin - bilateral_halo, 0);
+    stage1_end = std::min(stage2_end + bilateral_halo, 424);
+  }
+
+  /**
+   * Process a packet.
+   * @param packet Packet to process.
+   * @param want_ir Whether to read back IR.
+   * @param want_depth Whether to compute and read back depth; stage 1 alone gives IR.
+   * @param want_confidence Whether to read back the amplitude sums of stage 2; depth is computed but not read back for it.
+   * @param want_dealiasing Whether to read back the dealiasing confidences of stage 2, like @p want_confidence.
+   */
+  bool run(const DepthPacket &packet, bool want_ir, bool want_depth, bool want_confidence, bool want_dealiasing)
   {
     std::vector<cl::Event> eventWrite(1), eventPPS1(1), eventFPS1(1), eventPPS2(1), eventFPS2(1);
-    cl::Event eventReadIr, eventReadDepth;
+    cl::Event eventReadIr, eventReadDepth, eventReadConfidence, eventReadDealiasing;
+
+    // Kernels only run on the rows needed for the region of interest; the
+    // columns outside it are cleared after reading.
+    int stage1_begin, stage1_end, stage2_begin, stage2_end;
+    roiRows(stage1_begin, stage1_end, stage2_begin, stage2_end);
+    const cl::NDRange stage1_offset(stage1_begin * 512), stage1_size((stage1_end - stage1_begin) * 512);
+    const cl::NDRange stage2_offset(stage2_begin * 512), stage2_size((stage2_end - stage2_begin) * 512);
+    const cl::NDRange roi_offset(roi.y_begin * 512), roi_size((roi.y_end - roi.y_begin) * 512);
+    const size_t roi_byte_offset = roi.y_begin * 512 * sizeof(float);
+    const size_t roi_byte_size = (roi.y_end - roi.y_begin) * 512 * sizeof(float);
 
     CHECK_CL_RETURN(queue.enqueueWriteBuffer(buf_packet, CL_FALSE, 0, buf_packet_size, packet.buffer, NULL, &eventWrite[0]));
-    CHECK_CL_RETURN(queue.enqueueNDRangeKernel(kernel_processPixelStage1, cl::NullRange, cl::NDRange(IMAGE_SIZE), cl::NullRange, &eventWrite, &eventPPS1[0]));
-    CHECK_CL_RETURN(queue.enqueueReadBuffer(buf_ir, CL_FALSE, 0, buf_ir_size, ir_frame->data, &eventPPS1, &eventReadIr));
+    CHECK_CL_RETURN(queue.enqueueNDRangeKernel(kernel_processPixelStage1, stage1_offset, stage1_size, cl::NullRange, &eventWrite, &eventPPS1[0]));
+    if(want_ir)
+    {
+      CHECK_CL_RETURN(queue.enqueueReadBuffer(buf_ir, CL_FALSE, roi_byte_offset, roi_byte_size, ir_frame->data + roi_byte_offset, &eventPPS1, &eventReadIr));
+    }
+
+    if(!want_depth && !want_confidence && !want_dealiasing)
+    {
+      CHECK_CL_RETURN(eventReadIr.wait());
+      return true;
+    }
 
     if(config.EnableBilateralFilter)
     {
-      CHECK_CL_RETURN(queue.enqueueNDRangeKernel(kernel_filterPixelStage1, cl::NullRange, cl::NDRange(IMAGE_SIZE), cl::NullRange, &eventPPS1, &eventFPS1[0]));
+      CHECK_CL_RETURN(queue.enqueueNDRangeKernel(kernel_filterPixelStage1, stage2_offset, stage2_size, cl::NullRange, &eventPPS1, &eventFPS1[0]));
     }
     else
     {
       eventFPS1[0] = eventPPS1[0];
     }
 
-    CHECK_CL_RETURN(queue.enqueueNDRangeKernel(kernel_processPixelStage2, cl::NullRange, cl::NDRange(IMAGE_SIZE), cl::NullRange, &eventFPS1, &eventPPS2[0]));
+    CHECK_CL_RETURN(queue.enqueueNDRangeKernel(kernel_processPixelStage2, stage2_offset, stage2_size, cl::NullRange, &eventFPS1, &eventPPS2[0]));
+    if(want_confidence)
+    {
+      CHECK_CL_RETURN(queue.enqueueReadBuffer(buf_ir_sum, CL_FALSE, roi_byte_offset, roi_byte_size, confidence_frame->data + roi_byte_offset, &eventPPS2, &eventReadConfidence));
+    }
+    if(want_dealiasing)
+    {
+      CHECK_CL_RETURN(queue.enqueueReadBuffer(buf_dealiasing, CL_FALSE, roi_byte_offset, roi_byte_size, dealiasing_frame->data + roi_byte_offset, &eventPPS2, &eventReadDealiasing));
+    }
+
+    if(!want_depth)
+    {
+      if(want_ir)
+      {
+        CHECK_CL_RETURN(eventReadIr.wait());
+      }
+      if(want_confidence)
+      {
+        CHECK_CL_RETURN(eventReadConfidence.wait());
+      }
+      if(want_dealiasing)
+      {
+        CHECK_CL_RETURN(eventReadDealiasing.wait());
+      }
+      return true;
+    }
 
     if(config.EnableEdgeAwareFilter)
     {
-      CHECK_CL_RETURN(queue.enqueueNDRangeKernel(kernel_filterPixelStage2, cl::NullRange, cl::NDRange(IMAGE_SIZE), cl::NullRange, &eventPPS2, &eventFPS2[0]));
+      CHECK_CL_RETURN(queue.enqueueNDRangeKernel(kernel_filterPixelStage2, roi_offset, roi_size, cl::NullRange, &eventPPS2, &eventFPS2[0]));
     }
     else
     {
       eventFPS2[0] = eventPPS2[0];
     }
 
-    CHECK_CL_RETURN(queue.enqueueReadBuffer(config.EnableEdgeAwareFilter ? buf_filtered : buf_depth, CL_FALSE, 0, buf_depth_size, depth_frame->data, &eventFPS2, &eventReadDepth));
-    CHECK_CL_RETURN(eventReadIr.wait());
+    CHECK_CL_RETURN(queue.enqueueReadBuffer(config.EnableEdgeAwareFilter ? buf_filtered : buf_depth, CL_FALSE, roi_byte_offset, roi_byte_size,
+        depth_frame->data + roi_byte_offset, &eventFPS2, &eventReadDepth));
+    if(want_ir)
+    {
+      CHECK_CL_RETURN(eventReadIr.wait());
+    }
     CHECK_CL_RETURN(eventReadDepth.wait());
+    if(want_confidence)
+    {
+      CHECK_CL_RETURN(eventReadConfidence.wait());
+    }
+    if(want_dealiasing)
+    {
+      CHECK_CL_RETURN(eventReadDealiasing.wait());
+    }
 
 #ifdef LIBFREENECT2_WITH_PROFILING_CL
+    // Only frames going through all passes are profiled.
+    if(!want_ir)
+      return true;
+
     if(count == 0)
     {
       timings.clear();
@@ -654,6 +754,18 @@ public:
     depth_frame->format = Frame::Float;
   }
 
+  void newConfidenceFrame()
+  {
+    confidence_frame = new OpenCLFrame(static_cast<OpenCLBuffer *>(confidence_buffer_allocator->allocate(IMAGE_SIZE * sizeof(cl_float))));
+    confidence_frame->format = Frame::Float;
+  }
+
+  void newDealiasingFrame()
+  {
+    dealiasing_frame = new OpenCLFrame(static_cast<OpenCLBuffer *>(dealiasing_buffer_allocator->allocate(IMAGE_SIZE * sizeof(cl_float))));
+    dealiasing_frame->format = Frame::Float;
+  }
+
   bool fill_trig_table(const libfreenect2::protocol::P0TablesResponse *p0table)
   {
     if(!deviceInitialized)
@@ -746,6 +858,7 @@ void OpenCLDepthPacketProcessor::setConfiguration(const libfreenect2::DepthPacke
   }
 
   impl_->config = config;
+  impl_->roi = roi_;
   if (!impl_->programBuilt)
     impl_->buildProgram(impl_->sourceCode);
 }
@@ -783,6 +896,13 @@ void OpenCLDepthPacketProcessor::process(const DepthPacket &packet)
   if (!listener_)
     return;
 
+  const unsigned int frame_types = listener_->subscribedFrameTypes();
+  const bool want_ir = (frame_types & Frame::Ir) != 0, want_depth = (frame_types & Frame::Depth) != 0;
+  const bool want_confidence = (frame_types & Frame::Confidence) != 0;
+  const bool want_dealiasing = (frame_types & Frame::DealiasingConfidence) != 0;
+  if(!want_ir && !want_depth && !want_confidence && !want_dealiasing)
+    return;
+
   if(!impl_->programInitialized && !impl_->initProgram())
   {
     impl_->runtimeOk = false;
@@ -796,8 +916,20 @@ void OpenCLDepthPacketProcessor::process(const DepthPacket &packet)
   impl_->depth_frame->timestamp = packet.timestamp;
   impl_->ir_frame->sequence = packet.sequence;
   impl_->depth_frame->sequence = packet.sequence;
-
-  impl_->runtimeOk = impl_->run(packet);
+  impl_->confidence_frame->timestamp = packet.timestamp;
+  impl_->confidence_frame->sequence = packet.sequence;
+  impl_->dealiasing_frame->timestamp = packet.timestamp;
+  impl_->dealiasing_frame->sequence = packet.sequence;
+
+  impl_->runtimeOk = impl_->run(packet, want_ir, want_depth, want_confidence, want_dealiasing);
+  if(want_ir)
+    clearOutsideRoi(impl_->ir_frame, roi_);
+  if(want_depth)
+    clearOutsideRoi(impl_->depth_frame, roi_);
+  if(want_confidence)
+    clearOutsideRoi(impl_->confidence_frame, roi_);
+  if(want_dealiasing)
+    clearOutsideRoi(impl_->dealiasing_frame, roi_);
 
   impl_->stopTiming(LOG_INFO);
 
@@ -805,12 +937,18 @@ void OpenCLDepthPacketProcessor::process(const DepthPacket &packet)
   {
     impl_->ir_frame->status = 1;
     impl_->depth_frame->status = 1;
+    impl_->confidence_frame->status = 1;
+    impl_->dealiasing_frame->status = 1;
   }
 
-  if(listener_->onNewFrame(Frame::Ir, impl_->ir_frame))
+  if(want_ir && listener_->onNewFrame(Frame::Ir, impl_->ir_frame))
     impl_->newIrFrame();
-  if(listener_->onNewFrame(Frame::Depth, impl_->depth_frame))
+  if(want_depth && listener_->onNewFrame(Frame::Depth, impl_->depth_frame))
     impl_->newDepthFrame();
+  if(want_confidence && listener_->onNewFrame(Frame::Confidence, impl_->confidence_frame))
+    impl_->newConfidenceFrame();
+  if(want_dealiasing && listener_->onNewFrame(Frame::DealiasingConfidence, impl_->dealiasing_frame))
+    impl_->newDealiasingFrame();
 }
 
 Allocator *OpenCLDepthPacketProcessor::getAllocator()
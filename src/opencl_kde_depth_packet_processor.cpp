@@ -599,14 +599,29 @@ public:
     return true;
   }
 
-  bool run(const DepthPacket &packet)
+  /**
+   * Process a packet.
+   * @param packet Packet to process.
+   * @param want_ir Whether to read back IR.
+   * @param want_depth Whether to compute and read back depth; stage 1 alone gives IR.
+   */
+  bool run(const DepthPacket &packet, bool want_ir, bool want_depth)
   {
     std::vector<cl::Event> eventWrite(1), eventPPS1(1), eventFPS1(1), eventPPS2(1), eventFPS2(1);
     cl::Event eventReadIr, eventReadDepth;
 
     CHECK_CL_RETURN(queue.enqueueWriteBuffer(buf_packet, CL_FALSE, 0, buf_packet_size, packet.buffer, NULL, &eventWrite[0]));
     CHECK_CL_RETURN(queue.enqueueNDRangeKernel(kernel_processPixelStage1, cl::NullRange, cl::NDRange(IMAGE_SIZE), cl::NullRange, &eventWrite, &eventPPS1[0]));
-    CHECK_CL_RETURN(queue.enqueueReadBuffer(buf_ir, CL_FALSE, 0, buf_ir_size, ir_frame->data, &eventPPS1, &eventReadIr));
+    if(want_ir)
+    {
+      CHECK_CL_RETURN(queue.enqueueReadBuffer(buf_ir, CL_FALSE, 0, buf_ir_size, ir_frame->data, &eventPPS1, &eventReadIr));
+    }
+
+    if(!want_depth)
+    {
+      CHECK_CL_RETURN(eventReadIr.wait());
+      return true;
+    }
 
     if(config.EnableBilateralFilter)
     {
@@ -622,10 +637,17 @@ public:
     CHECK_CL_RETURN(queue.enqueueNDRangeKernel(kernel_filter_kde, cl::NullRange, cl::NDRange(IMAGE_SIZE), cl::NullRange, &eventPPS2, &eventFPS2[0]));
 
     CHECK_CL_RETURN(queue.enqueueReadBuffer(buf_depth, CL_FALSE, 0, buf_depth_size, depth_frame->data, &eventFPS2, &eventReadDepth));
-    CHECK_CL_RETURN(eventReadIr.wait());
+    if(want_ir)
+    {
+      CHECK_CL_RETURN(eventReadIr.wait());
+    }
     CHECK_CL_RETURN(eventReadDepth.wait());
 
 #ifdef LIBFREENECT2_WITH_PROFILING_CL
+    // Only frames going through all passes are profiled.
+    if(!want_ir)
+      return true;
+
     if(count == 0)
     {
       timings.clear();
@@ -847,6 +869,11 @@ void OpenCLKdeDepthPacketProcessor::process(const DepthPacket &packet)
   if (!listener_)
     return;
 
+  const unsigned int frame_types = listener_->subscribedFrameTypes();
+  const bool want_ir = (frame_types & Frame::Ir) != 0, want_depth = (frame_types & Frame::Depth) != 0;
+  if(!want_ir && !want_depth)
+    return;
+
   if(!impl_->programInitialized && !impl_->initProgram())
   {
     impl_->runtimeOk = false;
@@ -861,7 +888,7 @@ void OpenCLKdeDepthPacketProcessor::process(const DepthPacket &packet)
   impl_->ir_frame->sequence = packet.sequence;
   impl_->depth_frame->sequence = packet.sequence;
 
-  impl_->runtimeOk = impl_->run(packet);
+  impl_->runtimeOk = impl_->run(packet, want_ir, want_depth);
 
   impl_->stopTiming(LOG_INFO);
 
@@ -871,9 +898,9 @@ void OpenCLKdeDepthPacketProcessor::process(const DepthPacket &packet)
     impl_->depth_frame->status = 1;
   }
 
-  if(listener_->onNewFrame(Frame::Ir, impl_->ir_frame))
+  if(want_ir && listener_->onNewFrame(Frame::Ir, impl_->ir_frame))
     impl_->newIrFrame();
-  if(listener_->onNewFrame(Frame::Depth, impl_->depth_frame))
+  if(want_depth && listener_->onNewFrame(Frame::Depth, impl_->depth_frame))
     impl_->newDepthFrame();
 }
 
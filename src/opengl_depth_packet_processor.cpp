@@ -736,6 +736,10 @@ public:
       *ir = stage1_infrared.downloadToNewFrame();
     }
 
+    // IR only needs stage 1.
+    if(depth == 0 && !do_debug)
+      return;
+
     if(config.EnableBilateralFilter)
     {
       // bilateral filter
@@ -959,28 +963,40 @@ void OpenGLDepthPacketProcessor::process(const DepthPacket &packet)
     return;
   Frame *ir = 0, *depth = 0;
 
+  const unsigned int frame_types = listener_->subscribedFrameTypes();
+  const bool want_ir = (frame_types & Frame::Ir) != 0, want_depth = (frame_types & Frame::Depth) != 0;
+  if(!want_ir && !want_depth)
+    return;
+
   impl_->startTiming();
 
   glfwMakeContextCurrent(impl_->opengl_context_ptr);
 
   std::copy(packet.buffer, packet.buffer + packet.buffer_length/10*9, impl_->input_data.data);
   impl_->input_data.upload();
-  impl_->run(&ir, &depth);
+  impl_->run(want_ir ? &ir : 0, want_depth ? &depth : 0);
 
   if(impl_->do_debug) glfwSwapBuffers(impl_->opengl_context_ptr);
 
   impl_->stopTiming(LOG_INFO);
 
-  ir->timestamp = packet.timestamp;
-  depth->timestamp = packet.timestamp;
-  ir->sequence = packet.sequence;
-  depth->sequence = packet.sequence;
+  if(ir != 0)
+  {
+    ir->timestamp = packet.timestamp;
+    ir->sequence = packet.sequence;
 
-  if(!listener_->onNewFrame(Frame::Ir, ir))
-    delete ir;
+    if(!listener_->onNewFrame(Frame::Ir, ir))
+      delete ir;
+  }
+
+  if(depth != 0)
+  {
+    depth->timestamp = packet.timestamp;
+    depth->sequence = packet.sequence;
 
-  if(!listener_->onNewFrame(Frame::Depth, depth))
-    delete depth;
+    if(!listener_->onNewFrame(Frame::Depth, depth))
+      delete depth;
+  }
 }
 
 } /* namespace libfreenect2 */
@@ -79,7 +79,7 @@ void DepthStream::populateFrame(libfreenect2::Frame* srcFrame, int srcX, int src
     memset(dstFrame->data, 0x00, dstFrame->width * dstFrame->height * 2);
 
   // copy stream buffer from freenect
-  copyFrame(static_cast<float*>((void*)srcFrame->data), srcX, srcY, srcFrame->width,
+  copyFrame(srcFrame, srcX, srcY,
             static_cast<uint16_t*>(dstFrame->data), dstX, dstY, dstFrame->width,
             width, height, mirroring);
 }
@@ -56,7 +56,7 @@ void IrStream::populateFrame(libfreenect2::Frame* srcFrame, int srcX, int srcY,
   dstFrame->stride = dstFrame->width * sizeof(uint16_t);
 
   // copy stream buffer from freenect
-  copyFrame(static_cast<float*>((void*)srcFrame->data), srcX, srcY, srcFrame->width,
+  copyFrame(srcFrame, srcX, srcY,
             static_cast<uint16_t*>(dstFrame->data), dstX, dstY, dstFrame->width,
             width, height, mirroring);
 }
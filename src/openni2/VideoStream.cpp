@@ -53,14 +53,15 @@ OniStatus VideoStream::setVideoMode(OniVideoMode requested_mode)
   return ONI_STATUS_OK;
 }
 
-void VideoStream::copyFrame(float* srcPix, int srcX, int srcY, int srcStride, uint16_t* dstPix, int dstX, int dstY, int dstStride, int width, int height, bool mirroring)
+template<typename T>
+static void copyPixels(T* srcPix, int srcX, int srcY, int srcStride, uint16_t* dstPix, int dstX, int dstY, int dstStride, int width, int height, bool mirroring)
 {
   srcPix += srcX + srcY * srcStride;
   dstPix += dstX + dstY * dstStride;
 
   for (int y = 0; y < height; y++) {
     uint16_t* dst = dstPix + y * dstStride;
-    float* src = srcPix + y * srcStride;
+    T* src = srcPix + y * srcStride;
     if (mirroring) {
       dst += width;
       for (int x = 0; x < width; x++)
@@ -71,6 +72,25 @@ void VideoStream::copyFrame(float* srcPix, int srcX, int srcY, int srcStride, ui
     }
   }
 }
+
+void VideoStream::copyFrame(float* srcPix, int srcX, int srcY, int srcStride, uint16_t* dstPix, int dstX, int dstY, int dstStride, int width, int height, bool mirroring)
+{
+  copyPixels(srcPix, srcX, srcY, srcStride, dstPix, dstX, dstY, dstStride, width, height, mirroring);
+}
+
+void VideoStream::copyFrame(uint16_t* srcPix, int srcX, int srcY, int srcStride, uint16_t* dstPix, int dstX, int dstY, int dstStride, int width, int height, bool mirroring)
+{
+  copyPixels(srcPix, srcX, srcY, srcStride, dstPix, dstX, dstY, dstStride, width, height, mirroring);
+}
+
+// Float or UInt16 depth and IR frames, see Freenect2Device::Config::DepthFormat
+void VideoStream::copyFrame(libfreenect2::Frame* srcFrame, int srcX, int srcY, uint16_t* dstPix, int dstX, int dstY, int dstStride, int width, int height, bool mirroring)
+{
+  if (srcFrame->format == libfreenect2::Frame::UInt16)
+    copyFrame(static_cast<uint16_t*>((void*)srcFrame->data), srcX, srcY, srcFrame->width, dstPix, dstX, dstY, dstStride, width, height, mirroring);
+  else
+    copyFrame(static_cast<float*>((void*)srcFrame->data), srcX, srcY, srcFrame->width, dstPix, dstX, dstY, dstStride, width, height, mirroring);
+}
 void VideoStream::raisePropertyChanged(int propertyId, const void* data, int dataSize) {
   if (callPropertyChangedCallback)
     StreamBase::raisePropertyChanged(propertyId, data, dataSize);
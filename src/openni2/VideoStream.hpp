@@ -63,6 +63,8 @@ namespace Freenect2Driver
     OniStatus setVideoMode(OniVideoMode requested_mode);
 
     static void copyFrame(float* srcPix, int srcX, int srcY, int srcStride, uint16_t* dstPix, int dstX, int dstY, int dstStride, int width, int height, bool mirroring);
+    static void copyFrame(uint16_t* srcPix, int srcX, int srcY, int srcStride, uint16_t* dstPix, int dstX, int dstY, int dstStride, int width, int height, bool mirroring);
+    static void copyFrame(libfreenect2::Frame* srcFrame, int srcX, int srcY, uint16_t* dstPix, int dstX, int dstY, int dstStride, int width, int height, bool mirroring);
     void raisePropertyChanged(int propertyId, const void* data, int dataSize);
 
   public:
@@ -33,6 +33,9 @@
 #include <libfreenect2/depth_packet_stream_parser.h>
 #include <libfreenect2/protocol/response.h>
 
+#include <algorithm>
+#include <vector>
+
 namespace libfreenect2
 {
 
@@ -70,7 +73,7 @@ public:
   RgbPacketProcessor *rgb_processor_;
   BaseRgbPacketProcessor *async_rgb_processor_;
   DepthPacketProcessor *depth_processor_;
-  BaseDepthPacketProcessor *async_depth_processor_;
+  AsyncPacketProcessor<DepthPacket> *async_depth_processor_;
 
   ~PacketPipelineComponents();
   void initialize(RgbPacketProcessor *rgb, DepthPacketProcessor *depth);
@@ -128,13 +131,76 @@ DepthPacketProcessor *PacketPipeline::getDepthPacketProcessor() const
   return comp_->depth_processor_;
 }
 
+void PacketPipeline::setDepthRateDivisor(size_t divisor)
+{
+  comp_->depth_parser_->setRateDivisor(divisor);
+}
+
+void PacketPipeline::setDepthQueue(size_t size, QueuePolicy policy)
+{
+  comp_->async_depth_processor_->setQueue(size, policy);
+}
+
+void PacketPipeline::setEagerBufferAllocation(bool eager)
+{
+  comp_->async_rgb_processor_->setEagerBufferAllocation(eager);
+  comp_->async_depth_processor_->setEagerBufferAllocation(eager);
+}
+
+bool PacketPipeline::getRgbBufferStatistics(BufferStatistics &statistics) const
+{
+  return comp_->async_rgb_processor_->getBufferStatistics(statistics);
+}
+
+bool PacketPipeline::getDepthBufferStatistics(BufferStatistics &statistics) const
+{
+  return comp_->async_depth_processor_->getBufferStatistics(statistics);
+}
+
+/**
+ * CPU depth processor, or @p num_processors of them running in parallel,
+ * each with a share of the cores.
+ */
+static DepthPacketProcessor *newCpuDepthPacketProcessor(bool kde, size_t num_processors)
+{
+  if(num_processors <= 1)
+    return kde ? new CpuKdeDepthPacketProcessor() : new CpuDepthPacketProcessor();
+
+  const size_t num_threads = std::max<size_t>(1, libfreenect2::thread::hardware_concurrency() / num_processors);
+  std::vector<DepthPacketProcessor *> processors;
+  for(size_t i = 0; i < num_processors; ++i)
+  {
+    CpuDepthPacketProcessor *processor = kde ? new CpuKdeDepthPacketProcessor() : new CpuDepthPacketProcessor();
+    processor->setNumThreads(num_threads);
+    processors.push_back(processor);
+  }
+  return new ParallelDepthPacketProcessor(processors);
+}
+
 CpuPacketPipeline::CpuPacketPipeline()
 {
   comp_->initialize(getDefaultRgbPacketProcessor(), new CpuDepthPacketProcessor());
 }
 
+CpuPacketPipeline::CpuPacketPipeline(size_t num_processors)
+{
+  comp_->initialize(getDefaultRgbPacketProcessor(), newCpuDepthPacketProcessor(false, num_processors));
+}
+
 CpuPacketPipeline::~CpuPacketPipeline() { }
 
+CpuKdePacketPipeline::CpuKdePacketPipeline()
+{
+  comp_->initialize(getDefaultRgbPacketProcessor(), new CpuKdeDepthPacketProcessor());
+}
+
+CpuKdePacketPipeline::CpuKdePacketPipeline(size_t num_processors)
+{
+  comp_->initialize(getDefaultRgbPacketProcessor(), newCpuDepthPacketProcessor(true, num_processors));
+}
+
+CpuKdePacketPipeline::~CpuKdePacketPipeline() { }
+
 #ifdef LIBFREENECT2_WITH_OPENGL_SUPPORT
 OpenGLPacketPipeline::OpenGLPacketPipeline(void *parent_opengl_context, bool debug) : parent_opengl_context_(parent_opengl_context), debug_(debug)
 {
@@ -0,0 +1,179 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file parallel_depth_packet_processor.cpp Depth processing of consecutive packets in parallel. */
+
+#include <libfreenect2/depth_packet_processor.h>
+#include <libfreenect2/packet_worker_pool.h>
+#include <libfreenect2/logging.h>
+
+namespace libfreenect2
+{
+
+/** Processing of a packet by one of the processors of ParallelDepthPacketProcessor. */
+class ParallelDepthJob : public PacketWorkerPool<DepthPacket>::Job
+{
+public:
+  DepthPacketProcessor *processor;
+
+  ParallelDepthJob(DepthPacketProcessor *processor) :
+    processor(processor)
+  {
+  }
+
+  virtual const char *name()
+  {
+    return processor->name();
+  }
+
+  virtual void process(const DepthPacket &packet, FrameListener &frames)
+  {
+    processor->setFrameListener(&frames);
+    if(processor->good())
+      processor->process(packet);
+  }
+};
+
+class ParallelDepthPacketProcessorImpl
+{
+public:
+  std::vector<DepthPacketProcessor *> processors;
+  PacketWorkerPool<DepthPacket> *workers;
+
+  ParallelDepthPacketProcessorImpl(const std::vector<DepthPacketProcessor *> &processors) :
+    processors(processors),
+    workers(0)
+  {
+  }
+
+  ~ParallelDepthPacketProcessorImpl()
+  {
+    delete workers;
+    for(size_t i = 0; i < processors.size(); ++i)
+      delete processors[i];
+  }
+};
+
+ParallelDepthPacketProcessor::ParallelDepthPacketProcessor(const std::vector<DepthPacketProcessor *> &processors) :
+  impl_(new ParallelDepthPacketProcessorImpl(processors))
+{
+  std::vector<PacketWorkerPool<DepthPacket>::Job *> jobs;
+  for(size_t i = 0; i < processors.size(); ++i)
+    jobs.push_back(new ParallelDepthJob(processors[i]));
+  impl_->workers = new PacketWorkerPool<DepthPacket>(this, listener_, jobs);
+
+  // The two buffers of the default pool, for the packet being received and
+  // the one being passed on, and one for each processor.
+  setBufferCapacity(2);
+  LOG_INFO << "processing " << processors.size() << " depth packets in parallel";
+}
+
+ParallelDepthPacketProcessor::~ParallelDepthPacketProcessor()
+{
+  delete impl_;
+}
+
+void ParallelDepthPacketProcessor::setConfiguration(const libfreenect2::DepthPacketProcessor::Config &config)
+{
+  DepthPacketProcessor::setConfiguration(config);
+
+  // Each processor only sees every other packet, which breaks state kept
+  // across frames.
+  Config processor_config = config;
+  if(impl_->processors.size() > 1)
+  {
+    if(config.TemporalFilterWindow > 1)
+    {
+      LOG_WARNING << "temporal filter is not supported with parallel processors, disabled";
+      processor_config.TemporalFilterWindow = 0;
+    }
+    if(config.EnableAdaptiveDepthQuality)
+    {
+      LOG_WARNING << "adaptive depth quality is not supported with parallel processors, disabled";
+      processor_config.EnableAdaptiveDepthQuality = false;
+    }
+  }
+  for(size_t i = 0; i < impl_->processors.size(); ++i)
+    impl_->processors[i]->setConfiguration(processor_config);
+}
+
+void ParallelDepthPacketProcessor::setDepthQualityListener(libfreenect2::DepthQualityListener *listener)
+{
+  DepthPacketProcessor::setDepthQualityListener(listener);
+  for(size_t i = 0; i < impl_->processors.size(); ++i)
+    impl_->processors[i]->setDepthQualityListener(listener);
+}
+
+void ParallelDepthPacketProcessor::loadP0TablesFromCommandResponse(unsigned char* buffer, size_t buffer_length)
+{
+  for(size_t i = 0; i < impl_->processors.size(); ++i)
+    impl_->processors[i]->loadP0TablesFromCommandResponse(buffer, buffer_length);
+}
+
+void ParallelDepthPacketProcessor::loadXZTables(const float *xtable, const float *ztable)
+{
+  for(size_t i = 0; i < impl_->processors.size(); ++i)
+    impl_->processors[i]->loadXZTables(xtable, ztable);
+}
+
+void ParallelDepthPacketProcessor::loadBinnedXZTables(const float *xtable, const float *ztable)
+{
+  for(size_t i = 0; i < impl_->processors.size(); ++i)
+    impl_->processors[i]->loadBinnedXZTables(xtable, ztable);
+}
+
+void ParallelDepthPacketProcessor::loadLookupTable(const short *lut)
+{
+  for(size_t i = 0; i < impl_->processors.size(); ++i)
+    impl_->processors[i]->loadLookupTable(lut);
+}
+
+bool ParallelDepthPacketProcessor::ready()
+{
+  return impl_->workers->ready();
+}
+
+bool ParallelDepthPacketProcessor::good()
+{
+  for(size_t i = 0; i < impl_->processors.size(); ++i)
+  {
+    if(!impl_->processors[i]->good())
+      return false;
+  }
+  return true;
+}
+
+void ParallelDepthPacketProcessor::process(const DepthPacket &packet)
+{
+  impl_->workers->process(packet);
+}
+
+void ParallelDepthPacketProcessor::setBufferCapacity(size_t count)
+{
+  DepthPacketProcessor::setBufferCapacity(count + impl_->processors.size());
+}
+
+} /* namespace libfreenect2 */
@@ -29,6 +29,7 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <libfreenect2/registration.h>
+#include <libfreenect2/cpu_depth_kernels.h>
 #include <limits>
 
 namespace libfreenect2
@@ -68,6 +69,8 @@ private:
   const int filter_width_half;
   const int filter_height_half;
   const float filter_tolerance;
+
+  const CpuDepthKernels *kernels; ///< Instruction set specific kernels.
 };
 
 void RegistrationImpl::distort(int mx, int my, float& x, float& y) const
@@ -120,6 +123,13 @@ void RegistrationImpl::apply( int dx, int dy, float dz, float& cx, float &cy) co
   cx = rx * color.fx + color.cx;
 }
 
+/** Whether @p depth is a 512x424 depth frame, of Float or UInt16 pixels. */
+static bool isDepthFrame(const Frame *depth)
+{
+  return depth->width == 512 && depth->height == 424 &&
+      (depth->bytes_per_pixel == 4 || (depth->bytes_per_pixel == 2 && depth->format == Frame::UInt16));
+}
+
 void Registration::apply(const Frame *rgb, const Frame *depth, Frame *undistorted, Frame *registered, const bool enable_filter, Frame *bigdepth, int *color_depth_map) const
 {
   impl_->apply(rgb, depth, undistorted, registered, enable_filter, bigdepth, color_depth_map);
@@ -130,20 +140,17 @@ void RegistrationImpl::apply(const Frame *rgb, const Frame *depth, Frame *undist
   // Check if all frames are valid and have the correct size
   if (!rgb || !depth || !undistorted || !registered ||
       rgb->width != 1920 || rgb->height != 1080 || rgb->bytes_per_pixel != 4 ||
-      depth->width != 512 || depth->height != 424 || depth->bytes_per_pixel != 4 ||
+      !isDepthFrame(depth) ||
       undistorted->width != 512 || undistorted->height != 424 || undistorted->bytes_per_pixel != 4 ||
       registered->width != 512 || registered->height != 424 || registered->bytes_per_pixel != 4)
     return;
 
-  const float *depth_data = (float*)depth->data;
   const unsigned int *rgb_data = (unsigned int*)rgb->data;
   float *undistorted_data = (float*)undistorted->data;
   unsigned int *registered_data = (unsigned int*)registered->data;
-  const int *map_dist = distort_map;
-  const float *map_x = depth_to_color_map_x;
-  const int *map_yi = depth_to_color_map_yi;
 
   const int size_depth = 512 * 424;
+
   const int size_color = 1920 * 1080;
   const float color_cx = color.cx + 0.5f; // 0.5f added for later rounding
 
@@ -162,64 +169,35 @@ void RegistrationImpl::apply(const Frame *rgb, const Frame *depth, Frame *undist
   int *depth_to_c_off = color_depth_map ? color_depth_map : new int[size_depth];
   int *map_c_off = depth_to_c_off;
 
-  // initializing the depth_map with values outside of the Kinect2 range
+  /* Fix depth distortion, and compute pixel to use from 'rgb' based on depth measurement,
+   * stored as x/y offset in the rgb data.
+   */
+  if (depth->bytes_per_pixel == 2)
+    kernels->mapUShortDepthToColor((const uint16_t*)depth->data, distort_map, depth_to_color_map_x, depth_to_color_map_yi,
+        color.shift_m, color.fx, color_cx, size_color, size_depth, undistorted_data, depth_to_c_off);
+  else
+    kernels->mapDepthToColor((const float*)depth->data, distort_map, depth_to_color_map_x, depth_to_color_map_yi,
+        color.shift_m, color.fx, color_cx, size_color, size_depth, undistorted_data, depth_to_c_off);
+
   if(enable_filter){
+    // initializing the depth_map with values outside of the Kinect2 range
     filter_map = bigdepth ? (float*)bigdepth->data : new float[size_filter_map];
     p_filter_map = filter_map + offset_filter_map;
 
     for(float *it = filter_map, *end = filter_map + size_filter_map; it != end; ++it){
       *it = std::numeric_limits<float>::infinity();
     }
-  }
-
-  /* Fix depth distortion, and compute pixel to use from 'rgb' based on depth measurement,
-   * stored as x/y offset in the rgb data.
-   */
-
-  // iterating over all pixels from undistorted depth and registered color image
-  // the four maps have the same structure as the images, so their pointers are increased each iteration as well
-  for(int i = 0; i < size_depth; ++i, ++undistorted_data, ++map_dist, ++map_x, ++map_yi, ++map_c_off){
-    // getting index of distorted depth pixel
-    const int index = *map_dist;
-
-    // check if distorted depth pixel is outside of the depth image
-    if(index < 0){
-      *map_c_off = -1;
-      *undistorted_data = 0;
-      continue;
-    }
 
-    // getting depth value for current pixel
-    const float z = depth_data[index];
-    *undistorted_data = z;
+    for(int i = 0; i < size_depth; ++i){
+      const int c_off = depth_to_c_off[i];
 
-    // checking for invalid depth value
-    if(z <= 0.0f){
-      *map_c_off = -1;
-      continue;
-    }
-
-    // calculating x offset for rgb image based on depth value
-    const float rx = (*map_x + (color.shift_m / z)) * color.fx + color_cx;
-    const int cx = rx; // same as round for positive numbers (0.5f was already added to color_cx)
-    // getting y offset for depth image
-    const int cy = *map_yi;
-    // combining offsets
-    const int c_off = cx + cy * 1920;
-
-    // check if c_off is outside of rgb image
-    // checking rx/cx is not needed because the color image is much wider then the depth image
-    if(c_off < 0 || c_off >= size_color){
-      *map_c_off = -1;
-      continue;
-    }
+      if(c_off < 0)
+        continue;
 
-    // saving the offset for later
-    *map_c_off = c_off;
+      const float z = undistorted_data[i];
 
-    if(enable_filter){
       // setting a window around the filter map pixel corresponding to the color pixel with the current z value
-      int yi = (cy - filter_height_half) * 1920 + cx - filter_width_half; // index of first pixel to set
+      int yi = c_off - filter_height_half * 1920 - filter_width_half; // index of first pixel to set
       for(int r = -filter_height_half; r <= filter_height_half; ++r, yi += 1920) // index increased by a full row each iteration
       {
         float *it = p_filter_map + yi;
@@ -282,11 +260,12 @@ void RegistrationImpl::undistortDepth(const Frame *depth, Frame *undistorted) co
 {
   // Check if all frames are valid and have the correct size
   if (!depth || !undistorted ||
-      depth->width != 512 || depth->height != 424 || depth->bytes_per_pixel != 4 ||
+      !isDepthFrame(depth) ||
       undistorted->width != 512 || undistorted->height != 424 || undistorted->bytes_per_pixel != 4)
     return;
 
   const float *depth_data = (float*)depth->data;
+  const uint16_t *depth_u16 = depth->bytes_per_pixel == 2 ? (const uint16_t*)depth->data : NULL;
   float *undistorted_data = (float*)undistorted->data;
   const int *map_dist = distort_map;
 
@@ -309,7 +288,7 @@ void RegistrationImpl::undistortDepth(const Frame *depth, Frame *undistorted) co
     }
 
     // getting depth value for current pixel
-    const float z = depth_data[index];
+    const float z = depth_u16 ? depth_u16[index] : depth_data[index];
     *undistorted_data = z;
   }
 }
@@ -368,7 +347,8 @@ Registration::~Registration()
 }
 
 RegistrationImpl::RegistrationImpl(Freenect2Device::IrCameraParams depth_p, Freenect2Device::ColorCameraParams rgb_p):
-  depth(depth_p), color(rgb_p), filter_width_half(2), filter_height_half(1), filter_tolerance(0.01f)
+  depth(depth_p), color(rgb_p), filter_width_half(2), filter_height_half(1), filter_tolerance(0.01f),
+  kernels(&selectCpuDepthKernels())
 {
   float mx, my;
   int ix, iy, index;
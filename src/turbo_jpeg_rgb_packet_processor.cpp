@@ -27,22 +27,28 @@
 /** @file turbo_jpeg_rgb_packet_processor.cpp JPEG decoder with Turbo Jpeg. */
 
 #include <libfreenect2/rgb_packet_processor.h>
+#include <libfreenect2/packet_worker_pool.h>
 #include <libfreenect2/logging.h>
 #include <turbojpeg.h>
 
+#include <cstdlib>
+#include <vector>
+
 namespace libfreenect2
 {
 
-/** Implementation of the Turbo-Jpeg decoder processor. */
-class TurboJpegRgbPacketProcessorImpl: public WithPerfLogging
+/**
+ * One TurboJPEG decompressor and the frame it decodes into. When several
+ * decoders run in parallel, each is the job of a worker.
+ */
+class TurboJpegDecoder: public PacketWorkerPool<RgbPacket>::Job, public WithPerfLogging
 {
 public:
-
   tjhandle decompressor;
 
   Frame *frame;
 
-  TurboJpegRgbPacketProcessorImpl()
+  TurboJpegDecoder()
   {
     decompressor = tjInitDecompress();
     if(decompressor == 0)
@@ -53,7 +59,7 @@ public:
     newFrame();
   }
 
-  ~TurboJpegRgbPacketProcessorImpl()
+  virtual ~TurboJpegDecoder()
   {
     delete frame;
 
@@ -71,47 +77,115 @@ public:
     frame = new Frame(1920, 1080, tjPixelSize[TJPF_BGRX]);
     frame->format = Frame::BGRX;
   }
-};
 
-TurboJpegRgbPacketProcessor::TurboJpegRgbPacketProcessor() :
-    impl_(new TurboJpegRgbPacketProcessorImpl())
-{
-}
-
-TurboJpegRgbPacketProcessor::~TurboJpegRgbPacketProcessor()
-{
-  delete impl_;
-}
+  virtual const char *name()
+  {
+    return "TurboJPEG";
+  }
 
-void TurboJpegRgbPacketProcessor::process(const RgbPacket &packet)
-{
-  if(impl_->decompressor != 0 && listener_ != 0)
+  /** Decode a packet, and pass the frame to @p frames. */
+  virtual void process(const RgbPacket &packet, FrameListener &frames)
   {
-    impl_->startTiming();
+    if(decompressor == 0 || (frames.subscribedFrameTypes() & Frame::Color) == 0)
+      return;
+
+    startTiming();
 
-    impl_->frame->timestamp = packet.timestamp;
-    impl_->frame->sequence = packet.sequence;
-    impl_->frame->exposure = packet.exposure;
-    impl_->frame->gain = packet.gain;
-    impl_->frame->gamma = packet.gamma;
+    frame->timestamp = packet.timestamp;
+    frame->sequence = packet.sequence;
+    frame->exposure = packet.exposure;
+    frame->gain = packet.gain;
+    frame->gamma = packet.gamma;
 
-    int r = tjDecompress2(impl_->decompressor, packet.jpeg_buffer, packet.jpeg_buffer_length, impl_->frame->data, 1920, 1920 * tjPixelSize[TJPF_BGRX], 1080, TJPF_BGRX, 0);
+    int r = tjDecompress2(decompressor, packet.jpeg_buffer, packet.jpeg_buffer_length, frame->data, 1920, 1920 * tjPixelSize[TJPF_BGRX], 1080, TJPF_BGRX, 0);
 
-    impl_->stopTiming(LOG_INFO);
+    stopTiming(LOG_INFO);
 
     if(r == 0)
     {
-      if(listener_->onNewFrame(Frame::Color, impl_->frame))
+      if(frames.onNewFrame(Frame::Color, frame))
       {
-        impl_->newFrame();
+        newFrame();
       }
     }
     else
     {
       LOG_ERROR << "Failed to decompress rgb image! TurboJPEG error: '" << tjGetErrorStr() << "'";
     }
+  }
+};
 
+/** Implementation of the Turbo-Jpeg decoder processor. */
+class TurboJpegRgbPacketProcessorImpl
+{
+public:
+  TurboJpegDecoder *decoder; ///< The decoder, with a single one.
+  PacketWorkerPool<RgbPacket> *decoders; ///< The decoders, with several.
+
+  TurboJpegRgbPacketProcessorImpl() :
+    decoder(0),
+    decoders(0)
+  {
+  }
+
+  ~TurboJpegRgbPacketProcessorImpl()
+  {
+    delete decoders;
+    delete decoder;
   }
+};
+
+TurboJpegRgbPacketProcessor::TurboJpegRgbPacketProcessor(size_t num_decoders) :
+    impl_(new TurboJpegRgbPacketProcessorImpl())
+{
+  if(num_decoders == 0)
+  {
+    const char *env = std::getenv("LIBFREENECT2_JPEG_DECODERS");
+    num_decoders = env != 0 && std::atoi(env) > 0 ? std::atoi(env) : 1;
+  }
+
+  if(num_decoders == 1)
+  {
+    impl_->decoder = new TurboJpegDecoder();
+    return;
+  }
+
+  std::vector<PacketWorkerPool<RgbPacket>::Job *> jobs;
+  for(size_t i = 0; i < num_decoders; ++i)
+    jobs.push_back(new TurboJpegDecoder());
+  impl_->decoders = new PacketWorkerPool<RgbPacket>(this, listener_, jobs);
+
+  // The two buffers of the default pool, and one for each decoder.
+  setBufferCapacity(2);
+  LOG_INFO << "decoding " << num_decoders << " color packets in parallel";
+}
+
+TurboJpegRgbPacketProcessor::~TurboJpegRgbPacketProcessor()
+{
+  delete impl_;
+}
+
+bool TurboJpegRgbPacketProcessor::ready()
+{
+  return impl_->decoders == 0 || impl_->decoders->ready();
+}
+
+bool TurboJpegRgbPacketProcessor::releasesBuffers()
+{
+  return impl_->decoders != 0;
+}
+
+void TurboJpegRgbPacketProcessor::setBufferCapacity(size_t count)
+{
+  RgbPacketProcessor::setBufferCapacity(impl_->decoders != 0 ? count + impl_->decoders->size() : count);
+}
+
+void TurboJpegRgbPacketProcessor::process(const RgbPacket &packet)
+{
+  if(impl_->decoders != 0)
+    impl_->decoders->process(packet);
+  else if(listener_ != 0)
+    impl_->decoder->process(packet, *listener_);
 }
 
 } /* namespace libfreenect2 */
@@ -0,0 +1,647 @@
+/*
+ * This file is part of the OpenKinect Project. http://www.openkinect.org
+ *
+ * Copyright (c) 2014 individual OpenKinect contributors. See the CONTRIB file
+ * for details.
+ *
+ * This code is licensed to you under the terms of the Apache License, version
+ * 2.0, or, at your option, the terms of the GNU General Public License,
+ * version 2.0. See the APACHE20 and GPL2 files for the text of the licenses,
+ * or the following URLs:
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * http://www.gnu.org/licenses/gpl-2.0.txt
+ *
+ * If you redistribute this file in source form, modified or unmodified, you
+ * may:
+ *   1) Leave this header intact and distribute it under the same terms,
+ *      accompanying it with the APACHE20 and GPL20 files, or
+ *   2) Delete the Apache 2.0 clause and accompany it with the GPL2 file, or
+ *   3) Delete the GPL v2 clause and accompany it with the APACHE20 file
+ * In all cases you must keep the copyright notice intact and include a copy
+ * of the CONTRIB file.
+ *
+ * Binary distributions must follow the binary distribution requirements of
+ * either License.
+ */
+
+/** @file cpu_depth_kernels_check.cpp Parity check of the CPU depth kernels against the scalar reference. */
+
+#include <libfreenect2/cpu_depth_kernels.h>
+#include <libfreenect2/protocol/response.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+using namespace libfreenect2;
+
+static const int WIDTH = 512;
+static const int HEIGHT = 424;
+static const int NUM_PIXELS = WIDTH * HEIGHT;
+
+/** Bytes of a raw depth sub-image; a packet has ten of them. */
+static const size_t SUB_IMAGE_SIZE = WIDTH * HEIGHT * 11 / 8;
+
+/** Deterministic pseudo-random numbers, so that every run checks the same frame. */
+static unsigned int random_state = 12345;
+
+static unsigned int nextRandom()
+{
+  random_state = random_state * 1664525u + 1013904223u;
+  return random_state >> 8;
+}
+
+/**
+ * Read @p size bytes from the start of a file.
+ * @return False if the file is shorter or can not be read.
+ */
+static bool readFile(const char *path, void *data, size_t size)
+{
+  std::ifstream file(path, std::ios::binary);
+  if(!file.read(static_cast<char *>(data), size))
+  {
+    std::cerr << "can not read " << size << " bytes from " << path << std::endl;
+    return false;
+  }
+  return true;
+}
+
+/** Input of the kernels: a frame, synthetic or recorded, and its tables. */
+struct Input
+{
+  std::vector<int16_t> raw[9];
+  std::vector<uint16_t> p0[3];
+  std::vector<float> x_table, z_table;
+
+  /** Registration maps. */
+  std::vector<int> map_dist, map_yi;
+  std::vector<float> map_x;
+
+  /**
+   * Measurements of a scene of slanted planes with a step, of changing
+   * reflectivity with dark and saturated patches.
+   */
+  Input()
+  {
+    static const float modulation[3] = {3.0f, 15.0f, 2.0f}; // phase wraps per unambiguous distance
+    const float pi = 3.14159265f;
+    DepthPacketProcessor::Parameters params;
+
+    for(int i = 0; i < 9; ++i)
+      raw[i].resize(NUM_PIXELS);
+    for(int i = 0; i < 3; ++i)
+      p0[i].resize(NUM_PIXELS);
+    x_table.resize(NUM_PIXELS);
+    z_table.resize(NUM_PIXELS);
+    map_dist.resize(NUM_PIXELS);
+    map_yi.resize(NUM_PIXELS);
+    map_x.resize(NUM_PIXELS);
+
+    for(int y = 0; y < HEIGHT; ++y)
+    {
+      for(int x = 0; x < WIDTH; ++x)
+      {
+        const int i = y * WIDTH + x;
+
+        const float xu = (x + 0.5f - 256.0f) / 365.0f, yu = (y + 0.5f - 212.0f) / 365.0f;
+        x_table[i] = 8192.0f * xu;
+        z_table[i] = x < 3 ? 0.0f : 2083.333f / std::sqrt(xu * xu + yu * yu + 1.0f);
+
+        float distance = 0.15f + 0.25f * x / WIDTH + 0.1f * y / HEIGHT;
+        if(x > 300 && y > 150 && y < 300)
+          distance += 0.1f;
+
+        float amplitude = 200.0f + 150.0f * ((x / 40 + y / 40) % 3) + (nextRandom() % 20);
+        if((x / 64 + y / 64) % 7 == 0)
+          amplitude = 2.0f;
+
+        for(int k = 0; k < 3; ++k)
+        {
+          const float wraps = distance * modulation[k];
+          const float noise = 0.02f * ((int)(nextRandom() % 100) - 50) / 50.0f;
+          const float phase = 2.0f * pi * (wraps - std::floor(wraps)) + noise;
+          for(int j = 0; j < 3; ++j)
+          {
+            float v = amplitude * std::cos(phase + params.phase_in_rad[j]);
+            raw[3 * k + j][i] = x == 100 && y > 50 && y < 60 ? 32767 : (int16_t)std::floor(v + 0.5f);
+          }
+          p0[k][i] = (uint16_t)(nextRandom() & 0xffff);
+        }
+
+        map_dist[i] = x < 8 || y < 4 ? -1 : (y - 2) * WIDTH + x - 4;
+        map_x[i] = xu * 0.98f - 0.025f;
+        map_yi[i] = std::min(1079, std::max(0, (int)(540.0f + yu * 1050.0f)));
+      }
+    }
+  }
+
+  /**
+   * Replace the frame and its tables by a recording, in the formats of
+   * DumpPacketPipeline: the depth packet, the P0 tables command response,
+   * the x and z tables, and the lookup table. The packet is unpacked by the
+   * scalar kernels, which checkUnpack() checks.
+   * @param paths Files of each, in this order.
+   * @return False if a file can not be read.
+   */
+  bool load(char *paths[5])
+  {
+    std::vector<unsigned char> packet(10 * SUB_IMAGE_SIZE), response(sizeof(protocol::P0TablesResponse));
+    std::vector<int16_t> lut(2048);
+    if(!readFile(paths[0], &packet[0], packet.size()) || !readFile(paths[1], &response[0], response.size()) ||
+        !readFile(paths[2], &x_table[0], NUM_PIXELS * sizeof(float)) || !readFile(paths[3], &z_table[0], NUM_PIXELS * sizeof(float)) ||
+        !readFile(paths[4], &lut[0], lut.size() * sizeof(int16_t)))
+      return false;
+
+    const CpuDepthKernels &scalar = *findCpuDepthKernels("scalar");
+    for(int i = 0; i < 9; ++i)
+    {
+      for(int y = 0; y < HEIGHT; ++y)
+        scalar.unpackRow(&packet[0], i, y, &lut[0], 0, WIDTH, &raw[i][y * WIDTH]);
+    }
+
+    // The P0 tables are upside down, as CpuDepthPacketProcessor reads them.
+    const size_t offsets[3] = {offsetof(protocol::P0TablesResponse, p0table0), offsetof(protocol::P0TablesResponse, p0table1),
+        offsetof(protocol::P0TablesResponse, p0table2)};
+    for(int i = 0; i < 3; ++i)
+    {
+      for(int y = 0; y < HEIGHT; ++y)
+        std::memcpy(&p0[i][y * WIDTH], &response[offsets[i] + (HEIGHT - 1 - y) * WIDTH * sizeof(uint16_t)], WIDTH * sizeof(uint16_t));
+    }
+    return true;
+  }
+
+  const int16_t *rawRow(int i, int y) const { return &raw[i][y * WIDTH]; }
+  const uint16_t *p0Row(int i, int y) const { return &p0[i][y * WIDTH]; }
+};
+
+/** Planes of a whole frame, with the row pointers the kernels take. */
+struct Planes
+{
+  std::vector<float> a[3], b[3], amplitude[3];
+  std::vector<unsigned char> max_edge_test;
+  std::vector<float> ir, depth, ir_sum, dealiasing;
+
+  Planes()
+  {
+    for(int i = 0; i < 3; ++i)
+    {
+      a[i].resize(NUM_PIXELS);
+      b[i].resize(NUM_PIXELS);
+      amplitude[i].resize(NUM_PIXELS);
+    }
+    max_edge_test.resize(NUM_PIXELS);
+    ir.resize(NUM_PIXELS);
+    depth.resize(NUM_PIXELS);
+    ir_sum.resize(NUM_PIXELS);
+    dealiasing.resize(NUM_PIXELS);
+  }
+
+  Stage1Row stage1Row(int y)
+  {
+    Stage1Row row;
+    for(int i = 0; i < 3; ++i)
+    {
+      row.a[i] = &a[i][y * WIDTH];
+      row.b[i] = &b[i][y * WIDTH];
+      row.amplitude[i] = &amplitude[i][y * WIDTH];
+    }
+    return row;
+  }
+
+  FilteredRow filteredRow(int y)
+  {
+    FilteredRow row;
+    for(int i = 0; i < 3; ++i)
+    {
+      row.a[i] = &a[i][y * WIDTH];
+      row.b[i] = &b[i][y * WIDTH];
+    }
+    row.max_edge_test = &max_edge_test[y * WIDTH];
+    return row;
+  }
+};
+
+/** Hypotheses of the KDE phase unwrapping, with their border. */
+struct KdeInput
+{
+  std::vector<float> phase[3], conf[3];
+  KdePlanes planes;
+
+  explicit KdeInput(const DepthPacketProcessor::Parameters &params)
+  {
+    const int border = (int)params.kde_neigborhood_size;
+    planes.stride = WIDTH + 2 * border;
+    const size_t size = (size_t)planes.stride * (HEIGHT + 2 * border);
+    const size_t origin = (size_t)border * planes.stride + border;
+
+    for(size_t i = 0; i < 3; ++i)
+    {
+      const bool used = i < params.num_hyps;
+      phase[i].assign(used ? size : 0, 0.0f);
+      conf[i].assign(used ? size : 0, 0.0f);
+      planes.phase[i] = used ? &phase[i][origin] : 0;
+      planes.conf[i] = used ? &conf[i][origin] : 0;
+    }
+  }
+};
+
+/** Measurement of pixel (x, y) of raw depth sub-image @p sub, decoded bit by bit. */
+static int16_t decodePixel(const unsigned char *data, const int16_t *lut, int sub, int x, int y)
+{
+  if(x == 0 || x == WIDTH - 1)
+    return lut[0];
+
+  const unsigned char *row = &data[SUB_IMAGE_SIZE * sub + WIDTH * 11 / 8 * (y < 212 ? y + 212 : 423 - y)];
+  const int bit = (x / 4 + (x % 4) * 128) * 11;
+  int code = 0;
+  for(int i = 0; i < 11; ++i)
+    code |= ((row[(bit + i) / 8] >> ((bit + i) % 8)) & 1) << i;
+  return lut[code];
+}
+
+/**
+ * Unpack every row of the sub-images of a random packet, over whole rows and
+ * column ranges of parts of rows, and compare with decodePixel(). Columns
+ * out of the range must not be written.
+ * @return Whether all rows are unpacked exactly.
+ */
+static bool checkUnpack(const CpuDepthKernels &kernels)
+{
+  static const int ranges[][2] = {{0, 512}, {16, 496}, {0, 16}, {496, 512}, {48, 80}, {64, 128}, {112, 400}};
+  static const int16_t untouched = 32000;
+
+  // Ten sub-images, of which the last one is never unpacked.
+  std::vector<unsigned char> data(10 * SUB_IMAGE_SIZE);
+  for(size_t i = 0; i < data.size(); ++i)
+    data[i] = (unsigned char)nextRandom();
+  std::vector<int16_t> lut(2048);
+  for(size_t i = 0; i < lut.size(); ++i)
+    lut[i] = (int16_t)(nextRandom() % 8192) - 4096;
+
+  size_t count = 0, mismatches = 0;
+  std::vector<int16_t> out(WIDTH);
+  for(size_t r = 0; r < sizeof(ranges) / sizeof(ranges[0]); ++r)
+  {
+    const int x_begin = ranges[r][0], x_end = ranges[r][1];
+    for(int sub = 0; sub < 9; ++sub)
+    {
+      for(int y = 0; y < HEIGHT; ++y)
+      {
+        std::fill(out.begin(), out.end(), untouched);
+        kernels.unpackRow(&data[0], sub, y, &lut[0], x_begin, x_end, &out[0]);
+
+        for(int x = 0; x < WIDTH; ++x)
+        {
+          const int16_t expected = x_begin <= x && x < x_end ? decodePixel(&data[0], &lut[0], sub, x, y) : untouched;
+          mismatches += out[x] != expected ? 1 : 0;
+        }
+        count += WIDTH;
+      }
+    }
+  }
+
+  const bool ok = mismatches == 0;
+  std::cout << (ok ? "ok   " : "FAIL ") << kernels.isa << " unpack: " << mismatches << "/" << count << " values differ" << std::endl;
+  return ok;
+}
+
+/**
+ * Error bound of an output against the scalar kernels, see CpuDepthKernels.
+ *
+ * The error of a value is its difference from the scalar value divided by a
+ * scale, which is the larger of the magnitude of the scalar value and 1
+ * unless the output has its own. Values which the kernels decide by
+ * comparing, like a phase unwrapping or an edge test, may differ more
+ * where the decision differs.
+ */
+struct Bound
+{
+  double tolerance;      ///< Largest error of a value.
+  double decisions;      ///< Fraction of the values allowed beyond #tolerance, where a decision differs.
+  double decision_error; ///< Largest error of these.
+};
+
+/**
+ * Compare the outputs of a kernel against the scalar ones, and print the
+ * largest error of all values.
+ * @param isa Name of the kernels.
+ * @param name Name of the output.
+ * @param bound Bound of the output.
+ * @param reference Scalar output.
+ * @param output Output of the kernels.
+ * @param scale Scale of the error of each value, or NULL for the magnitude of the scalar value.
+ * @param count Number of values.
+ * @return Whether the outputs are within the bound.
+ */
+template<typename T>
+static bool compare(const char *isa, const char *name, const Bound &bound, const T *reference, const T *output, const float *scale, size_t count)
+{
+  size_t beyond = 0;
+  double max_error = 0.0;
+
+  for(size_t i = 0; i < count; ++i)
+  {
+    const double r = reference[i], o = output[i];
+    if(r == o || (r != r && o != o))
+      continue;
+
+    const double error = std::fabs(o - r) / std::max(scale != 0 ? scale[i] : std::fabs(r), 1.0);
+    if(!(error <= bound.tolerance))
+      ++beyond;
+    if(!(error <= max_error))
+      max_error = error;
+  }
+
+  const bool ok = max_error <= bound.tolerance || (beyond <= bound.decisions * count && max_error <= bound.decision_error);
+  std::cout << (ok ? "ok   " : "FAIL ") << isa << " " << name << ": max error " << max_error << " (bound " << bound.tolerance << "), "
+            << beyond << "/" << count << " values beyond it";
+  if(bound.decisions > 0)
+    std::cout << ", decided values up to " << bound.decision_error;
+  std::cout << std::endl;
+  return ok;
+}
+
+template<typename T>
+static bool compare(const char *isa, const char *name, const Bound &bound, const std::vector<T> &reference, const std::vector<T> &output,
+    const std::vector<float> *scale = 0)
+{
+  return compare(isa, name, bound, &reference[0], &output[0], scale != 0 ? &(*scale)[0] : 0, reference.size());
+}
+
+/** Bounds of the outputs; see CpuDepthKernels for how they follow from the kernels. */
+static const Bound EXACT = {0.0, 0.0, 0.0};
+static const Bound STAGE1_BOUND = {1e-6, 0.0, 0.0};
+static const Bound BILATERAL_BOUND = {1e-6, 0.0, 0.0};
+static const Bound EDGE_TEST_BOUND = {0.0, 1e-3, 1.0};
+static const Bound AMPLITUDE_BOUND = {1e-6, 0.0, 0.0};
+static const Bound DEPTH_BOUND = {1e-5, 1e-3, 9.0};
+static const Bound DEALIASING_BOUND = {1e-4, 1e-3, 1.0};
+static const Bound KDE_PHASE_BOUND = {1e-6, 0.0, 0.0};
+static const Bound KDE_LIKELIHOOD_BOUND = {1e-5, 1e-3, 1e-2};
+static const Bound COLOR_COLUMN_BOUND = {0.0, 1e-3, 1.0};
+
+/**
+ * Sum of the magnitudes of the measurements of frequency @p i, times
+ * @p multiplier: the scale of the errors of stage 1, as the measurements
+ * mostly cancel out in a and b.
+ */
+static std::vector<float> measurementScale(const Input &input, int i, float multiplier)
+{
+  std::vector<float> scale(NUM_PIXELS);
+  for(int j = 0; j < NUM_PIXELS; ++j)
+    scale[j] = multiplier * (std::abs((int)input.raw[3 * i][j]) + std::abs((int)input.raw[3 * i + 1][j]) + std::abs((int)input.raw[3 * i + 2][j]));
+  return scale;
+}
+
+/** Norm of a and b of frequency @p i. */
+static std::vector<float> abNorm(const Planes &planes, int i)
+{
+  std::vector<float> norm(NUM_PIXELS);
+  for(int j = 0; j < NUM_PIXELS; ++j)
+    norm[j] = std::sqrt(planes.a[i][j] * planes.a[i][j] + planes.b[i][j] * planes.b[i][j]);
+  return norm;
+}
+
+/** Largest of @p norm over the 3x3 neighbourhood of each pixel, the scale of the errors of the bilateral filter. */
+static std::vector<float> neighbourhoodMax(const std::vector<float> &norm)
+{
+  std::vector<float> out(NUM_PIXELS);
+  for(int y = 0; y < HEIGHT; ++y)
+  {
+    for(int x = 0; x < WIDTH; ++x)
+    {
+      float m = 0.0f;
+      for(int yi = std::max(y - 1, 0); yi <= std::min(y + 1, HEIGHT - 1); ++yi)
+        for(int xi = std::max(x - 1, 0); xi <= std::min(x + 1, WIDTH - 1); ++xi)
+          m = std::max(m, norm[yi * WIDTH + xi]);
+      out[y * WIDTH + x] = m;
+    }
+  }
+  return out;
+}
+
+/**
+ * Rank the hypotheses of equal likelihood of each pixel by phase. The
+ * kernels rank hypotheses of equal residual in any order.
+ */
+static void rankTies(const DepthPacketProcessor::Parameters &params, KdeInput &kde)
+{
+  const KdePlanes &planes = kde.planes;
+  for(int y = 0; y < HEIGHT; ++y)
+  {
+    for(int x = 0; x < WIDTH; ++x)
+    {
+      const int i = y * planes.stride + x;
+      for(size_t n = 1; n < params.num_hyps; ++n)
+      {
+        for(size_t j = 0; j + n < params.num_hyps; ++j)
+        {
+          const bool tie = std::fabs(planes.conf[j][i] - planes.conf[j + 1][i]) <= KDE_LIKELIHOOD_BOUND.tolerance;
+          if(tie && planes.phase[j + 1][i] < planes.phase[j][i])
+          {
+            std::swap(planes.phase[j][i], planes.phase[j + 1][i]);
+            std::swap(planes.conf[j][i], planes.conf[j + 1][i]);
+          }
+        }
+      }
+    }
+  }
+}
+
+/**
+ * Column of each color offset, or one column out of the color image for
+ * pixels mapped out of it; to compare offsets within a row of the image.
+ */
+static std::vector<int> colorColumns(const std::vector<int> &offset, const std::vector<int> &reference, const Input &input)
+{
+  std::vector<int> column(NUM_PIXELS);
+  for(int i = 0; i < NUM_PIXELS; ++i)
+  {
+    const int expected = reference[i] >= 0 ? reference[i] - input.map_yi[i] * 1920 : 960;
+    column[i] = offset[i] >= 0 ? offset[i] - input.map_yi[i] * 1920 : expected < 960 ? -1 : 1920;
+  }
+  return column;
+}
+
+/**
+ * Run each kernel of @p kernels and of the scalar kernels on the same
+ * input, the scalar output of the kernel before it, and compare them.
+ * @return Whether all outputs are within their bound.
+ */
+static bool check(const CpuDepthKernels &kernels, const CpuDepthKernels &scalar, const Input &input)
+{
+  DepthPacketProcessor::Parameters params;
+  bool ok = true;
+
+  // Stage 1 and IR.
+  Planes stage1[2];
+  std::vector<float> ir[2];
+  const CpuDepthKernels *k[2] = {&scalar, &kernels};
+  for(int n = 0; n < 2; ++n)
+  {
+    ir[n].resize(NUM_PIXELS);
+    for(int y = 0; y < HEIGHT; ++y)
+    {
+      const int16_t *raw[9];
+      for(int i = 0; i < 9; ++i)
+        raw[i] = input.rawRow(i, y);
+      const uint16_t *p0_row[3] = {input.p0Row(0, y), input.p0Row(1, y), input.p0Row(2, y)};
+
+      const Stage1Row out = stage1[n].stage1Row(y);
+      k[n]->processStage1Row(params, raw, p0_row, &input.z_table[y * WIDTH], 0, WIDTH, out);
+      k[n]->processIrRow(params, stage1[0].stage1Row(y), 0, WIDTH, &ir[n][y * WIDTH]);
+    }
+  }
+  for(int i = 0; i < 3; ++i)
+  {
+    const std::vector<float> scale = measurementScale(input, i, params.ab_multiplier_per_frq[i]);
+    const std::vector<float> amplitude_scale = measurementScale(input, i, params.ab_multiplier_per_frq[i] * params.ab_multiplier);
+    ok &= compare(kernels.isa, "stage 1 a", STAGE1_BOUND, stage1[0].a[i], stage1[1].a[i], &scale);
+    ok &= compare(kernels.isa, "stage 1 b", STAGE1_BOUND, stage1[0].b[i], stage1[1].b[i], &scale);
+    ok &= compare(kernels.isa, "stage 1 amplitude", STAGE1_BOUND, stage1[0].amplitude[i], stage1[1].amplitude[i], &amplitude_scale);
+  }
+  ok &= compare(kernels.isa, "IR", AMPLITUDE_BOUND, ir[0], ir[1]);
+
+  // Bilateral filter of the scalar stage 1 output.
+  Planes filtered[2];
+  for(int n = 0; n < 2; ++n)
+  {
+    for(int y = 0; y < HEIGHT; ++y)
+    {
+      const Stage1Row rows[3] = {stage1[0].stage1Row(std::max(y - 1, 0)), stage1[0].stage1Row(y), stage1[0].stage1Row(std::min(y + 1, HEIGHT - 1))};
+      const Stage1Row *m[3] = {&rows[0], &rows[1], &rows[2]};
+      k[n]->filterStage1Row(y, params, m, WIDTH, HEIGHT, 0, WIDTH, filtered[n].filteredRow(y));
+    }
+  }
+  for(int i = 0; i < 3; ++i)
+  {
+    const std::vector<float> scale = neighbourhoodMax(abNorm(stage1[0], i));
+    ok &= compare(kernels.isa, "bilateral filter a", BILATERAL_BOUND, filtered[0].a[i], filtered[1].a[i], &scale);
+    ok &= compare(kernels.isa, "bilateral filter b", BILATERAL_BOUND, filtered[0].b[i], filtered[1].b[i], &scale);
+  }
+  ok &= compare(kernels.isa, "bilateral filter edge test", EDGE_TEST_BOUND, filtered[0].max_edge_test, filtered[1].max_edge_test);
+
+  // Stage 2 and the KDE phase hypotheses of the scalar filter output.
+  KdeInput kde_phase_scalar(params), kde_phase_output(params);
+  KdeInput *kde_phase[2] = {&kde_phase_scalar, &kde_phase_output};
+  Planes stage2[2];
+  for(int n = 0; n < 2; ++n)
+  {
+    for(int y = 0; y < HEIGHT; ++y)
+    {
+      const int row = y * WIDTH;
+      k[n]->processStage2Row(params, filtered[0].filteredRow(y), stage1[0].stage1Row(y), &input.x_table[row], &input.z_table[row], 0, WIDTH,
+          &stage2[n].ir[row], &stage2[n].depth[row], &stage2[n].ir_sum[row], &stage2[n].dealiasing[row]);
+      k[n]->processKdePhaseRow(params, filtered[0].filteredRow(y), stage1[0].stage1Row(y), 0, WIDTH, 0, kde_phase[n]->planes, y);
+    }
+  }
+  rankTies(params, kde_phase_scalar);
+  rankTies(params, kde_phase_output);
+  ok &= compare(kernels.isa, "stage 2 IR", AMPLITUDE_BOUND, stage2[0].ir, stage2[1].ir);
+  ok &= compare(kernels.isa, "stage 2 depth", DEPTH_BOUND, stage2[0].depth, stage2[1].depth, &input.z_table);
+  ok &= compare(kernels.isa, "stage 2 IR sum", AMPLITUDE_BOUND, stage2[0].ir_sum, stage2[1].ir_sum);
+  ok &= compare(kernels.isa, "stage 2 dealiasing confidence", DEALIASING_BOUND, stage2[0].dealiasing, stage2[1].dealiasing);
+  for(size_t i = 0; i < params.num_hyps; ++i)
+  {
+    ok &= compare(kernels.isa, "KDE phase", KDE_PHASE_BOUND, kde_phase_scalar.phase[i], kde_phase_output.phase[i]);
+    ok &= compare(kernels.isa, "KDE likelihood", KDE_LIKELIHOOD_BOUND, kde_phase_scalar.conf[i], kde_phase_output.conf[i]);
+  }
+
+  // KDE filter of the scalar hypotheses.
+  const int size = (int)params.kde_neigborhood_size;
+  const float sigma = 0.5f * size;
+  std::vector<float> gauss(2 * size + 1);
+  for(int i = -size; i <= size; ++i)
+    gauss[i + size] = std::exp(-0.5f * i * i / (sigma * sigma));
+
+  std::vector<float> kde_depth[2];
+  for(int n = 0; n < 2; ++n)
+  {
+    kde_depth[n].resize(NUM_PIXELS);
+    for(int y = 0; y < HEIGHT; ++y)
+    {
+      const int row = y * WIDTH;
+      k[n]->filterKdeRow(params, kde_phase_scalar.planes, y, &gauss[0], &input.x_table[row], &input.z_table[row], 0, WIDTH, &kde_depth[n][row]);
+    }
+  }
+  ok &= compare(kernels.isa, "KDE depth", DEPTH_BOUND, kde_depth[0], kde_depth[1], &input.z_table);
+
+  // Registration of the scalar depth, in both formats.
+  std::vector<uint16_t> depth_mm(NUM_PIXELS);
+  for(int i = 0; i < NUM_PIXELS; ++i)
+    depth_mm[i] = (uint16_t)std::min(stage2[0].depth[i] + 0.5f, 65535.0f);
+
+  std::vector<float> undistorted[2];
+  std::vector<int> color_offset[2];
+  const std::vector<float> one(NUM_PIXELS, 1.0f);
+  for(int format = 0; format < 2; ++format)
+  {
+    for(int n = 0; n < 2; ++n)
+    {
+      undistorted[n].resize(NUM_PIXELS);
+      color_offset[n].resize(NUM_PIXELS);
+      if(format == 0)
+        k[n]->mapDepthToColor(&stage2[0].depth[0], &input.map_dist[0], &input.map_x[0], &input.map_yi[0], 52.0f, 1081.37f, 960.0f,
+            1920 * 1080, NUM_PIXELS, &undistorted[n][0], &color_offset[n][0]);
+      else
+        k[n]->mapUShortDepthToColor(&depth_mm[0], &input.map_dist[0], &input.map_x[0], &input.map_yi[0], 52.0f, 1081.37f, 960.0f,
+            1920 * 1080, NUM_PIXELS, &undistorted[n][0], &color_offset[n][0]);
+    }
+    ok &= compare(kernels.isa, format == 0 ? "registration depth" : "registration UInt16 depth", EXACT, undistorted[0], undistorted[1]);
+    ok &= compare(kernels.isa, format == 0 ? "registration color column" : "registration UInt16 color column", COLOR_COLUMN_BOUND,
+        colorColumns(color_offset[0], color_offset[0], input), colorColumns(color_offset[1], color_offset[0], input), &one);
+  }
+
+  return ok;
+}
+
+/**
+ * Main application entry point.
+ *
+ * Runs every kernel set built in and supported by this CPU on a frame, and
+ * checks its outputs against the scalar kernels. The frame is synthetic, or
+ * a recorded packet given with its tables in the formats of
+ * DumpPacketPipeline. The unpacking of every kernel set, the scalar one
+ * included, is checked against a decoding of each pixel.
+ * @return 0 if all are within the bounds documented in cpu_depth_kernels.h, 1 otherwise.
+ */
+int main(int argc, char **argv)
+{
+  static const char *isas[] = {"scalar", "sse2", "avx2", "neon"};
+
+  if(argc != 1 && argc != 6)
+  {
+    std::cerr << "Usage: " << argv[0] << " [<depth packet> <P0 tables> <x table> <z table> <lookup table>]" << std::endl;
+    return 1;
+  }
+
+  Input input;
+  if(argc == 6 && !input.load(argv + 1))
+    return 1;
+  std::cout << "checking " << (argc == 6 ? "the recorded packet" : "a synthetic frame") << std::endl;
+
+  const CpuDepthKernels *scalar = findCpuDepthKernels("scalar");
+  bool ok = true;
+  int checked = 0;
+
+  for(size_t i = 0; i < sizeof(isas) / sizeof(isas[0]); ++i)
+  {
+    const CpuDepthKernels *kernels = findCpuDepthKernels(isas[i]);
+    if(kernels == 0)
+    {
+      std::cout << "skip " << isas[i] << ": not built in or not supported" << std::endl;
+      continue;
+    }
+    ok &= checkUnpack(*kernels);
+    if(kernels != scalar)
+      ok &= check(*kernels, *scalar, input);
+    ++checked;
+  }
+
+  std::cout << (ok ? "PASSED" : "FAILED") << ": " << checked << " kernel set(s) checked" << std::endl;
+  return ok ? 0 : 1;
+}